@@ -2,14 +2,97 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <map>
+#include <charconv>
+#include <filesystem>
+
+// the crc32 instruction comes with SSE4.2, its 8-byte form only in 64-bit builds; crc32c checks CPUID at run time,
+// so a default x64 build (no /arch:AVX or -msse4.2) still uses it on CPUs that have it
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSE42_TARGET
+#else
+#include <cpuid.h>
+#define SSE42_TARGET __attribute__((target("sse4.2")))
+#endif
+#define HAS_SSE42
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#define fsync _commit
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
 
 // constants
 
 const std::string CLIENTS_FILE = "CLIENTS.txt";
+const std::string CLIENTS_INDEX_FILE = "CLIENTS.idx";
+const std::string CLIENTS_INDEX_SIZE_KEY = "#size";    // index slot holding the CLIENTS.txt size it was built from
+const std::string CLIENTS_INDEX_LOCK_FILE = "CLIENTS.lock";    // the bank and the ATMs hold it around every CLIENTS.idx write
+const std::string HOT_BALANCES_FILE = "BALANCES.idx";  // account number -> latest balance, overrides the one in CLIENTS.txt
+const std::string HOT_BALANCES_LOCK_FILE = "BALANCES.lock";    // the bank and the ATMs hold it around every BALANCES.idx change
+const std::string CLIENTS_SHARDS_FILE = "CLIENTS_SHARDS.txt";  // how many shard files the bank split CLIENTS.txt into
+const std::string HISTORY_INDEX_FILE = "HISTORY.idx";
+const std::string HISTORY_LOCK_FILE = "HISTORY.lock";   // held from reading the head slot to writing the new one
+const std::string HISTORY_SEGMENT_PREFIX = "HISTORY_";
+const std::string CASSETTES_FILE = "CASSETTES.txt";
+
+// ATM-local files, the terminal keeps working from these while the master CLIENTS.txt can't be reached
+const std::string ATM_ID = "ATM01";
+const std::string ATM_CACHE_FILE = "ATM_CACHE.txt";
+const std::string ATM_OUTBOX_FILE = "ATM_OUTBOX.txt";
+const std::string ATM_SYNC_STATE_FILE = "ATM_SYNC.txt";
+const std::string ATM_CONFLICTS_FILE = "ATM_CONFLICTS.txt";
+const std::string ATM_COMMIT_FILE = "ATM_COMMIT.txt";  // names the files of a commit whose renames aren't all done yet
+const std::string MASTER_SYNC_JOURNAL_FILE = "SYNC_" + ATM_ID + ".txt";    // next to CLIENTS.txt
 const std::string SEPARATOR = " /##/ ";
 const std::string CURRENCY = "$";
 
-const int CLIENT_NOT_FOUND = -1;
+namespace dispenser {
+
+    // one cassette per denomination, largest first
+    constexpr int NUM_OF_CASSETTES = 6;
+    constexpr int DENOMINATIONS[NUM_OF_CASSETTES] = { 200, 100, 50, 20, 10, 5 };
+    constexpr int AMOUNT_STEP = 5;     // gcd of the denominations
+    constexpr int MAX_WITHDRAW = 5000;
+    constexpr int NUM_OF_AMOUNTS = MAX_WITHDRAW / AMOUNT_STEP + 1;
+    constexpr int DEFAULT_NOTES_PER_CASSETTE = 200;
+    constexpr uint16_t UNREACHABLE = UINT16_MAX;
+}
+
+namespace loadtest {
+
+    constexpr int NUM_OF_FLOWS = 6;
+    constexpr int NUM_OF_RESULTS = 8;
+    constexpr int NOTES_PER_CASSETTE = 1000000;     // withdrawals are measured, not starved by an empty machine
+}
 
 // types (enums & structs)
 
@@ -19,7 +102,8 @@ enum eMainMenu {
     NORMAL_WITHDRAW = 2,
     DEPOSIT = 3,
     SHOW_BALANCE = 4,
-    LOGOUT = 5,
+    MINI_STATEMENT = 5,
+    LOGOUT = 6,
 };
 
 enum eQuickWithdraw {
@@ -35,6 +119,14 @@ enum eQuickWithdraw {
     EXIT = 9,
 };
 
+enum eHistoryType {
+
+    HISTORY_DEPOSIT = 1,
+    HISTORY_WITHDRAW = 2,
+    HISTORY_TRANSFER_IN = 3,
+    HISTORY_TRANSFER_OUT = 4,
+};
+
 struct sClient {
 
     std::string accountNum;
@@ -44,6 +136,313 @@ struct sClient {
     float balance;
 };
 
+// why a transaction was refused, or not
+enum eAtmResult {
+
+    ATM_OK = 0,
+    ATM_INSUFFICIENT_BALANCE = 1,
+    ATM_CANT_DISPENSE = 2,
+    ATM_PENDING_LIMIT = 3,
+    ATM_CASSETTE_CONFLICT = 4,
+    ATM_SAVE_FAILED = 5,
+    ATM_LOGIN_FAILED = 6,
+    ATM_BALANCE_CONFLICT = 7,
+};
+
+// the menu a captured choice was made in, numbered after Bank_System's menus so one trace format serves both
+enum eTraceMenu {
+
+    TRACE_NONE = 0,
+    TRACE_ATM_LOGIN = 4,
+    TRACE_ATM_MAIN = 5,
+};
+
+enum eLoadTestFlow {
+
+    FLOW_LOGIN = 0,
+    FLOW_QUICK_WITHDRAW = 1,
+    FLOW_NORMAL_WITHDRAW = 2,
+    FLOW_DEPOSIT = 3,
+    FLOW_BALANCE = 4,
+    FLOW_VISIT = 5,
+};
+
+struct sLoadTestOptions {
+
+    int numOfCustomers = 64;
+    double seconds = 10;
+    int thinkMs = 0;
+    double zipfSkew = 0.99;
+    double openLoopRate = 0;    // visits per second, 0 runs closed loop
+};
+
+// per customer thread, merged after the run
+struct sLoadTestStats {
+
+    std::vector <double> vLatencies[loadtest::NUM_OF_FLOWS];    // milliseconds
+    long long results[loadtest::NUM_OF_RESULTS] = {};
+};
+
+// 64 bytes per captured operation in a trace file, same layout in Bank_System
+struct sTraceRecord {
+
+    int64_t timestamp = 0;              // nanoseconds since the epoch, paces an original-speed replay
+    char accountNum[24] = {};           // the customer at the terminal
+    char otherAccountNum[24] = {};      // unused by the ATM
+    float amount = 0;                   // withdrawn or deposited, 0 when nothing was saved
+    uint16_t menu = 0;
+    uint16_t choice = 0;
+};
+
+// latency summary of one replayed operation, in microseconds
+struct sReplayResult {
+
+    std::string operation;
+    size_t count = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+    double mean = 0;
+};
+
+// one fixed-size record per transaction in the monthly HISTORY_<yyyymm>.dat segments
+struct sHistoryRecord {
+
+    char accountNum[24] = {};
+    int64_t timestamp = 0;
+    int32_t type = 0;
+    float amount = 0;
+    float balanceAfter = 0;
+    int32_t previousSegment = 0;    // where the account's previous record is, 0 if none
+    int64_t previousOffset = 0;
+};
+
+// notes per cassette for one amount
+struct sNotePlan {
+
+    uint16_t counts[dispenser::NUM_OF_CASSETTES] = {};
+    uint16_t totalNotes = dispenser::UNREACHABLE;
+};
+
+struct sNoteTable {
+
+    sNotePlan plans[dispenser::NUM_OF_AMOUNTS] = {};
+};
+
+// a transaction waiting in the outbox until the master file has it
+struct sPendingOperation {
+
+    int64_t sequence = 0;
+    std::string accountNum;
+    eHistoryType type = HISTORY_DEPOSIT;
+    float amount = 0;   // signed balance delta
+    int64_t timestamp = 0;
+};
+
+// cassette inventory plus, for every amount, the last note of a combination the inventory covers
+struct sCassettes {
+
+    int counts[dispenser::NUM_OF_CASSETTES] = {};
+    int16_t lastNote[dispenser::NUM_OF_AMOUNTS] = {};   // cassette index, -1 if the amount can't be made
+};
+
+// on-disk open-addressing hash index: a header followed by `capacity` slots
+struct sIndexHeader {
+
+    char magic[8] = { 'B', 'N', 'K', 'I', 'N', 'D', 'X', '1' };
+    uint64_t capacity = 0;
+    uint64_t count = 0;
+};
+
+struct sIndexSlot {
+
+    uint64_t keyHash = 0;   // 0 marks an empty slot
+    char key[40] = {};
+    int64_t first = 0;
+    int64_t second = 0;
+};
+
+// exclusive lock on a file shared with the bank and the other ATMs, held until destroyed
+struct sFileLock {
+
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+
+    explicit sFileLock(const std::string& fileName) {
+
+        handle = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        OVERLAPPED overlapped = {};
+
+        if (handle != INVALID_HANDLE_VALUE)
+            LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+    }
+
+    ~sFileLock() {
+
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+    }
+#else
+    int descriptor = -1;
+
+    explicit sFileLock(const std::string& fileName) {
+
+        descriptor = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if (descriptor != -1)
+            flock(descriptor, LOCK_EX);
+    }
+
+    ~sFileLock() {
+
+        if (descriptor != -1)
+            close(descriptor);
+    }
+#endif
+
+    sFileLock(const sFileLock&) = delete;
+    sFileLock& operator=(const sFileLock&) = delete;
+};
+
+
+// fewest-notes combination of every amount with unlimited notes, built at compile time
+constexpr sNoteTable buildMinNotesTable() {
+
+    sNoteTable table;
+
+    table.plans[0].totalNotes = 0;
+
+    for (int amount = 1; amount < dispenser::NUM_OF_AMOUNTS; amount++) {
+
+        for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++) {
+
+            int units = dispenser::DENOMINATIONS[cassette] / dispenser::AMOUNT_STEP;
+
+            if (units > amount || table.plans[amount - units].totalNotes == dispenser::UNREACHABLE)
+                continue;
+
+            if (table.plans[amount - units].totalNotes + 1 < table.plans[amount].totalNotes) {
+
+                table.plans[amount] = table.plans[amount - units];
+                table.plans[amount].counts[cassette]++;
+                table.plans[amount].totalNotes++;
+            }
+        }
+    }
+
+    return table;
+}
+
+constexpr sNoteTable MIN_NOTES_TABLE = buildMinNotesTable();
+
+// CRC32C tables for slicing-by-8: table k advances a CRC over one byte followed by k zero bytes
+struct sCrc32cTable {
+
+    uint32_t values[8][256] = {};
+};
+
+constexpr sCrc32cTable buildCrc32cTable() {
+
+    // Castagnoli polynomial, reflected
+    constexpr uint32_t POLYNOMIAL = 0x82F63B78;
+
+    sCrc32cTable table;
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+
+        uint32_t crc = byte;
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+
+        table.values[0][byte] = crc;
+    }
+
+    for (int k = 1; k < 8; k++) {
+
+        for (int byte = 0; byte < 256; byte++)
+            table.values[k][byte] = (table.values[k - 1][byte] >> 8) ^ table.values[0][table.values[k - 1][byte] & 0xFF];
+    }
+
+    return table;
+}
+
+
+// record integrity --> client lines end in a CRC32C, same format as Bank_System writes
+namespace integrity {
+
+    constexpr sCrc32cTable CRC32C_TABLE = buildCrc32cTable();
+    constexpr char CHECKSUM_MARKER = '#';
+    constexpr size_t CHECKSUM_LENGTH = 9;              // the marker and 8 hex digits
+}
+
+// client shards --> the bank's CLIENTS.txt, CLIENTS.idx and BALANCES.idx split by account-number hash
+namespace shards {
+
+    constexpr int MAX_SHARDS = 256;
+
+    int count = 1;      // from CLIENTS_SHARDS.txt, one shard is the plain CLIENTS.txt
+}
+
+sCassettes cassettes;
+
+namespace offline {
+
+    constexpr float MAX_PENDING_WITHDRAW = 1000;    // per account, caps the exposure while the bank can't confirm balances
+    constexpr int SYNC_RETRY_SECONDS = 5;
+
+    // cache, outbox and sequences; the cache holds master records, the queued operations are added on read
+    std::mutex stateMutex;
+    std::unordered_map <std::string, sClient> cache;
+    std::deque <sPendingOperation> outbox;
+    int64_t lastSequence = 0;
+    int64_t ackedSequence = 0;
+    int64_t reportedSequence = 0;   // the operation a sync is stuck on, logged to ATM_CONFLICTS.txt once
+
+    // ATM_CACHE.txt and ATM_OUTBOX.txt are appended to, a file is rewritten once most of its lines are superseded
+    size_t cacheFileLines = 0;
+    size_t outboxFileLines = 0;
+
+    // held while reading or writing the CLIENTS.txt, CLIENTS.idx and BALANCES.idx shards; taken before stateMutex
+    std::mutex masterMutex;
+
+    std::condition_variable syncRequested;
+    bool isSyncRequested = false;
+    bool isStopping = false;
+    std::thread syncThread;
+
+    struct sSyncGuard {
+
+        ~sSyncGuard() {
+
+            {
+                std::lock_guard <std::mutex> lock(stateMutex);
+                isStopping = true;
+            }
+
+            syncRequested.notify_all();
+
+            if (syncThread.joinable())
+                syncThread.join();
+        }
+
+    } syncGuard;
+}
+
+// workload capture --> every operation of a --capture session goes to a binary trace that --replay re-executes
+namespace trace {
+
+    // operation names, indexed by the main menu choice
+    const std::string MAIN_MENU_OPERATIONS[7] = { "", "Quick Withdraw", "Normal Withdraw", "Deposit", "Show Balance", "Mini Statement", "Logout" };
+
+    std::string fileName;           // empty while not capturing
+    sTraceRecord current;           // the operation in progress, menu TRACE_NONE when there is none
+
+    volatile size_t replaySink = 0; // keeps the replayed reads from being optimized away
+}
+
 
 // utility functions (declaration)
 
@@ -62,6 +461,30 @@ char readChar(const std::string& msg, const std::string& sep = " ");
 void clearScreen();
 
 void returnToScreen(const std::string& menu = "Main Menu");
+
+bool replaceFile(const std::string& fromFileName, const std::string& toFileName);
+
+bool writeSyncedFile(const std::string& fileName, const std::string& content);
+
+bool commitFiles(const std::vector <std::pair <std::string, std::string>>& vFiles);
+
+void recoverCommit();
+
+#ifdef HAS_SSE42
+bool hasCrc32Instruction();
+
+SSE42_TARGET uint32_t crc32cHardware(const char* data, size_t length, uint32_t crc);
+#endif
+
+uint32_t crc32cTable(const char* data, size_t length, uint32_t crc);
+
+uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0);
+
+void appendLineChecksum(std::string& content, size_t lineStart);
+
+bool hasLineChecksum(std::string_view line);
+
+bool verifyLineChecksum(std::string_view& line, bool isRequired);
  
 
 // input functions (declaration)
@@ -77,23 +500,137 @@ int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg = "En
 
 bool confirmTransaction(float amount, float& balance, bool isWithdraw = true);
 
-sClient lineToRecord(const std::string& line);
+uint64_t hashKey(const std::string& key);
+
+bool createIndexFile(const std::string& indexFile, uint64_t capacity);
+
+bool openIndexFile(const std::string& indexFile, std::fstream& file, sIndexHeader& header);
+
+bool probeIndexSlot(std::fstream& file, const sIndexHeader& header, const std::string& key, sIndexSlot& slot, uint64_t& position);
+
+bool readIndexSlot(const std::string& indexFile, const std::string& key, sIndexSlot& slot);
+
+bool growIndexFile(const std::string& indexFile, const sIndexHeader& header);
+
+bool upsertIndexSlot(const std::string& indexFile, const sIndexSlot& newSlot);
+
+sIndexSlot makeIndexSlot(const std::string& key, int64_t first, int64_t second);
+
+std::tm toLocalTime(int64_t timestamp);
+
+int32_t getHistorySegment(int64_t timestamp);
+
+std::string getHistorySegmentFile(int32_t segment);
+
+bool appendHistory(const std::string& accountNum, eHistoryType type, float amount, float balanceAfter);
+
+std::vector <sHistoryRecord> readAccountHistory(const std::string& accountNum, size_t maxRecords, int64_t fromTime = 0, int64_t toTime = INT64_MAX);
+
+bool lineToRecord(std::string_view line, sClient& client);
 
 std::string recordToLine(const sClient& record);
 
-std::vector <sClient> loadClientsFromFile();
+std::string readFileContent(const std::string& fileName);
+
+std::string buildClientsIndexContent(const std::string& clientsContent);
+
+bool loadShardCount();
+
+int getClientShard(const std::string& accountNum);
+
+std::string getShardFileName(const std::string& fileName, int shardIndex);
+
+std::string readClientsContent();
+
+bool refreshClientsIndex(int shardIndex, bool isForced = false);
+
+int64_t getFileSize(const std::string& fileName);
+
+bool readClientRecord(const std::string& accountNum, sClient& client);
 
-void saveClientsToFile(const std::vector <sClient>& vClients);
+bool readHotBalance(const std::string& accountNum, float& balance);
+
+bool writeHotBalance(const std::string& accountNum, float balance);
+
+bool syncFile(const std::string& fileName);
+
+bool isClientDeleted(const std::string& accountNum);
+
+void rebuildDispenseTable();
+
+void loadCassettesFromFile();
+
+std::string cassettesToFileContent(const int counts[dispenser::NUM_OF_CASSETTES]);
+
+bool canDispense(int amount);
+
+bool getDispensePlan(int amount, sNotePlan& plan);
+
+std::string pendingOperationToLine(const sPendingOperation& operation);
+
+bool lineToPendingOperation(const std::string& line, sPendingOperation& operation);
+
+void loadOfflineState();
+
+bool appendSyncedFile(const std::string& fileName, const std::string& content);
+
+void cacheMasterClient(const sClient& client);
+
+bool commitSyncState();
+
+float getPendingDelta(const std::string& accountNum, bool isWithdrawOnly);
+
+bool isMasterReachable();
+
+bool getSessionClient(const std::string& accountNum, sClient& client);
+
+void appendConflict(const sPendingOperation& operation, const std::string& reason);
+
+bool syncWithMaster();
+
+void syncWorker();
+
+void stopSyncWorker();
 
 int getQuickWithdrawValue(eQuickWithdraw value);
 
-int getClientIndexByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients);
+eAtmResult checkTransaction(int amount, const sClient& client, bool isWithdraw, sNotePlan& plan);
+
+eAtmResult saveTransaction(int amount, sClient& client, bool isWithdraw, const sNotePlan& plan);
+
+float refreshSessionBalance(sClient& client);
+
+void confirmAndSaveTransaction(int amount, sClient& client, bool isWithdraw = true);
+
+bool processQuickWithdraw(eQuickWithdraw choice, sClient& client);
+
+std::vector <double> buildZipfCdf(size_t numOfItems, double skew);
+
+size_t sampleZipf(const std::vector <double>& vCdf, std::mt19937_64& random);
+
+void runCustomerVisit(const sClient& customer, std::mt19937_64& random, sLoadTestStats& stats, std::chrono::steady_clock::time_point visitStart);
+
+void waitForOutboxDrain();
+
+void startTraceCapture(const std::string& fileName);
+
+void beginTraceOperation(eTraceMenu menu, int choice);
+
+void setTraceSubject(const std::string& accountNum, float amount = 0);
 
-bool isClientExistsByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients);
+void endTraceOperation();
 
-void confirmAndSaveTransaction(int amount, float& balance, const std::vector <sClient>& vClients, bool isWithdraw = true);
+std::vector <sTraceRecord> loadTraceFile(const std::string& fileName);
 
-bool processQuickWithdraw(eQuickWithdraw choice, sClient& client, const std::vector <sClient>& vClients);
+std::string getTraceOperationName(const sTraceRecord& record);
+
+bool replayTraceRecord(const sTraceRecord& record, sClient& session);
+
+double parseReplaySpeed(const std::string& speed);
+
+std::vector <sReplayResult> summarizeReplay(std::map <std::string, std::vector <double>>& latencies);
+
+std::string replayResultsToFileContent(const std::vector <sReplayResult>& vResults);
 
 
 // output functions (declaration)
@@ -104,25 +641,45 @@ void printQuickWithdrawMenu(float balance);
 
 bool printAmountExceedBalance(float amount, float balance);
 
+void printCantDispense(int amount);
+
+void printDispensedNotes(const sNotePlan& plan);
+
+void printHistoryRecord(const sHistoryRecord& record);
+
+void printLoadTestReport(const sLoadTestStats& stats, double seconds);
+
+void printReplayResults(const std::vector <sReplayResult>& vResults);
+
 
 // core functions (declaration)
 
-void quickWithdraw(sClient& client, const std::vector <sClient>& vClients);
+void quickWithdraw(sClient& client);
 
-void normalWithdraw(sClient& client, const std::vector <sClient>& vClients);
+void normalWithdraw(sClient& client);
 
-void Deposit(sClient& client, const std::vector <sClient>& vClients);
+void Deposit(sClient& client);
 
 void showBalance(float balance);
 
-void applyMenuChoice(eMainMenu choice, sClient& client, const std::vector <sClient>& vClients);
+void miniStatement(const std::string& accountNum);
+
+void applyMenuChoice(eMainMenu choice, sClient& client);
 
-void startProgram(sClient& client, const std::vector <sClient>& vClients);
+void startProgram(sClient& client);
 
-sClient processLoginAndGetClient(const std::vector <sClient>& vClients);
+sClient processLoginAndGetClient();
 
 void Login();
 
+void runLoadTest(const sLoadTestOptions& options);
+
+std::filesystem::path copyToScratchDirectory(const std::filesystem::path& dataDirectory, const std::string& prefix);
+
+void runReplay(const std::string& traceFile, double speed, const std::string& resultsFile);
+
+int runHeadlessCommand(const std::vector <std::string>& vArgs);
+
 
 
 // utility functions (definition)
@@ -232,387 +789,2594 @@ void returnToScreen(const std::string& screen) {
     clearScreen();
 }
 
+bool replaceFile(const std::string& fromFileName, const std::string& toFileName) {
 
-// input functions (definition)
+#ifdef _WIN32
+    return MoveFileExA(fromFileName.c_str(), toFileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(fromFileName.c_str(), toFileName.c_str()) == 0;
+#endif
+}
 
-std::string readAccountNum() {
+bool writeSyncedFile(const std::string& fileName, const std::string& content) {
 
-    return readText("Enter account number:");
-}
+    FILE* file = std::fopen(fileName.c_str(), "wb");
 
-int readPincode() {
+    if (file == nullptr)
+        return false;
 
-    return readPositiveNum("Enter pincode number:");
-}
+    bool isWritten = std::fwrite(content.data(), 1, content.size(), file) == content.size();
 
-int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg) {
+    isWritten = (std::fflush(file) == 0) && isWritten;
+    isWritten = (fsync(fileno(file)) == 0) && isWritten;
+    isWritten = (std::fclose(file) == 0) && isWritten;
 
-    return readNumInRange(msg, firstChoice, lastChoice);
+    return isWritten;
 }
 
-bool confirmTransaction(float amount, float& balance, bool isWithdraw) {
+// all files are written to .tmp and fsynced first; when there are several, ATM_COMMIT.txt names them from the first
+// rename to the last, so a crash in between is rolled forward on the next start and they change together or not at all
+bool commitFiles(const std::vector <std::pair <std::string, std::string>>& vFiles) {
 
-    char confirm = readChar("\nAre you sure you want to perform this transaction (Y/N):");
+    // an earlier commit whose renames failed is finished before its files are written again
+    recoverCommit();
 
-    if (toupper(confirm) == 'Y') {
+    for (const std::pair <std::string, std::string>& file : vFiles) {
 
-        if (isWithdraw)
-            amount *= -1;
+        if (!writeSyncedFile(file.first + ".tmp", file.second))
+            return false;
+    }
 
-        balance += amount;
+    if (vFiles.size() == 1)
+        return replaceFile(vFiles[0].first + ".tmp", vFiles[0].first);
 
-        std::cout << "\nTransaction Done Successfully, New Account Balance: " << CURRENCY << balance << '\n';
+    std::string fileNames;
 
-        return true;
-    }
+    for (const std::pair <std::string, std::string>& file : vFiles)
+        fileNames += file.first + '\n';
 
-    return false;
-}
+    if (!writeSyncedFile(ATM_COMMIT_FILE + ".tmp", fileNames) || !replaceFile(ATM_COMMIT_FILE + ".tmp", ATM_COMMIT_FILE))
+        return false;
 
-bool printAmountExceedBalance(float amount, float balance) {
+    // from here on the commit has happened; a rename that fails is retried from ATM_COMMIT.txt
+    bool isRenamed = true;
 
-    if (amount > balance) {
+    for (const std::pair <std::string, std::string>& file : vFiles)
+        isRenamed = replaceFile(file.first + ".tmp", file.first) && isRenamed;
 
-        std::cout << "\nAmount Exceed Balance, Try another amount\n";
-        return true;
-    }
+    if (isRenamed)
+        std::remove(ATM_COMMIT_FILE.c_str());
 
-    return false;
+    return true;
 }
 
-sClient lineToRecord(const std::string& line) {
+// finishes the renames of a commit that stopped half way; the files already renamed have no .tmp left
+void recoverCommit() {
 
-    std::vector <std::string> vClientInfo = splitText(line, SEPARATOR);
+    std::istringstream fileNames(readFileContent(ATM_COMMIT_FILE));
+    std::string fileName;
+    bool isRenamed = true;
 
+    while (std::getline(fileNames, fileName)) {
 
-    sClient client;
+        std::fstream tmpFile(fileName + ".tmp", std::ios::in);
 
-    client.accountNum = vClientInfo[0];
-    client.pincode = std::stoi(vClientInfo[1]);
-    client.name = vClientInfo[2];
-    client.phoneNum = vClientInfo[3];
-    client.balance = std::stod(vClientInfo[4]);
+        if (tmpFile.is_open()) {
 
-    return client;
+            tmpFile.close();
+            isRenamed = replaceFile(fileName + ".tmp", fileName) && isRenamed;
+        }
+    }
+
+    if (isRenamed)
+        std::remove(ATM_COMMIT_FILE.c_str());
 }
 
-std::string recordToLine(const sClient& record) {
+#ifdef HAS_SSE42
+// CPUID leaf 1 reports SSE4.2 in bit 20 of ECX
+bool hasCrc32Instruction() {
 
-    std::string line;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
 
-    line += record.accountNum + SEPARATOR;
-    line += std::to_string(record.pincode) + SEPARATOR;
-    line += record.name + SEPARATOR;
-    line += record.phoneNum + SEPARATOR;
-    line += std::to_string(record.balance);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
 
-    return line;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
 }
 
-std::vector <sClient> loadClientsFromFile() {
+// the crc is taken and returned un-inverted, crc32c does the inversion
+SSE42_TARGET uint32_t crc32cHardware(const char* data, size_t length, uint32_t crc) {
 
-    std::vector <sClient> vClients;
+    uint64_t wideCrc = crc;
 
-    std::fstream file;
+    for (; length >= 8; data += 8, length -= 8) {
 
-    file.open(CLIENTS_FILE, std::ios::in);
+        uint64_t word;
+        std::memcpy(&word, data, 8);
 
-    if (file.is_open()) {
+        wideCrc = _mm_crc32_u64(wideCrc, word);
+    }
 
-        std::string line;
+    crc = (uint32_t)wideCrc;
 
-        while (std::getline(file, line)) {
+    // records are short, the tail is a good part of each one
+    if (length >= 4) {
 
-            sClient client = lineToRecord(line);
-            vClients.push_back(client);
-        }
+        uint32_t word;
+        std::memcpy(&word, data, 4);
 
-        file.close();
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
     }
 
-    return vClients;
+    for (; length > 0; data++, length--)
+        crc = _mm_crc32_u8(crc, (uint8_t)*data);
+
+    return crc;
 }
+#endif
 
-void saveClientsToFile(const std::vector <sClient>& vClients) {
+uint32_t crc32cTable(const char* data, size_t length, uint32_t crc) {
+
+    const uint32_t (&table)[8][256] = integrity::CRC32C_TABLE.values;
+
+    // little-endian loads, like every binary record of the program
+    for (; length >= 8; data += 8, length -= 8) {
+
+        uint32_t low, high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+
+        low ^= crc;
+
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+            table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+
+    if (length >= 4) {
+
+        uint32_t word;
+        std::memcpy(&word, data, 4);
+
+        word ^= crc;
+
+        crc = table[3][word & 0xFF] ^ table[2][(word >> 8) & 0xFF] ^ table[1][(word >> 16) & 0xFF] ^ table[0][word >> 24];
+        data += 4;
+        length -= 4;
+    }
+
+    for (; length > 0; data++, length--)
+        crc = table[0][(crc ^ (uint8_t)*data) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+// CRC32C (Castagnoli): the SSE4.2 crc32 instruction 8 bytes at a time on CPUs that have it, slicing-by-8 otherwise
+uint32_t crc32c(const char* data, size_t length, uint32_t crc) {
+
+#ifdef HAS_SSE42
+    static const bool isHardware = hasCrc32Instruction();
+
+    if (isHardware)
+        return ~crc32cHardware(data, length, ~crc);
+#endif
+
+    return ~crc32cTable(data, length, ~crc);
+}
+
+// closes the line that starts at lineStart with SEPARATOR, the marker and the line's CRC32C in hex
+void appendLineChecksum(std::string& content, size_t lineStart) {
+
+    const char digits[] = "0123456789abcdef";
+
+    uint32_t crc = crc32c(content.data() + lineStart, content.size() - lineStart);
+
+    content += SEPARATOR;
+    content += integrity::CHECKSUM_MARKER;
+
+    for (int shift = 28; shift >= 0; shift -= 4)
+        content += digits[(crc >> shift) & 0xF];
+}
+
+bool hasLineChecksum(std::string_view line) {
+
+    if (line.size() < SEPARATOR.size() + integrity::CHECKSUM_LENGTH)
+        return false;
+
+    size_t checksumStart = line.size() - integrity::CHECKSUM_LENGTH;
+
+    return line[checksumStart] == integrity::CHECKSUM_MARKER && line.compare(checksumStart - SEPARATOR.size(), SEPARATOR.size(), SEPARATOR) == 0;
+}
+
+// false for a corrupt line; a valid checksum is stripped, a line written before checksums only passes when none is required
+bool verifyLineChecksum(std::string_view& line, bool isRequired) {
+
+    if (!hasLineChecksum(line))
+        return !isRequired;
+
+    size_t checksumStart = line.size() - integrity::CHECKSUM_LENGTH;
+    uint32_t stored = 0;
+
+    auto parsed = std::from_chars(line.data() + checksumStart + 1, line.data() + line.size(), stored, 16);
+
+    if (parsed.ec != std::errc() || parsed.ptr != line.data() + line.size())
+        return false;
+
+    line = line.substr(0, checksumStart - SEPARATOR.size());
+
+    return crc32c(line.data(), line.size()) == stored;
+}
+
+
+// input functions (definition)
+
+std::string readAccountNum() {
+
+    return readText("Enter account number:");
+}
+
+int readPincode() {
+
+    return readPositiveNum("Enter pincode number:");
+}
+
+int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg) {
+
+    return readNumInRange(msg, firstChoice, lastChoice);
+}
+
+bool confirmTransaction(float amount, float& balance, bool isWithdraw) {
+
+    char confirm = readChar("\nAre you sure you want to perform this transaction (Y/N):");
+
+    if (toupper(confirm) == 'Y') {
+
+        if (isWithdraw)
+            amount *= -1;
+
+        balance += amount;
+
+        std::cout << "\nTransaction Done Successfully, New Account Balance: " << CURRENCY << balance << '\n';
+
+        return true;
+    }
+
+    return false;
+}
+
+bool printAmountExceedBalance(float amount, float balance) {
+
+    if (amount > balance) {
+
+        std::cout << "\nAmount Exceed Balance, Try another amount\n";
+        return true;
+    }
+
+    return false;
+}
+
+// false for a torn or corrupted line; lines the bank wrote before checksums have none and are still read
+bool lineToRecord(std::string_view line, sClient& client) {
+
+    if (!verifyLineChecksum(line, false))
+        return false;
+
+    std::string_view vFields[5];
+
+    for (int i = 0; i < 5; i++) {
+
+        size_t sepPos = (i < 4) ? line.find(SEPARATOR) : line.size();
+
+        if (sepPos == std::string_view::npos)
+            return false;
+
+        vFields[i] = line.substr(0, sepPos);
+        line.remove_prefix(std::min(line.size(), sepPos + SEPARATOR.length()));
+    }
+
+    auto pincode = std::from_chars(vFields[1].data(), vFields[1].data() + vFields[1].size(), client.pincode);
+    auto balance = std::from_chars(vFields[4].data(), vFields[4].data() + vFields[4].size(), client.balance);
+
+    if (pincode.ec != std::errc() || pincode.ptr != vFields[1].data() + vFields[1].size() || vFields[0].empty())
+        return false;
+
+    if (balance.ec != std::errc() || balance.ptr != vFields[4].data() + vFields[4].size())
+        return false;
+
+    client.accountNum = vFields[0];
+    client.name = vFields[2];
+    client.phoneNum = vFields[3];
+
+    return true;
+}
+
+std::string recordToLine(const sClient& record) {
+
+    std::string line;
+
+    line += record.accountNum + SEPARATOR;
+    line += std::to_string(record.pincode) + SEPARATOR;
+    line += record.name + SEPARATOR;
+    line += record.phoneNum + SEPARATOR;
+    line += std::to_string(record.balance);
+
+    appendLineChecksum(line, 0);
+
+    return line;
+}
+
+std::string readFileContent(const std::string& fileName) {
+
+    std::fstream file;
+
+    file.open(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+
+    if (!file.is_open())
+        return "";
+
+    std::string content((size_t)file.tellg(), '\0');
+
+    file.seekg(0);
+    file.read(&content[0], content.size());
+
+    return content;
+}
+
+// CLIENTS.idx: account number -> (line offset, line length) in CLIENTS.txt, same slot layout as HISTORY.idx
+std::string buildClientsIndexContent(const std::string& clientsContent) {
+
+    std::vector <sIndexSlot> vEntries;
+
+    vEntries.push_back(makeIndexSlot(CLIENTS_INDEX_SIZE_KEY, clientsContent.size(), 0));
+
+    for (size_t offset = 0; offset < clientsContent.size();) {
+
+        size_t end = clientsContent.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = clientsContent.size();
+
+        size_t keyEnd = clientsContent.find(SEPARATOR, offset);
+
+        if (keyEnd < end)
+            vEntries.push_back(makeIndexSlot(clientsContent.substr(offset, keyEnd - offset), offset, end - offset));
+
+        offset = end + 1;
+    }
+
+    sIndexHeader header;
+
+    header.capacity = 1024;
+
+    while (vEntries.size() * 10 > header.capacity * 7)
+        header.capacity *= 2;
+
+    header.count = vEntries.size();
+
+    std::vector <sIndexSlot> vSlots(header.capacity);
+
+    for (const sIndexSlot& entry : vEntries) {
+
+        uint64_t position = entry.keyHash % header.capacity;
+
+        while (vSlots[position].keyHash != 0)
+            position = (position + 1) % header.capacity;
+
+        vSlots[position] = entry;
+    }
+
+    std::string content((const char*)&header, sizeof(header));
+    content.append((const char*)vSlots.data(), vSlots.size() * sizeof(sIndexSlot));
+
+    return content;
+}
+
+bool loadShardCount() {
+
+    // a missing or empty file is the single CLIENTS.txt; anything else has to be a count in range, guessing one
+    // would route every account to the wrong shard
+    std::string content = readFileContent(CLIENTS_SHARDS_FILE);
+    size_t end = content.find_last_not_of(" \t\r\n") + 1;
+    int numOfShards = 1;
+
+    if (end != 0) {
+
+        auto parsed = std::from_chars(content.data(), content.data() + end, numOfShards);
+
+        if (parsed.ec != std::errc() || parsed.ptr != content.data() + end || numOfShards < 1 || numOfShards > shards::MAX_SHARDS) {
+
+            std::cout << CLIENTS_SHARDS_FILE << " holds \"" << content.substr(0, end) << "\", not a shard count from 1 to " << shards::MAX_SHARDS << '\n';
+            return false;
+        }
+    }
+
+    shards::count = numOfShards;
+
+    return true;
+}
+
+// the same CRC32C split the bank uses
+int getClientShard(const std::string& accountNum) {
+
+    return (shards::count == 1) ? 0 : (int)(crc32c(accountNum.data(), accountNum.size()) % shards::count);
+}
+
+// CLIENTS.txt -> CLIENTS_2_of_8.txt
+std::string getShardFileName(const std::string& fileName, int shardIndex) {
+
+    if (shards::count == 1)
+        return fileName;
+
+    size_t extension = fileName.rfind('.');
+
+    return fileName.substr(0, extension) + "_" + std::to_string(shardIndex) + "_of_" + std::to_string(shards::count) + fileName.substr(extension);
+}
+
+std::string readClientsContent() {
+
+    std::string content;
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++)
+        content += readFileContent(getShardFileName(CLIENTS_FILE, shardIndex));
+
+    return content;
+}
+
+// one probe and a file size; a shard's index is only rebuilt after the shard changed size behind the ATM's back
+bool refreshClientsIndex(int shardIndex, bool isForced) {
+
+    std::string clientsFile = getShardFileName(CLIENTS_FILE, shardIndex);
+    std::string indexFile = getShardFileName(CLIENTS_INDEX_FILE, shardIndex);
+    sIndexSlot slot;
+
+    if (!isForced && readIndexSlot(indexFile, CLIENTS_INDEX_SIZE_KEY, slot) && slot.first == getFileSize(clientsFile))
+        return true;
+
+    // the bank appends slots in place and other ATMs rebuild too: the rebuild holds the index lock, checks again and
+    // goes through a temp file of its own
+    sFileLock indexLock(getShardFileName(CLIENTS_INDEX_LOCK_FILE, shardIndex));
+
+    std::string content = readFileContent(clientsFile);
+
+    if (!isForced && readIndexSlot(indexFile, CLIENTS_INDEX_SIZE_KEY, slot) && slot.first == (int64_t)content.size())
+        return true;
+
+    std::string tmpFile = indexFile + "." + std::to_string(getpid()) + ".tmp";
+
+    if (writeSyncedFile(tmpFile, buildClientsIndexContent(content)) && replaceFile(tmpFile, indexFile))
+        return true;
+
+    std::remove(tmpFile.c_str());
+
+    return false;
+}
+
+int64_t getFileSize(const std::string& fileName) {
+
+    std::fstream file;
+
+    file.open(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+
+    return file.is_open() ? (int64_t)file.tellg() : 0;
+}
+
+bool readClientRecord(const std::string& accountNum, sClient& client) {
+
+    int shardIndex = getClientShard(accountNum);
+
+    if (accountNum.empty() || accountNum[0] == '#' || !refreshClientsIndex(shardIndex))
+        return false;
+
+    // a slot can still be stale after a same-size rewrite, so the line it points at is checked and the index rebuilt once
+    for (int attempt = 0; attempt < 2; attempt++) {
+
+        if (attempt == 1 && !refreshClientsIndex(shardIndex, true))
+            return false;
+
+        sIndexSlot slot;
+
+        if (!readIndexSlot(getShardFileName(CLIENTS_INDEX_FILE, shardIndex), accountNum, slot))
+            return false;
+
+        // read from the byte before the record to the byte after it, both must be newlines (or the file's ends)
+        int64_t start = std::max <int64_t>(slot.first - 1, 0);
+        std::string line((size_t)(slot.first - start + slot.second + 1), '\0');
+
+        std::fstream file;
+
+        file.open(getShardFileName(CLIENTS_FILE, shardIndex), std::ios::in | std::ios::binary);
+        file.seekg(start);
+        file.read(&line[0], line.size());
+
+        line.resize((size_t)file.gcount());
+
+        if (slot.first > 0) {
+
+            if (line.empty() || line[0] != '\n')
+                continue;
+
+            line.erase(0, 1);
+        }
+
+        if (line.size() < (size_t)slot.second || (line.size() > (size_t)slot.second && line[slot.second] != '\n'))
+            continue;
+
+        line.resize(slot.second);
+
+        if (line.compare(0, accountNum.size() + SEPARATOR.size(), accountNum + SEPARATOR) != 0)
+            continue;
+
+        // a corrupt record is refused rather than guessed at, the customer can't log in until the bank repairs it
+        if (!lineToRecord(line, client))
+            return false;
+
+        // the balance in CLIENTS.txt is only as new as the bank's last full rewrite
+        readHotBalance(accountNum, client.balance);
+        return true;
+    }
+
+    return false;
+}
+
+// BALANCES.idx: the slot layout of CLIENTS.idx, first holds the float's bits
+bool readHotBalance(const std::string& accountNum, float& balance) {
+
+    sIndexSlot slot;
+
+    if (!readIndexSlot(getShardFileName(HOT_BALANCES_FILE, getClientShard(accountNum)), accountNum, slot))
+        return false;
+
+    uint32_t bits = (uint32_t)slot.first;
+
+    std::memcpy(&balance, &bits, sizeof(balance));
+    return true;
+}
+
+bool writeHotBalance(const std::string& accountNum, float balance) {
+
+    uint32_t bits;
+
+    std::memcpy(&bits, &balance, sizeof(bits));
+
+    return upsertIndexSlot(getShardFileName(HOT_BALANCES_FILE, getClientShard(accountNum)), makeIndexSlot(accountNum, bits, 0));
+}
+
+bool syncFile(const std::string& fileName) {
+
+    FILE* file = std::fopen(fileName.c_str(), "rb+");
+
+    if (file == nullptr)
+        return false;
+
+    bool isSynced = fsync(fileno(file)) == 0;
+
+    std::fclose(file);
+
+    return isSynced;
+}
+
+// the master balances of the accounts, what the sync journal hashes to tell whether a batch landed
+// only a shard that was read to its end without the account's line confirms the bank removed it
+bool isClientDeleted(const std::string& accountNum) {
+
+    std::fstream file;
+
+    file.open(getShardFileName(CLIENTS_FILE, getClientShard(accountNum)), std::ios::in | std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+
+    while (std::getline(file, line)) {
+
+        if (line.compare(0, accountNum.size() + SEPARATOR.size(), accountNum + SEPARATOR) == 0)
+            return false;
+    }
+
+    return file.eof() && !file.bad();
+}
+
+// bounded change-making over the current inventory, rerun only when the inventory changes
+void rebuildDispenseTable() {
+
+    std::vector <int> vNotesUsed(dispenser::NUM_OF_AMOUNTS, 0);
+
+    std::fill(std::begin(cassettes.lastNote), std::end(cassettes.lastNote), -1);
+
+    for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++) {
+
+        int units = dispenser::DENOMINATIONS[cassette] / dispenser::AMOUNT_STEP;
+
+        std::fill(vNotesUsed.begin(), vNotesUsed.end(), 0);
+
+        for (int amount = units; amount < dispenser::NUM_OF_AMOUNTS; amount++) {
+
+            int rest = amount - units;
+            bool isRestReachable = (rest == 0) || (cassettes.lastNote[rest] != -1);
+
+            if (cassettes.lastNote[amount] == -1 && isRestReachable && vNotesUsed[rest] < cassettes.counts[cassette]) {
+
+                cassettes.lastNote[amount] = cassette;
+                vNotesUsed[amount] = vNotesUsed[rest] + 1;
+            }
+        }
+    }
+}
+
+void loadCassettesFromFile() {
+
+    std::fill(std::begin(cassettes.counts), std::end(cassettes.counts), dispenser::DEFAULT_NOTES_PER_CASSETTE);
+
+    std::fstream file;
+
+    file.open(CASSETTES_FILE, std::ios::in);
+
+    if (file.is_open()) {
+
+        std::string line;
+
+        while (std::getline(file, line)) {
+
+            std::vector <std::string> vCassette = splitText(line, SEPARATOR);
+
+            if (vCassette.size() != 2)
+                continue;
+
+            int denomination = std::stoi(vCassette[0]);
+
+            for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++) {
+
+                if (dispenser::DENOMINATIONS[cassette] == denomination)
+                    cassettes.counts[cassette] = std::max(0, std::stoi(vCassette[1]));
+            }
+        }
+
+        file.close();
+    }
+
+    rebuildDispenseTable();
+}
+
+std::string cassettesToFileContent(const int counts[dispenser::NUM_OF_CASSETTES]) {
+
+    std::string content;
+
+    for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++)
+        content += std::to_string(dispenser::DENOMINATIONS[cassette]) + SEPARATOR + std::to_string(counts[cassette]) + '\n';
+
+    return content;
+}
+
+// O(1): a single lookup, cheap enough to run on every entered amount
+bool canDispense(int amount) {
+
+    if (amount <= 0 || amount > dispenser::MAX_WITHDRAW || amount % dispenser::AMOUNT_STEP != 0)
+        return false;
+
+    return cassettes.lastNote[amount / dispenser::AMOUNT_STEP] != -1;
+}
+
+bool getDispensePlan(int amount, sNotePlan& plan) {
+
+    if (!canDispense(amount))
+        return false;
+
+    int units = amount / dispenser::AMOUNT_STEP;
+
+    plan = MIN_NOTES_TABLE.plans[units];
+
+    bool isCovered = true;
+
+    for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++)
+        isCovered = isCovered && plan.counts[cassette] <= cassettes.counts[cassette];
+
+    if (isCovered)
+        return true;
+
+    // a cassette is running low, walk the inventory-aware table back instead
+    plan = sNotePlan();
+    plan.totalNotes = 0;
+
+    while (units > 0) {
+
+        int cassette = cassettes.lastNote[units];
+
+        plan.counts[cassette]++;
+        plan.totalNotes++;
+
+        units -= dispenser::DENOMINATIONS[cassette] / dispenser::AMOUNT_STEP;
+    }
+
+    return true;
+}
+
+std::string pendingOperationToLine(const sPendingOperation& operation) {
+
+    std::string line;
+
+    line += std::to_string(operation.sequence) + SEPARATOR;
+    line += operation.accountNum + SEPARATOR;
+    line += std::to_string(operation.type) + SEPARATOR;
+    line += std::to_string(operation.amount) + SEPARATOR;
+    line += std::to_string(operation.timestamp);
+
+    return line;
+}
+
+// a torn or hand-edited line is rejected whole, a half-parsed operation would be pushed to the master
+bool lineToPendingOperation(const std::string& line, sPendingOperation& operation) {
+
+    std::vector <std::string> vOperation = splitText(line, SEPARATOR);
+
+    if (vOperation.size() != 5)
+        return false;
+
+    auto isParsed = [](const std::string& text, auto& value) {
+
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+    };
+
+    int type = 0;
+
+    if (!isParsed(vOperation[0], operation.sequence) || !isParsed(vOperation[2], type) || !isParsed(vOperation[3], operation.amount)
+        || !isParsed(vOperation[4], operation.timestamp))
+        return false;
+
+    if (operation.sequence <= 0 || (type != HISTORY_DEPOSIT && type != HISTORY_WITHDRAW) || !std::isfinite(operation.amount))
+        return false;
+
+    operation.accountNum = vOperation[1];
+    operation.type = (eHistoryType)type;
+
+    return true;
+}
+
+void loadOfflineState() {
+
+    std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+    std::istringstream stateFile(readFileContent(ATM_SYNC_STATE_FILE));
+    std::string line;
+
+    if (std::getline(stateFile, line)) {
+
+        std::vector <std::string> vState = splitText(line, SEPARATOR);
+        int64_t lastSequence = 0, ackedSequence = 0;
+
+        if (vState.size() == 2 && std::from_chars(vState[0].data(), vState[0].data() + vState[0].size(), lastSequence).ec == std::errc()
+            && std::from_chars(vState[1].data(), vState[1].data() + vState[1].size(), ackedSequence).ec == std::errc()) {
+
+            offline::lastSequence = lastSequence;
+            offline::ackedSequence = ackedSequence;
+        }
+    }
+
+    // later lines of the same account supersede earlier ones
+    std::string cacheContent = readFileContent(ATM_CACHE_FILE);
+    std::istringstream cacheFile(cacheContent);
+    bool isCacheClean = cacheContent.empty() || cacheContent.back() == '\n';
+
+    while (std::getline(cacheFile, line)) {
+
+        sClient client;
+
+        if (lineToRecord(line, client))
+            offline::cache[client.accountNum] = client;
+        else
+            isCacheClean = false;
+
+        offline::cacheFileLines++;
+    }
+
+    // operations up to the acked sequence reached the master; their lines stay until the file is next rewritten
+    std::string outboxContent = readFileContent(ATM_OUTBOX_FILE);
+    std::istringstream outboxFile(outboxContent);
+    bool isOutboxClean = outboxContent.empty() || outboxContent.back() == '\n';
+
+    while (std::getline(outboxFile, line)) {
+
+        sPendingOperation operation;
+
+        if (!lineToPendingOperation(line, operation))
+            isOutboxClean = false;
+
+        else if (operation.sequence > offline::ackedSequence && (offline::outbox.empty() || operation.sequence > offline::outbox.back().sequence)) {
+
+            offline::outbox.push_back(operation);
+            offline::lastSequence = std::max(offline::lastSequence, operation.sequence);
+        }
+
+        offline::outboxFileLines++;
+    }
+
+    // a line torn by a crash is dropped now, before the next append would run into it
+    if (!isCacheClean) {
+
+        std::string content;
+
+        for (const auto& entry : offline::cache)
+            content += recordToLine(entry.second) + '\n';
+
+        if (commitFiles({ { ATM_CACHE_FILE, content } }))
+            offline::cacheFileLines = offline::cache.size();
+    }
+
+    if (!isOutboxClean) {
+
+        std::string content;
+
+        for (const sPendingOperation& operation : offline::outbox)
+            content += pendingOperationToLine(operation) + '\n';
+
+        if (commitFiles({ { ATM_OUTBOX_FILE, content } }))
+            offline::outboxFileLines = offline::outbox.size();
+    }
+
+    offline::isSyncRequested = !offline::outbox.empty();
+}
+
+bool appendSyncedFile(const std::string& fileName, const std::string& content) {
+
+    FILE* file = std::fopen(fileName.c_str(), "ab");
+
+    if (file == nullptr)
+        return false;
+
+    bool isWritten = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+
+    isWritten = (std::fflush(file) == 0) && isWritten;
+    isWritten = (fsync(fileno(file)) == 0) && isWritten;
+    isWritten = (std::fclose(file) == 0) && isWritten;
+
+    return isWritten;
+}
+
+// caller holds offline::stateMutex; an unchanged record writes nothing, a changed one appends its line
+void cacheMasterClient(const sClient& client) {
+
+    auto it = offline::cache.find(client.accountNum);
+
+    if (it != offline::cache.end() && recordToLine(it->second) == recordToLine(client))
+        return;
+
+    offline::cache[client.accountNum] = client;
+
+    if (offline::cacheFileLines < 2 * offline::cache.size() + 64) {
+
+        if (appendSyncedFile(ATM_CACHE_FILE, recordToLine(client) + '\n')) {
+
+            offline::cacheFileLines++;
+            return;
+        }
+    }
+
+    std::string content;
+
+    for (const auto& entry : offline::cache)
+        content += recordToLine(entry.second) + '\n';
+
+    if (commitFiles({ { ATM_CACHE_FILE, content } }))
+        offline::cacheFileLines = offline::cache.size();
+}
+
+// caller holds offline::stateMutex; ATM_SYNC.txt is what retires the acked operations, the outbox file is only
+// rewritten once the acked lines outnumber the queued ones
+bool commitSyncState() {
+
+    std::string stateContent = std::to_string(offline::lastSequence) + SEPARATOR + std::to_string(offline::ackedSequence) + '\n';
+
+    if (!commitFiles({ { ATM_SYNC_STATE_FILE, stateContent } }))
+        return false;
+
+    if (offline::outboxFileLines >= 2 * offline::outbox.size() + 64 || (offline::outbox.empty() && offline::outboxFileLines > 0)) {
+
+        std::string content;
+
+        for (const sPendingOperation& operation : offline::outbox)
+            content += pendingOperationToLine(operation) + '\n';
+
+        if (commitFiles({ { ATM_OUTBOX_FILE, content } }))
+            offline::outboxFileLines = offline::outbox.size();
+    }
+
+    return true;
+}
+
+// caller holds offline::stateMutex
+float getPendingDelta(const std::string& accountNum, bool isWithdrawOnly) {
+
+    float delta = 0;
+
+    for (const sPendingOperation& operation : offline::outbox) {
+
+        if (operation.accountNum == accountNum && (!isWithdrawOnly || operation.type == HISTORY_WITHDRAW))
+            delta += operation.amount;
+    }
+
+    return delta;
+}
+
+bool isMasterReachable() {
+
+    std::fstream file;
+
+    file.open(getShardFileName(CLIENTS_FILE, 0), std::ios::in);
+
+    return file.is_open();
+}
+
+// the master record when the bank can be reached, the cached one otherwise; queued operations are added on top
+bool getSessionClient(const std::string& accountNum, sClient& client) {
+
+    sClient masterClient;
+
+    // the outbox is read before a sync can move operations from it into the master, or they would be counted twice
+    std::lock_guard <std::mutex> masterLock(offline::masterMutex);
+
+    bool isFound = readClientRecord(accountNum, masterClient);
+    bool isReachable = isFound || isMasterReachable();
+
+    std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+    if (isFound) {
+
+        cacheMasterClient(masterClient);
+
+        client = masterClient;
+        client.balance += getPendingDelta(accountNum, false);
+        return true;
+    }
+
+    if (isReachable)
+        return false;
+
+    auto it = offline::cache.find(accountNum);
+
+    if (it == offline::cache.end())
+        return false;
+
+    client = it->second;
+    client.balance += getPendingDelta(accountNum, false);
+    return true;
+}
+
+void appendConflict(const sPendingOperation& operation, const std::string& reason) {
+
+    std::fstream file;
+
+    file.open(ATM_CONFLICTS_FILE, std::ios::out | std::ios::app);
+
+    if (file.is_open())
+        file << pendingOperationToLine(operation) << SEPARATOR << reason << '\n';
+}
+
+// pushes the queued operations to BALANCES.idx as balance deltas, one slot per touched account; CLIENTS.txt isn't rewritten
+bool syncWithMaster() {
+
+    std::vector <sPendingOperation> vOperations;
+    int64_t ackedSequence;
+
+    {
+        std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+        vOperations.assign(offline::outbox.begin(), offline::outbox.end());
+        ackedSequence = offline::ackedSequence;
+    }
+
+    if (vOperations.empty())
+        return true;
+
+    std::lock_guard <std::mutex> masterLock(offline::masterMutex);
+
+    if (!isMasterReachable())
+        return false;
+
+    // the bank folds BALANCES.idx into its shard files under the same locks, so a balance read here is still current
+    // when its slot is written; shards are locked in index order, so two syncs never wait on each other in a cycle
+    std::vector <int> vShards;
+
+    for (const sPendingOperation& operation : vOperations)
+        vShards.push_back(getClientShard(operation.accountNum));
+
+    std::sort(vShards.begin(), vShards.end());
+    vShards.erase(std::unique(vShards.begin(), vShards.end()), vShards.end());
+
+    std::deque <sFileLock> balancesLocks;
+
+    for (int shardIndex : vShards)
+        balancesLocks.emplace_back(getShardFileName(HOT_BALANCES_LOCK_FILE, shardIndex));
+
+    // a journal ahead of the acked sequence means the last sync stopped between the journal and BALANCES.idx; each of its
+    // accounts is checked on its own: the batch's balance means its slot was written, the balance before means it wasn't
+    std::vector <std::string> vJournal = splitText(readFileContent(MASTER_SYNC_JOURNAL_FILE), "\n");
+    std::unordered_map <std::string, bool> journalAccounts;
+    int64_t journalSequence = 0;
+
+    if (!vJournal.empty())
+        std::from_chars(vJournal[0].data(), vJournal[0].data() + vJournal[0].size(), journalSequence);
+
+    if (journalSequence > ackedSequence) {
+
+        for (size_t i = 1; i < vJournal.size(); i++) {
+
+            std::vector <std::string> vAccount = splitText(vJournal[i], SEPARATOR);
+            sClient client;
+
+            if (vAccount.size() != 3)
+                continue;
+
+            bool isRead = readClientRecord(vAccount[0], client);
+            std::string balance = std::to_string(client.balance);
+
+            // the bank changed the balance since: whether the slot was written can't be told, so the operations
+            // stay in the outbox for the operator instead of being charged twice or dropped
+            if (!isRead || (balance != vAccount[1] && balance != vAccount[2])) {
+
+                if (offline::reportedSequence != journalSequence)
+                    appendConflict(vOperations.front(), "can't tell whether sync batch up to " + vJournal[0] + " reached " + vAccount[0] + ", left in the outbox");
+
+                offline::reportedSequence = journalSequence;
+                return false;
+            }
+
+            journalAccounts[vAccount[0]] = (balance == vAccount[2]);
+        }
+    }
+
+    // running master balance per touched account, operations applied in sequence order
+    std::unordered_map <std::string, sClient> touchedClients;
+    std::unordered_map <std::string, float> balancesBefore;
+    std::vector <std::string> vTouched;
+    std::vector <sPendingOperation> vApplied;
+    std::vector <float> vBalancesAfter;
+
+    // the last operation that is settled: applied now, applied by the interrupted batch, or dropped with its account
+    int64_t lastSequence = ackedSequence;
+
+    for (const sPendingOperation& operation : vOperations) {
+
+        if (operation.sequence <= ackedSequence)
+            continue;
+
+        if (operation.sequence <= journalSequence && journalAccounts[operation.accountNum]) {
+
+            lastSequence = operation.sequence;
+            continue;
+        }
+
+        auto it = touchedClients.find(operation.accountNum);
+
+        if (it == touchedClients.end()) {
+
+            sClient client;
+
+            if (!readClientRecord(operation.accountNum, client)) {
+
+                // the cash is gone either way, only an account the bank removed lets the debit go
+                if (isClientDeleted(operation.accountNum)) {
+
+                    appendConflict(operation, "account deleted in " + CLIENTS_FILE + ", operation dropped");
+                    lastSequence = operation.sequence;
+                    continue;
+                }
+
+                // an index rebuild, a torn line or a master that's briefly unreadable: this and every later operation wait for the next sync
+                if (offline::reportedSequence != operation.sequence)
+                    appendConflict(operation, "account unreadable in " + CLIENTS_FILE + ", retried on the next sync");
+
+                offline::reportedSequence = operation.sequence;
+                break;
+            }
+
+            it = touchedClients.emplace(operation.accountNum, client).first;
+            balancesBefore[operation.accountNum] = client.balance;
+            vTouched.push_back(operation.accountNum);
+        }
+
+        // the cash has already left the machine, so an overdrawing withdrawal is applied and flagged
+        if (operation.type == HISTORY_WITHDRAW && it->second.balance + operation.amount < 0)
+            appendConflict(operation, "overdrawn, master balance was " + std::to_string(it->second.balance));
+
+        it->second.balance += operation.amount;
+
+        vApplied.push_back(operation);
+        vBalancesAfter.push_back(it->second.balance);
+        lastSequence = operation.sequence;
+    }
+
+    if (lastSequence == ackedSequence)
+        return false;
+
+    if (!vApplied.empty()) {
+
+        std::string journal = std::to_string(lastSequence) + '\n';
+
+        for (const std::string& accountNum : vTouched)
+            journal += accountNum + SEPARATOR + std::to_string(balancesBefore[accountNum]) + SEPARATOR + std::to_string(touchedClients[accountNum].balance) + '\n';
+
+        if (!commitFiles({ { MASTER_SYNC_JOURNAL_FILE, journal } }))
+            return false;
+
+        std::vector <int> vTouchedShards;
+
+        for (const std::string& accountNum : vTouched) {
+
+            if (!writeHotBalance(accountNum, touchedClients[accountNum].balance))
+                return false;
+
+            if (std::find(vTouchedShards.begin(), vTouchedShards.end(), getClientShard(accountNum)) == vTouchedShards.end())
+                vTouchedShards.push_back(getClientShard(accountNum));
+        }
+
+        // the slots are on disk before ATM_SYNC.txt and the outbox stop holding the operations, one fsync per shard
+        for (int shardIndex : vTouchedShards) {
+
+            if (!syncFile(getShardFileName(HOT_BALANCES_FILE, shardIndex)))
+                return false;
+        }
+
+        for (size_t i = 0; i < vApplied.size(); i++)
+            appendHistory(vApplied[i].accountNum, vApplied[i].type, vApplied[i].amount, vBalancesAfter[i]);
+    }
+
+    // still under masterMutex: nobody sees the new master balances with the applied operations left in the outbox
+    std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+    offline::ackedSequence = lastSequence;
+
+    while (!offline::outbox.empty() && offline::outbox.front().sequence <= lastSequence)
+        offline::outbox.pop_front();
+
+    if (!commitSyncState())
+        return false;
+
+    for (const auto& entry : touchedClients)
+        cacheMasterClient(entry.second);
+
+    return true;
+}
+
+void syncWorker() {
+
+    std::unique_lock <std::mutex> lock(offline::stateMutex);
+
+    while (true) {
+
+        // woken by every queued operation, retried on a timer while the master can't be reached
+        offline::syncRequested.wait_for(lock, std::chrono::seconds(offline::SYNC_RETRY_SECONDS), [] { return offline::isStopping || offline::isSyncRequested; });
+
+        bool isStopping = offline::isStopping;
+        bool hasPending = !offline::outbox.empty();
+
+        offline::isSyncRequested = false;
+
+        if (hasPending) {
+
+            lock.unlock();
+            syncWithMaster();
+            lock.lock();
+        }
+
+        if (isStopping)
+            break;
+    }
+}
+
+// the worker pushes what is still queued, then exits
+void stopSyncWorker() {
+
+    {
+        std::lock_guard <std::mutex> lock(offline::stateMutex);
+        offline::isStopping = true;
+    }
+
+    offline::syncRequested.notify_all();
+
+    if (offline::syncThread.joinable())
+        offline::syncThread.join();
+}
+
+// returns once the sync thread pushed every queued operation to BALANCES.idx
+void waitForOutboxDrain() {
+
+    while (true) {
+
+        {
+            std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+            if (offline::outbox.empty())
+                return;
+
+            offline::isSyncRequested = true;
+        }
+
+        offline::syncRequested.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+// everything that can refuse a transaction before the customer confirms it
+eAtmResult checkTransaction(int amount, const sClient& client, bool isWithdraw, sNotePlan& plan) {
+
+    std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+    if (isWithdraw && amount > client.balance)
+        return ATM_INSUFFICIENT_BALANCE;
+
+    if (isWithdraw && !getDispensePlan(amount, plan))
+        return ATM_CANT_DISPENSE;
+
+    if (isWithdraw && -getPendingDelta(client.accountNum, true) + amount > offline::MAX_PENDING_WITHDRAW)
+        return ATM_PENDING_LIMIT;
+
+    return ATM_OK;
+}
+
+// storage side of a confirmed transaction; client.balance holds the new balance the session expects and is set to the one saved
+eAtmResult saveTransaction(int amount, sClient& client, bool isWithdraw, const sNotePlan& plan) {
+
+    {
+        std::lock_guard <std::mutex> lock(offline::stateMutex);
+
+        auto cached = offline::cache.find(client.accountNum);
+        bool wasCached = cached != offline::cache.end();
+
+        // the session's balance was read at login; another session on the same account may have changed it since
+        float currentBalance = wasCached ? cached->second.balance + getPendingDelta(client.accountNum, false) : client.balance + (isWithdraw ? amount : -amount);
+
+        if (isWithdraw && amount > currentBalance)
+            return ATM_BALANCE_CONFLICT;
+
+        int newCounts[dispenser::NUM_OF_CASSETTES];
+
+        for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++) {
+
+            newCounts[cassette] = cassettes.counts[cassette] - (isWithdraw ? plan.counts[cassette] : 0);
+
+            // another session emptied the cassette between the plan and the confirmation
+            if (newCounts[cassette] < 0)
+                return ATM_CASSETTE_CONFLICT;
+        }
+
+        sPendingOperation operation;
+
+        operation.sequence = offline::lastSequence + 1;
+        operation.accountNum = client.accountNum;
+        operation.type = isWithdraw ? HISTORY_WITHDRAW : HISTORY_DEPOSIT;
+        operation.amount = isWithdraw ? -amount : amount;
+        operation.timestamp = (int64_t)std::time(nullptr);
+
+        // the cassettes go first: a crash before the outbox line leaves notes counted out that are still in the
+        // machine, never notes counted in that were dispensed; the appended outbox line is the commit
+        if (isWithdraw && !commitFiles({ { CASSETTES_FILE, cassettesToFileContent(newCounts) } }))
+            return ATM_SAVE_FAILED;
+
+        if (!appendSyncedFile(ATM_OUTBOX_FILE, pendingOperationToLine(operation) + '\n')) {
+
+            // whatever part of the line reached the file goes with a rewrite from memory
+            std::string content;
+
+            for (const sPendingOperation& queued : offline::outbox)
+                content += pendingOperationToLine(queued) + '\n';
+
+            if (commitFiles({ { ATM_OUTBOX_FILE, content } }))
+                offline::outboxFileLines = offline::outbox.size();
+
+            if (isWithdraw)
+                commitFiles({ { CASSETTES_FILE, cassettesToFileContent(cassettes.counts) } });
+
+            return ATM_SAVE_FAILED;
+        }
+
+        client.balance = currentBalance + operation.amount;
+
+        offline::outbox.push_back(operation);
+        offline::lastSequence++;
+        offline::outboxFileLines++;
+
+        offline::isSyncRequested = true;
+
+        if (isWithdraw) {
+
+            std::copy(std::begin(newCounts), std::end(newCounts), std::begin(cassettes.counts));
+            rebuildDispenseTable();
+        }
+    }
+
+    offline::syncRequested.notify_one();
+
+    return ATM_OK;
+}
+
+// the balance as of now, not as of login: the master's plus whatever this terminal still has queued
+float refreshSessionBalance(sClient& client) {
+
+    sClient current;
+
+    if (getSessionClient(client.accountNum, current))
+        client.balance = current.balance;
+
+    return client.balance;
+}
+
+void confirmAndSaveTransaction(int amount, sClient& client, bool isWithdraw) {
+
+    sNotePlan plan;
+
+    eAtmResult result = checkTransaction(amount, client, isWithdraw, plan);
+
+    if (result == ATM_CANT_DISPENSE) {
+
+        printCantDispense(amount);
+        return;
+    }
+
+    if (result == ATM_PENDING_LIMIT) {
+
+        std::cout << "\nThe bank can't confirm your balance right now, at most " << CURRENCY << offline::MAX_PENDING_WITHDRAW << " can be withdrawn until it does\n";
+        return;
+    }
+
+    if (result != ATM_OK)
+        return;
+
+    float oldBalance = client.balance;
+
+    if (confirmTransaction(amount, client.balance, isWithdraw)) {
+
+        result = saveTransaction(amount, client, isWithdraw, plan);
+
+        if (result == ATM_BALANCE_CONFLICT) {
+
+            client.balance = oldBalance;
+
+            std::cout << "\nYour balance changed in another session and no longer covers this amount, nothing was withdrawn\n";
+            return;
+        }
+
+        if (result != ATM_OK) {
+
+            client.balance = oldBalance;
+
+            std::cout << "\nTransaction couldn't be saved, your balance wasn't changed\n";
+            return;
+        }
+
+        setTraceSubject(client.accountNum, amount);
+
+        if (isWithdraw)
+            printDispensedNotes(plan);
+    }
+}
+
+int getQuickWithdrawValue(eQuickWithdraw value) {
+
+    switch (value) {
+
+    case eQuickWithdraw::WITHDRAW_20: return 20;
+
+    case eQuickWithdraw::WITHDRAW_50: return 50;
+
+    case eQuickWithdraw::WITHDRAW_100: return 100;
+
+    case eQuickWithdraw::WITHDRAW_200: return 200;
+
+    case eQuickWithdraw::WITHDRAW_400: return 400;
+
+    case eQuickWithdraw::WITHDRAW_600: return 600;
+
+    case eQuickWithdraw::WITHDRAW_800: return 800;
+
+    case eQuickWithdraw::WITHDRAW_1000: return 1000;
+
+    }
+}
+
+bool processQuickWithdraw(eQuickWithdraw choice, sClient& client) {
+
+    if (choice != eQuickWithdraw::EXIT) {
+
+        int amount = getQuickWithdrawValue(choice);
+
+
+        if (printAmountExceedBalance(amount, client.balance))
+            return false;
+
+        if (!canDispense(amount)) {
+
+            printCantDispense(amount);
+            return false;
+        }
+
+
+        confirmAndSaveTransaction(amount, client);
+        return true;
+    }
+}
+
+
+uint64_t hashKey(const std::string& key) {
+
+    // FNV-1a, 0 is reserved for empty index slots
+    uint64_t hash = 14695981039346656037ull;
+
+    for (unsigned char c : key) {
+
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash ? hash : 1;
+}
+
+bool createIndexFile(const std::string& indexFile, uint64_t capacity) {
+
+    std::fstream file;
+
+    file.open(indexFile, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+        return false;
+
+    sIndexHeader header;
+    header.capacity = capacity;
+
+    file.write((const char*)&header, sizeof(header));
+
+    std::vector <sIndexSlot> vEmptySlots(1024);
+
+    for (uint64_t written = 0; written < capacity; written += vEmptySlots.size())
+        file.write((const char*)vEmptySlots.data(), std::min <uint64_t>(vEmptySlots.size(), capacity - written) * sizeof(sIndexSlot));
+
+    file.close();
+
+    return !file.fail();
+}
+
+bool openIndexFile(const std::string& indexFile, std::fstream& file, sIndexHeader& header) {
+
+    file.open(indexFile, std::ios::in | std::ios::out | std::ios::binary);
+
+    if (!file.is_open()) {
+
+        if (!createIndexFile(indexFile, 1024))
+            return false;
+
+        file.open(indexFile, std::ios::in | std::ios::out | std::ios::binary);
+    }
+
+    file.read((char*)&header, sizeof(header));
+
+    return file.good() && std::memcmp(header.magic, "BNKINDX1", 8) == 0 && header.capacity > 0;
+}
+
+bool probeIndexSlot(std::fstream& file, const sIndexHeader& header, const std::string& key, sIndexSlot& slot, uint64_t& position) {
+
+    // linear probing from the key's home slot, stops at the key or at the first empty slot
+    uint64_t keyHash = hashKey(key);
+
+    for (uint64_t probe = 0; probe < header.capacity; probe++) {
+
+        position = (keyHash + probe) % header.capacity;
+
+        file.seekg(sizeof(sIndexHeader) + position * sizeof(sIndexSlot));
+        file.read((char*)&slot, sizeof(slot));
+
+        if (!file.good())
+            return false;
+
+        if (slot.keyHash == 0)
+            return false;
+
+        if (slot.keyHash == keyHash && key.compare(0, sizeof(slot.key) - 1, slot.key) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool readIndexSlot(const std::string& indexFile, const std::string& key, sIndexSlot& slot) {
+
+    std::fstream file;
+    sIndexHeader header;
+    uint64_t position;
+
+    file.open(indexFile, std::ios::in | std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    file.read((char*)&header, sizeof(header));
+
+    if (!file.good() || std::memcmp(header.magic, "BNKINDX1", 8) != 0 || header.capacity == 0)
+        return false;
+
+    return probeIndexSlot(file, header, key, slot, position);
+}
+
+bool growIndexFile(const std::string& indexFile, const sIndexHeader& header) {
+
+    std::fstream oldFile;
+
+    oldFile.open(indexFile, std::ios::in | std::ios::binary);
+    oldFile.seekg(sizeof(sIndexHeader));
+
+    std::vector <sIndexSlot> vSlots(header.capacity);
+    oldFile.read((char*)vSlots.data(), vSlots.size() * sizeof(sIndexSlot));
+    oldFile.close();
+
+    std::string grownFile = indexFile + ".grow";
+
+    if (!createIndexFile(grownFile, header.capacity * 2))
+        return false;
+
+    for (const sIndexSlot& slot : vSlots) {
+
+        if (slot.keyHash != 0 && !upsertIndexSlot(grownFile, slot))
+            return false;
+    }
+
+    return replaceFile(grownFile, indexFile);
+}
+
+bool upsertIndexSlot(const std::string& indexFile, const sIndexSlot& newSlot) {
+
+    std::fstream file;
+    sIndexHeader header;
+
+    if (!openIndexFile(indexFile, file, header))
+        return false;
+
+    sIndexSlot slot;
+    uint64_t position;
+
+    bool isFound = probeIndexSlot(file, header, newSlot.key, slot, position);
+
+    if (!isFound) {
+
+        // keep the table at most 70% full so probes stay short
+        if ((header.count + 1) * 10 > header.capacity * 7) {
+
+            file.close();
+
+            return growIndexFile(indexFile, header) && upsertIndexSlot(indexFile, newSlot);
+        }
+
+        header.count++;
+
+        file.clear();
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+    }
+
+    file.clear();
+    file.seekp(sizeof(sIndexHeader) + position * sizeof(sIndexSlot));
+    file.write((const char*)&newSlot, sizeof(newSlot));
+
+    file.close();
+
+    return !file.fail();
+}
+
+sIndexSlot makeIndexSlot(const std::string& key, int64_t first, int64_t second) {
+
+    sIndexSlot slot;
+
+    slot.keyHash = hashKey(key);
+    key.copy(slot.key, sizeof(slot.key) - 1);
+    slot.first = first;
+    slot.second = second;
+
+    return slot;
+}
+
+std::tm toLocalTime(int64_t timestamp) {
+
+    std::time_t time = (std::time_t)timestamp;
+    std::tm date = {};
+
+#ifdef _WIN32
+    localtime_s(&date, &time);
+#else
+    localtime_r(&time, &date);
+#endif
+
+    return date;
+}
+
+int32_t getHistorySegment(int64_t timestamp) {
+
+    std::tm date = toLocalTime(timestamp);
+
+    return (date.tm_year + 1900) * 100 + date.tm_mon + 1;
+}
+
+std::string getHistorySegmentFile(int32_t segment) {
+
+    return HISTORY_SEGMENT_PREFIX + std::to_string(segment) + ".dat";
+}
+
+bool appendHistory(const std::string& accountNum, eHistoryType type, float amount, float balanceAfter) {
+
+    sHistoryRecord record;
+
+    accountNum.copy(record.accountNum, sizeof(record.accountNum) - 1);
+    record.timestamp = (int64_t)std::time(nullptr);
+    record.type = type;
+    record.amount = amount;
+    record.balanceAfter = balanceAfter;
+
+    // the new record points back at the account's previous one, the index then points at the new record;
+    // the bank and the ATMs both append, so the lock keeps two records from taking the same previous one
+    sFileLock historyLock(HISTORY_LOCK_FILE);
+    sIndexSlot head;
+
+    if (readIndexSlot(HISTORY_INDEX_FILE, accountNum, head)) {
+
+        record.previousSegment = (int32_t)head.first;
+        record.previousOffset = head.second;
+    }
+
+    int32_t segment = getHistorySegment(record.timestamp);
+
+    FILE* file = std::fopen(getHistorySegmentFile(segment).c_str(), "ab");
+
+    if (file == nullptr)
+        return false;
+
+    std::fseek(file, 0, SEEK_END);
+    int64_t offset = std::ftell(file);
+
+    // the record is on disk before the head slot points at it
+    bool isWritten = std::fwrite(&record, sizeof(record), 1, file) == 1;
+
+    isWritten = (std::fflush(file) == 0) && isWritten;
+    isWritten = (fsync(fileno(file)) == 0) && isWritten;
+    isWritten = (std::fclose(file) == 0) && isWritten;
+
+    // the head slot is on disk before the lock lets the next append read it
+    return isWritten && offset >= 0 && upsertIndexSlot(HISTORY_INDEX_FILE, makeIndexSlot(accountNum, segment, offset))
+        && syncFile(HISTORY_INDEX_FILE);
+}
+
+std::vector <sHistoryRecord> readAccountHistory(const std::string& accountNum, size_t maxRecords, int64_t fromTime, int64_t toTime) {
+
+    std::vector <sHistoryRecord> vRecords;
+
+    sIndexSlot head;
+
+    if (!readIndexSlot(HISTORY_INDEX_FILE, accountNum, head))
+        return vRecords;
+
+    int32_t segment = (int32_t)head.first;
+    int64_t offset = head.second;
 
     std::fstream file;
+    int32_t openSegment = 0;
+
+    // walk the account's chain newest first, only its own records are ever read
+    while (segment != 0 && vRecords.size() < maxRecords) {
+
+        if (segment != openSegment) {
+
+            file.close();
+            file.clear();
+            file.open(getHistorySegmentFile(segment), std::ios::in | std::ios::binary);
+
+            openSegment = segment;
+        }
+
+        sHistoryRecord record;
+
+        file.seekg(offset);
+        file.read((char*)&record, sizeof(record));
+
+        if (!file.good())
+            break;
+
+        if (record.timestamp < fromTime)
+            break;
+
+        if (record.timestamp <= toTime)
+            vRecords.push_back(record);
+
+        segment = record.previousSegment;
+        offset = record.previousOffset;
+    }
+
+    return vRecords;
+}
+
+
+// output functions (definition)
+
+void printMainMenu() {
+
+    std::cout << "==================================\n";
+    std::cout << "\tATM Main Menu\n";
+    std::cout << "==================================\n";
+    std::cout << "[1] Quick Withdraw\n";
+    std::cout << "[2] Normal Withdraw\n";
+    std::cout << "[3] Deposit\n";
+    std::cout << "[4] Show Balance\n";
+    std::cout << "[5] Mini Statement\n";
+    std::cout << "[6] Exit\n";
+    std::cout << "==================================\n";
+}
+
+void printQuickWithdrawMenu(float balance) {
+
+    std::cout << "==================================\n";
+    std::cout << "\tQuick Withdraw Menu\n";
+    std::cout << "==================================\n";
+
+    // amounts the cassettes can't cover right now are marked with *
+    for (int choice = eQuickWithdraw::WITHDRAW_20; choice <= eQuickWithdraw::WITHDRAW_1000; choice++) {
+
+        int amount = getQuickWithdrawValue((eQuickWithdraw)choice);
+
+        std::cout << "[" << choice << "] " << amount << (canDispense(amount) ? "" : "*");
+        std::cout << ((choice % 2 == 1) ? "\t\t" : "\n");
+    }
+
+    std::cout << "[9] Exit\n";
+    std::cout << "==================================\n";
+
+    std::cout << "Your Current Balance: " << CURRENCY << balance << "\n";
+}
+
+void printCantDispense(int amount) {
+
+    if (amount > dispenser::MAX_WITHDRAW)
+        std::cout << "\nThe maximum per withdrawal is " << CURRENCY << dispenser::MAX_WITHDRAW << ", Try another amount\n";
+
+    else if (amount % dispenser::AMOUNT_STEP != 0)
+        std::cout << "\nAmount must be a multiple of " << dispenser::AMOUNT_STEP << "'s, Try another amount\n";
+
+    else
+        std::cout << "\nThe ATM doesn't have the notes for this amount, Try another amount\n";
+}
+
+void printDispensedNotes(const sNotePlan& plan) {
+
+    std::cout << "Please take your cash:";
+
+    for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++) {
+
+        if (plan.counts[cassette] > 0)
+            std::cout << "  " << plan.counts[cassette] << " x " << CURRENCY << dispenser::DENOMINATIONS[cassette];
+    }
+
+    std::cout << '\n';
+}
+
+void printHistoryRecord(const sHistoryRecord& record) {
+
+    const std::string types[5] = { "", "Deposit", "Withdraw", "Transfer In", "Transfer Out" };
+
+    std::tm localDate = toLocalTime(record.timestamp);
+
+    std::ostringstream date;
+    date << std::put_time(&localDate, "%Y-%m-%d %H:%M");
+
+    std::cout << std::left << std::setw(18) << date.str();
+    std::cout << std::setw(14) << ((record.type >= 1 && record.type <= 4) ? types[record.type] : "?");
+    std::cout << std::setw(10) << record.amount << CURRENCY << record.balanceAfter << '\n';
+}
+
+
+void printLoadTestReport(const sLoadTestStats& stats, double seconds) {
+
+    const std::string flows[loadtest::NUM_OF_FLOWS] = { "Login", "Quick Withdraw", "Normal Withdraw", "Deposit", "Balance", "Whole Visit" };
+
+    std::cout << std::left << std::setw(18) << "Flow" << std::setw(10) << "Count" << std::setw(12) << "Per Second";
+    std::cout << std::setw(12) << "p50 (ms)" << std::setw(12) << "p99 (ms)" << std::setw(12) << "p999 (ms)" << "Max (ms)\n";
+
+    std::cout << std::fixed << std::setprecision(3);
+
+    for (int flow = 0; flow < loadtest::NUM_OF_FLOWS; flow++) {
+
+        std::vector <double> vLatencies = stats.vLatencies[flow];
+
+        std::sort(vLatencies.begin(), vLatencies.end());
+
+        auto percentile = [&vLatencies](double fraction) {
+
+            return vLatencies.empty() ? 0 : vLatencies[std::min(vLatencies.size() - 1, (size_t)(fraction * vLatencies.size()))];
+        };
+
+        std::cout << std::setw(18) << flows[flow] << std::setw(10) << vLatencies.size() << std::setw(12) << vLatencies.size() / seconds;
+        std::cout << std::setw(12) << percentile(0.5) << std::setw(12) << percentile(0.99) << std::setw(12) << percentile(0.999);
+        std::cout << (vLatencies.empty() ? 0 : vLatencies.back()) << '\n';
+    }
+
+    const std::string results[loadtest::NUM_OF_RESULTS] = { "Done", "Insufficient Balance", "Can't Dispense", "Pending Limit",
+        "Cassette Conflict", "Save Failed", "Login Failed", "Balance Conflict" };
+
+    double numOfVisits = std::max <size_t>(1, stats.vLatencies[FLOW_VISIT].size());
+
+    std::cout << "\nOutcomes (aborts are refused by a rule, conflicts lost a race with another customer)\n";
+
+    for (int result = 0; result < loadtest::NUM_OF_RESULTS; result++)
+        std::cout << "| " << std::setw(22) << results[result] << "| " << std::setw(10) << stats.results[result] << "| " << 100.0 * stats.results[result] / numOfVisits << "%\n";
+
+    std::cout << std::defaultfloat << std::setprecision(6) << std::right;
+}
+
+
+// core functions (definition)
+
+void quickWithdraw(sClient& client) {
+
+    while (true) {
+
+        printQuickWithdrawMenu(client.balance);
+
+        eQuickWithdraw choice = (eQuickWithdraw)readMenuChoice(1, 9);
+
+        if (processQuickWithdraw(choice, client))
+            break;
+
+
+        returnToScreen("Quick Withdraw Menu");
+        clearScreen();
+    }
+
+    returnToScreen();
+}
+
+void normalWithdraw(sClient& client) {
+
+    int amount;
+
+    while (true) {
+
+        std::cout << "===================================\n";
+        std::cout << "\tNormal Withdraw Screen\n";
+        std::cout << "===================================\n";
+
+        do {
+
+            amount = readPositiveNum("Enter an amount multiple of " + std::to_string(dispenser::AMOUNT_STEP) + "'s:");
+
+            if (!canDispense(amount))
+                printCantDispense(amount);
+
+        } while (!canDispense(amount));
+
+
+        if (!printAmountExceedBalance(amount, client.balance))
+            break;
+
+
+        returnToScreen("Normal Withdraw");
+        clearScreen();
+    }
+
+    confirmAndSaveTransaction(amount, client);
+
+    returnToScreen();
+}
+
+void Deposit(sClient& client) {
+
+    std::cout << "===================================\n";
+    std::cout << "\tDeposit Screen\n";
+    std::cout << "===================================\n";
+
+    int amount = readPositiveNum("Enter deposit amount: ", CURRENCY);
+
+    confirmAndSaveTransaction(amount, client, false);
+
+    returnToScreen();
+}
+
+void showBalance(float balance) {
+
+    std::cout << "===================================\n";
+    std::cout << "\tShow Balance Screen\n";
+    std::cout << "===================================\n";
+
+    std::cout << "\nYour balance ----> " << CURRENCY << balance << '\n';
+
+    returnToScreen();
+}
+
+void miniStatement(const std::string& accountNum) {
+
+    std::cout << "===================================\n";
+    std::cout << "\tMini Statement Screen\n";
+    std::cout << "===================================\n";
+
+    std::vector <sHistoryRecord> vRecords = readAccountHistory(accountNum, 10);
+
+    if (vRecords.empty())
+        std::cout << "\nNo transactions yet\n";
+
+    for (const sHistoryRecord& record : vRecords)
+        printHistoryRecord(record);
+
+    returnToScreen();
+}
+
+void applyMenuChoice(eMainMenu choice, sClient& client) {
+
+    beginTraceOperation(TRACE_ATM_MAIN, choice);
+    setTraceSubject(client.accountNum);
+
+    clearScreen();
+
+    switch (choice) {
+
+    case eMainMenu::QUICK_WITHDRAW:
+
+        quickWithdraw(client);
+        break;
+
+    case eMainMenu::NORMAL_WITHDRAW:
+
+        normalWithdraw(client);
+        break;
+
+    case eMainMenu::DEPOSIT:
+
+        Deposit(client);
+        break;
+
+    case eMainMenu::SHOW_BALANCE:
+
+        showBalance(refreshSessionBalance(client));
+        break;
+
+    case eMainMenu::MINI_STATEMENT:
+
+        miniStatement(client.accountNum);
+        break;
+
+    case eMainMenu::LOGOUT:
+
+        endTraceOperation();
+
+        Login();
+        break;
+    }
+
+    endTraceOperation();
+}
+
+void startProgram(sClient& client) {
+
+    eMainMenu choice;
+
+    do {
+
+        printMainMenu();
+        choice = (eMainMenu)readMenuChoice(1, 6);
+
+        applyMenuChoice(choice, client);
+
+    } while (choice != eMainMenu::LOGOUT);
+}
 
-    file.open(CLIENTS_FILE, std::ios::out);
+sClient processLoginAndGetClient() {
 
-    if (file.is_open()) {
+    sClient client;
+
+    while (true) {
 
-        for (const sClient& client : vClients) {
+        std::string accountNum = readAccountNum();
+        int pincode = readPincode();
 
-            file << recordToLine(client) << '\n';
+        if (getSessionClient(accountNum, client) && client.pincode == pincode) {
+
+            beginTraceOperation(TRACE_ATM_LOGIN, 0);
+            setTraceSubject(accountNum);
+            endTraceOperation();
+
+            break;
         }
 
-        file.close();
+        std::cout << "\nInvalid AccountNum/Pincode\n";
     }
+
+    return client;
+}
+
+void Login() {
+
+    std::cout << "===============================\n";
+    std::cout << "\tLogin Screen\n";
+    std::cout << "===============================\n";
+
+    sClient client = processLoginAndGetClient();
+
+    clearScreen();
+
+    startProgram(client);
 }
 
-int getClientIndexByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients) {
+// load test --> simulated customers drive the same storage calls as the screens, without the console
 
-    int index = 0;
+std::vector <double> buildZipfCdf(size_t numOfItems, double skew) {
 
-    for (const sClient& client : vClients) {
+    std::vector <double> vCdf(numOfItems);
+    double total = 0;
 
-        if (client.accountNum != accountNum)
-            index++;
+    for (size_t rank = 0; rank < numOfItems; rank++) {
 
-        else
-            return index;
+        total += 1.0 / std::pow((double)(rank + 1), skew);
+        vCdf[rank] = total;
     }
 
-    return CLIENT_NOT_FOUND;
+    for (double& value : vCdf)
+        value /= total;
+
+    return vCdf;
 }
 
-bool isClientExistsByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients) {
+size_t sampleZipf(const std::vector <double>& vCdf, std::mt19937_64& random) {
 
-    return getClientIndexByAccountNum(accountNum, vClients) != CLIENT_NOT_FOUND;
+    double value = std::uniform_real_distribution <double>(0, 1)(random);
+
+    return std::min(vCdf.size() - 1, (size_t)(std::lower_bound(vCdf.begin(), vCdf.end(), value) - vCdf.begin()));
 }
 
-void confirmAndSaveTransaction(int amount, float& balance, const std::vector <sClient>& vClients,  bool isWithdraw) {
+// one customer at the terminal: log in, do one thing, leave
+void runCustomerVisit(const sClient& customer, std::mt19937_64& random, sLoadTestStats& stats, std::chrono::steady_clock::time_point visitStart) {
+
+    auto lap = [](std::chrono::steady_clock::time_point from) {
+
+        return std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - from).count();
+    };
+
+    auto loginStart = std::chrono::steady_clock::now();
 
-    if (confirmTransaction(amount, balance, isWithdraw)) {
+    sClient client;
+
+    if (!getSessionClient(customer.accountNum, client) || client.pincode != customer.pincode) {
 
-        saveClientsToFile(vClients);
+        stats.results[ATM_LOGIN_FAILED]++;
+        stats.vLatencies[FLOW_VISIT].push_back(lap(visitStart));
+        return;
     }
-}
 
-int getQuickWithdrawValue(eQuickWithdraw value) {
+    stats.vLatencies[FLOW_LOGIN].push_back(lap(loginStart));
 
-    switch (value) {
+    int pick = (int)(random() % 100);
+    eLoadTestFlow flow = (pick < 40) ? FLOW_QUICK_WITHDRAW : (pick < 60) ? FLOW_NORMAL_WITHDRAW : (pick < 80) ? FLOW_DEPOSIT : FLOW_BALANCE;
 
-    case eQuickWithdraw::WITHDRAW_20: return 20;
+    auto flowStart = std::chrono::steady_clock::now();
+    eAtmResult result = ATM_OK;
 
-    case eQuickWithdraw::WITHDRAW_50: return 50;
+    if (flow == FLOW_BALANCE)
+        refreshSessionBalance(client);
 
-    case eQuickWithdraw::WITHDRAW_100: return 100;
+    else {
 
-    case eQuickWithdraw::WITHDRAW_200: return 200;
+        bool isWithdraw = flow != FLOW_DEPOSIT;
+        int amount;
 
-    case eQuickWithdraw::WITHDRAW_400: return 400;
+        if (flow == FLOW_QUICK_WITHDRAW)
+            amount = getQuickWithdrawValue((eQuickWithdraw)(eQuickWithdraw::WITHDRAW_20 + random() % 8));
 
-    case eQuickWithdraw::WITHDRAW_600: return 600;
+        else
+            amount = dispenser::AMOUNT_STEP * (int)(1 + random() % 100);
 
-    case eQuickWithdraw::WITHDRAW_800: return 800;
+        sNotePlan plan;
 
-    case eQuickWithdraw::WITHDRAW_1000: return 1000;
+        result = checkTransaction(amount, client, isWithdraw, plan);
 
+        if (result == ATM_OK) {
+
+            client.balance += isWithdraw ? -amount : amount;
+            result = saveTransaction(amount, client, isWithdraw, plan);
+        }
     }
+
+    stats.vLatencies[flow].push_back(lap(flowStart));
+    stats.vLatencies[FLOW_VISIT].push_back(lap(visitStart));
+    stats.results[result]++;
 }
 
-bool processQuickWithdraw(eQuickWithdraw choice, sClient& client, const std::vector <sClient>& vClients) {
+void runLoadTest(const sLoadTestOptions& options) {
 
-    if (choice != eQuickWithdraw::EXIT) {
+    std::vector <sClient> vCustomers;
+    std::istringstream clientsFile(readClientsContent());
+    std::string line;
 
-        int amount = getQuickWithdrawValue(choice);
+    while (std::getline(clientsFile, line)) {
 
+        sClient customer;
 
-        if (printAmountExceedBalance(amount, client.balance))
-            return false;
+        if (lineToRecord(line, customer))
+            vCustomers.push_back(customer);
+    }
 
+    if (vCustomers.empty()) {
 
-        confirmAndSaveTransaction(amount, client.balance, vClients);
-        return true;
+        std::cout << "No clients in " << CLIENTS_FILE << " to run the load test on\n";
+        return;
     }
-}
 
+    // hot accounts are spread over the file instead of being its first lines
+    std::mt19937_64 shuffler(42);
+    std::shuffle(vCustomers.begin(), vCustomers.end(), shuffler);
 
-// output functions (definition)
+    std::vector <double> vCdf = buildZipfCdf(vCustomers.size(), options.zipfSkew);
 
-void printMainMenu() {
+    {
+        std::lock_guard <std::mutex> lock(offline::stateMutex);
 
-    std::cout << "==================================\n";
-    std::cout << "\tATM Main Menu\n";
-    std::cout << "==================================\n";
-    std::cout << "[1] Quick Withdraw\n";
-    std::cout << "[2] Normal Withdraw\n";
-    std::cout << "[3] Deposit\n";
-    std::cout << "[4] Show Balance\n";
-    std::cout << "[5] Exit\n";
-    std::cout << "==================================\n";
-}
+        for (int cassette = 0; cassette < dispenser::NUM_OF_CASSETTES; cassette++)
+            cassettes.counts[cassette] = std::max(cassettes.counts[cassette], loadtest::NOTES_PER_CASSETTE);
 
-void printQuickWithdrawMenu(float balance) {
+        rebuildDispenseTable();
+    }
 
-    std::cout << "==================================\n";
-    std::cout << "\tQuick Withdraw Menu\n";
-    std::cout << "==================================\n";
-    std::cout << "[1] 20" << "\t\t" << "[2] 50\n";
-    std::cout << "[3] 100" << "\t\t" << "[4] 200\n";
-    std::cout << "[5] 400" << "\t\t" << "[6] 600\n";
-    std::cout << "[7] 800" << "\t\t" << "[8] 1000\n";
-    std::cout << "[9] Exit\n";
-    std::cout << "==================================\n";
+    std::cout << "Load test on " << vCustomers.size() << " account(s): " << options.numOfCustomers << " customer(s), " << options.seconds << "s, ";
 
-    std::cout << "Your Current Balance: " << CURRENCY << balance << "\n";
-}
+    if (options.openLoopRate > 0)
+        std::cout << "open loop at " << options.openLoopRate << " visits/s";
+    else
+        std::cout << "closed loop, " << options.thinkMs << " ms think time";
 
+    std::cout << ", zipf skew " << options.zipfSkew << '\n';
+    std::cout << "Cassettes topped up to " << loadtest::NOTES_PER_CASSETTE << " notes each, on a scratch copy of the data, the real files are untouched\n\n";
 
-// core functions (definition)
+    std::string conflicts = readFileContent(ATM_CONFLICTS_FILE);
+    long long conflictsBefore = std::count(conflicts.begin(), conflicts.end(), '\n');
 
-void quickWithdraw(sClient& client, const std::vector <sClient>& vClients) {
+    std::vector <sLoadTestStats> vStats(options.numOfCustomers);
+    std::vector <std::thread> vThreads;
 
-    while (true) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast <std::chrono::steady_clock::duration>(std::chrono::duration <double>(options.seconds));
 
-        printQuickWithdrawMenu(client.balance);
+    for (int t = 0; t < options.numOfCustomers; t++) {
 
-        eQuickWithdraw choice = (eQuickWithdraw)readMenuChoice(1, 9);
+        vThreads.emplace_back([&, t]() {
 
-        if (processQuickWithdraw(choice, client, vClients))
-            break;
+            std::mt19937_64 random(t + 1);
+            sLoadTestStats& stats = vStats[t];
 
+            for (long long visit = t; ; visit += options.numOfCustomers) {
 
-        returnToScreen("Quick Withdraw Menu");
-        clearScreen();
+                std::chrono::steady_clock::time_point visitStart;
+
+                // open loop: visits arrive on a fixed schedule and latency counts from the scheduled time,
+                // so a stall shows up as the queueing delay of every visit behind it (no coordinated omission)
+                if (options.openLoopRate > 0) {
+
+                    visitStart = start + std::chrono::duration_cast <std::chrono::steady_clock::duration>(std::chrono::duration <double>(visit / options.openLoopRate));
+
+                    if (visitStart >= deadline)
+                        break;
+
+                    std::this_thread::sleep_until(visitStart);
+                }
+
+                else {
+
+                    visitStart = std::chrono::steady_clock::now();
+
+                    if (visitStart >= deadline)
+                        break;
+                }
+
+                runCustomerVisit(vCustomers[sampleZipf(vCdf, random)], random, stats, visitStart);
+
+                if (options.openLoopRate <= 0 && options.thinkMs > 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(options.thinkMs));
+            }
+        });
     }
 
-    returnToScreen();
-}
+    for (std::thread& thread : vThreads)
+        thread.join();
 
-void normalWithdraw(sClient& client, const std::vector <sClient>& vClients) {
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
 
-    int amount;
+    sLoadTestStats total;
 
-    while (true) {
+    for (sLoadTestStats& stats : vStats) {
 
-        std::cout << "===================================\n";
-        std::cout << "\tNormal Withdraw Screen\n";
-        std::cout << "===================================\n";
+        for (int flow = 0; flow < loadtest::NUM_OF_FLOWS; flow++)
+            total.vLatencies[flow].insert(total.vLatencies[flow].end(), stats.vLatencies[flow].begin(), stats.vLatencies[flow].end());
 
-        int amountMultiple = 5;
+        for (int result = 0; result < loadtest::NUM_OF_RESULTS; result++)
+            total.results[result] += stats.results[result];
+    }
 
-        do {
+    printLoadTestReport(total, seconds);
 
-            amount = readPositiveNum("Enter an amount multiple of " + std::to_string(amountMultiple) + "'s:");
+    // how far the master file fell behind the terminal
+    auto syncStart = std::chrono::steady_clock::now();
 
-        } while (amount % amountMultiple != 0);
+    waitForOutboxDrain();
 
+    conflicts = readFileContent(ATM_CONFLICTS_FILE);
 
-        if (!printAmountExceedBalance(amount, client.balance))
-            break;
+    std::cout << "\nOutbox drained to " << HOT_BALANCES_FILE << " " << std::chrono::duration <double>(std::chrono::steady_clock::now() - syncStart).count() << "s after the run, ";
+    std::cout << std::count(conflicts.begin(), conflicts.end(), '\n') - conflictsBefore << " sync conflict(s) logged to " << ATM_CONFLICTS_FILE << '\n';
+}
 
+// every regular file of the data directory, the terminal's state files included
+std::filesystem::path copyToScratchDirectory(const std::filesystem::path& dataDirectory, const std::string& prefix) {
 
-        returnToScreen("Normal Withdraw");
-        clearScreen();
+    std::error_code error;
+    std::filesystem::path runDirectory = std::filesystem::temp_directory_path(error) / (prefix
+        + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+    std::filesystem::create_directories(runDirectory, error);
+
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dataDirectory, error)) {
+
+        if (entry.is_regular_file())
+            std::filesystem::copy_file(entry.path(), runDirectory / entry.path().filename(), error);
     }
 
-    confirmAndSaveTransaction(amount, client.balance, vClients);
+    return runDirectory;
+}
 
-    returnToScreen();
+// workload capture --> a --capture session records each operation, --replay re-executes them against this build
+
+void startTraceCapture(const std::string& fileName) {
+
+    trace::fileName = fileName;
 }
 
-void Deposit(sClient& client, const std::vector <sClient>& vClients) {
+void beginTraceOperation(eTraceMenu menu, int choice) {
 
-    std::cout << "===================================\n";
-    std::cout << "\tDeposit Screen\n";
-    std::cout << "===================================\n";
+    if (trace::fileName.empty())
+        return;
 
-    int amount = readPositiveNum("Enter deposit amount: ", CURRENCY);
+    trace::current = sTraceRecord();
 
-    confirmAndSaveTransaction(amount, client.balance, vClients, false);
+    trace::current.timestamp = std::chrono::duration_cast <std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    trace::current.menu = (uint16_t)menu;
+    trace::current.choice = (uint16_t)choice;
 
-    returnToScreen();
+    if (getTraceOperationName(trace::current).empty())
+        trace::current.menu = TRACE_NONE;
 }
 
-void showBalance(float balance) {
+void setTraceSubject(const std::string& accountNum, float amount) {
 
-    std::cout << "===================================\n";
-    std::cout << "\tShow Balance Screen\n";
-    std::cout << "===================================\n";
+    if (trace::current.menu == TRACE_NONE)
+        return;
 
-    std::cout << "\nYour balance ----> " << CURRENCY << balance << '\n';
+    std::memset(trace::current.accountNum, 0, sizeof(trace::current.accountNum));
+    std::memcpy(trace::current.accountNum, accountNum.data(), std::min(accountNum.size(), sizeof(trace::current.accountNum)));
 
-    returnToScreen();
+    trace::current.amount = amount;
 }
 
-void applyMenuChoice(eMainMenu choice, sClient& client, const std::vector <sClient>& vClients) {
+void endTraceOperation() {
 
-    clearScreen();
+    if (trace::current.menu == TRACE_NONE)
+        return;
 
-    switch (choice) {
+    std::fstream file;
 
-    case eMainMenu::QUICK_WITHDRAW:
+    file.open(trace::fileName, std::ios::out | std::ios::app | std::ios::binary);
+    file.write((const char*)&trace::current, sizeof(sTraceRecord));
 
-        quickWithdraw(client, vClients);
-        break;
+    trace::current.menu = TRACE_NONE;
+}
+
+std::vector <sTraceRecord> loadTraceFile(const std::string& fileName) {
 
+    std::string content = readFileContent(fileName);
+    std::vector <sTraceRecord> vRecords(content.size() / sizeof(sTraceRecord));
+
+    if (!vRecords.empty())
+        std::memcpy(vRecords.data(), content.data(), vRecords.size() * sizeof(sTraceRecord));
+
+    return vRecords;
+}
+
+std::string getTraceOperationName(const sTraceRecord& record) {
+
+    if (record.menu == TRACE_ATM_LOGIN)
+        return "Login";
+
+    if (record.menu == TRACE_ATM_MAIN && record.choice < 7)
+        return trace::MAIN_MENU_OPERATIONS[record.choice];
+
+    return "";
+}
+
+// re-executes one captured operation with the storage calls its screen makes; false for Bank_System operations
+bool replayTraceRecord(const sTraceRecord& record, sClient& session) {
+
+    std::string accountNum(record.accountNum, strnlen(record.accountNum, sizeof(record.accountNum)));
+
+    if (record.menu == TRACE_ATM_LOGIN) {
+
+        getSessionClient(accountNum, session);
+        return true;
+    }
+
+    if (record.menu != TRACE_ATM_MAIN)
+        return false;
+
+    // a trace that starts in the middle of a session
+    if (session.accountNum != accountNum && !getSessionClient(accountNum, session))
+        return true;
+
+    switch (record.choice) {
+
+    case eMainMenu::QUICK_WITHDRAW:
     case eMainMenu::NORMAL_WITHDRAW:
+    case eMainMenu::DEPOSIT: {
 
-        normalWithdraw(client, vClients);
-        break;
+        // a zero amount is a screen the customer left without saving anything
+        if (record.amount <= 0)
+            return true;
 
-    case eMainMenu::DEPOSIT:
+        bool isWithdraw = record.choice != eMainMenu::DEPOSIT;
+        int amount = (int)record.amount;
 
-        Deposit(client, vClients);
-        break;
+        sNotePlan plan;
+
+        if (checkTransaction(amount, session, isWithdraw, plan) == ATM_OK) {
+
+            float oldBalance = session.balance;
+
+            session.balance += isWithdraw ? -amount : amount;
+
+            if (saveTransaction(amount, session, isWithdraw, plan) != ATM_OK)
+                session.balance = oldBalance;
+        }
+
+        return true;
+    }
 
     case eMainMenu::SHOW_BALANCE:
 
-        showBalance(client.balance);
-        break;
+        trace::replaySink = (size_t)refreshSessionBalance(session);
+        return true;
+
+    case eMainMenu::MINI_STATEMENT:
+
+        trace::replaySink = readAccountHistory(accountNum, 10).size();
+        return true;
 
     case eMainMenu::LOGOUT:
 
-        Login();
-        break;
+        return true;
     }
+
+    return false;
 }
 
-void startProgram(sClient& client, const std::vector <sClient>& vClients) {
+double parseReplaySpeed(const std::string& speed) {
 
-    eMainMenu choice;
+    if (speed == "max")
+        return 0;
 
-    do {
+    if (speed == "original")
+        return 1;
 
-        printMainMenu();
-        choice = (eMainMenu)readMenuChoice(1, 5);
+    return std::max(0.0, std::stod(speed));
+}
 
-        applyMenuChoice(choice, client, vClients);
+// one row per operation, sorted by name, plus a Total row over all of them
+std::vector <sReplayResult> summarizeReplay(std::map <std::string, std::vector <double>>& latencies) {
 
-    } while (choice != eMainMenu::LOGOUT);
+    auto summarize = [](const std::string& operation, std::vector <double>& vLatencies) {
+
+        std::sort(vLatencies.begin(), vLatencies.end());
+
+        sReplayResult result;
+
+        result.operation = operation;
+        result.count = vLatencies.size();
+        result.p50 = vLatencies[vLatencies.size() / 2];
+        result.p99 = vLatencies[std::min(vLatencies.size() - 1, vLatencies.size() * 99 / 100)];
+        result.max = vLatencies.back();
+
+        for (double latency : vLatencies)
+            result.mean += latency;
+
+        result.mean /= vLatencies.size();
+
+        return result;
+    };
+
+    std::vector <sReplayResult> vResults;
+    std::vector <double> vAll;
+
+    for (auto& entry : latencies) {
+
+        vAll.insert(vAll.end(), entry.second.begin(), entry.second.end());
+        vResults.push_back(summarize(entry.first, entry.second));
+    }
+
+    if (!vAll.empty())
+        vResults.push_back(summarize("Total", vAll));
+
+    return vResults;
 }
 
-sClient processLoginAndGetClient(const std::vector <sClient>& vClients) {
+// same format as Bank_System's, so Bank_System --replay-compare can diff two ATM builds too
+std::string replayResultsToFileContent(const std::vector <sReplayResult>& vResults) {
 
-    sClient client;
-    int index;
+    std::string content;
 
-    while (true) {
+    for (const sReplayResult& result : vResults) {
 
-        client.accountNum = readAccountNum();
-        client.pincode = readPincode();
+        content += result.operation + SEPARATOR + std::to_string(result.count) + SEPARATOR + std::to_string(result.p50) + SEPARATOR;
+        content += std::to_string(result.p99) + SEPARATOR + std::to_string(result.max) + SEPARATOR + std::to_string(result.mean) + '\n';
+    }
 
-        if ((index = getClientIndexByAccountNum(client.accountNum, vClients)) != CLIENT_NOT_FOUND)
-            break;
+    return content;
+}
 
-        std::cout << "\nInvalid AccountNum/Pincode\n";
+void printReplayResults(const std::vector <sReplayResult>& vResults) {
+
+    std::cout << std::left << std::setw(20) << "Operation" << std::right << std::setw(10) << "Count" << std::setw(12) << "p50 (us)";
+    std::cout << std::setw(12) << "p99 (us)" << std::setw(12) << "Max (us)" << std::setw(12) << "Mean (us)" << '\n';
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    for (const sReplayResult& result : vResults) {
+
+        std::cout << std::left << std::setw(20) << result.operation << std::right << std::setw(10) << result.count << std::setw(12) << result.p50;
+        std::cout << std::setw(12) << result.p99 << std::setw(12) << result.max << std::setw(12) << result.mean << '\n';
     }
 
-    client.name = vClients[index].name;
-    client.phoneNum = vClients[index].phoneNum;
-    client.balance = vClients[index].balance;
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
 
-    return client;
+// speed 1 keeps the captured gaps between operations, 0 runs them back to back, anything else divides the gaps by it
+void runReplay(const std::string& traceFile, double speed, const std::string& resultsFile) {
+
+    std::vector <sTraceRecord> vRecords = loadTraceFile(traceFile);
+
+    if (vRecords.empty()) {
+
+        std::cout << "No operations in " << traceFile << '\n';
+        return;
+    }
+
+    std::map <std::string, std::vector <double>> latencies;
+    size_t numOfSkipped = 0;
+
+    sClient session;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (const sTraceRecord& record : vRecords) {
+
+        if (speed > 0) {
+
+            auto offset = std::chrono::nanoseconds((int64_t)((record.timestamp - vRecords[0].timestamp) / speed));
+
+            std::this_thread::sleep_until(start + std::chrono::duration_cast <std::chrono::steady_clock::duration>(offset));
+        }
+
+        auto operationStart = std::chrono::steady_clock::now();
+
+        if (!replayTraceRecord(record, session)) {
+
+            numOfSkipped++;
+            continue;
+        }
+
+        latencies[getTraceOperationName(record)].push_back(std::chrono::duration <double, std::micro>(std::chrono::steady_clock::now() - operationStart).count());
+    }
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Replayed " << vRecords.size() - numOfSkipped << " of " << vRecords.size() << " operation(s) from " << traceFile << " in " << seconds << "s at ";
+
+    if (speed > 0)
+        std::cout << speed << "x original speed";
+    else
+        std::cout << "max speed";
+
+    std::cout << ", " << numOfSkipped << " skipped\n\n";
+
+    std::vector <sReplayResult> vResults = summarizeReplay(latencies);
+
+    printReplayResults(vResults);
+
+    // the next run starts from a master file that has every replayed transaction
+    waitForOutboxDrain();
+
+    if (!resultsFile.empty() && !commitFiles({ { resultsFile, replayResultsToFileContent(vResults) } }))
+        std::cout << "\nCouldn't write " << resultsFile << '\n';
 }
 
-void Login() {
+int runHeadlessCommand(const std::vector <std::string>& vArgs) {
 
-    std::cout << "===============================\n";
-    std::cout << "\tLogin Screen\n";
-    std::cout << "===============================\n";
+    const std::string& command = vArgs[0];
 
-    std::vector <sClient> vClients = loadClientsFromFile();
-    
-    sClient client = processLoginAndGetClient(vClients);
+    if (command == "--replay" && vArgs.size() > 1) {
 
-    clearScreen();
+        runReplay(vArgs[1], parseReplaySpeed((vArgs.size() > 2) ? vArgs[2] : "max"), (vArgs.size() > 3) ? vArgs[3] : "");
+        return 0;
+    }
+
+    if (command == "--load-test") {
+
+        sLoadTestOptions options;
+
+        if (vArgs.size() > 1)
+            options.numOfCustomers = std::max(1, std::stoi(vArgs[1]));
+
+        if (vArgs.size() > 2)
+            options.seconds = std::stod(vArgs[2]);
+
+        if (vArgs.size() > 3)
+            options.thinkMs = std::max(0, std::stoi(vArgs[3]));
+
+        if (vArgs.size() > 4)
+            options.zipfSkew = std::stod(vArgs[4]);
+
+        if (vArgs.size() > 5)
+            options.openLoopRate = std::stod(vArgs[5]);
+
+        runLoadTest(options);
+        return 0;
+    }
+
+    std::cout << "Unknown command: " << command << '\n';
+    std::cout << "Usage: ATM_System [--load-test [customers] [seconds] [think ms] [zipf skew] [open loop visits/s]]\n";
+    std::cout << "                  [--capture <trace file>] [--replay <trace file> [max|original|<speedup>] [results file]]\n";
 
-    startProgram(client, vClients);
+    return 1;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+
+    if (!loadShardCount())
+        return 1;
+
+    const std::filesystem::path dataDirectory = std::filesystem::current_path();
+    std::filesystem::path runDirectory;
+
+    // the load test tops the cassettes up and moves money, so it runs on a scratch copy of the data directory;
+    // the switch comes before any state is loaded, so the terminal never mixes the two
+    if (argc > 1 && std::string(argv[1]) == "--load-test") {
+
+        runDirectory = copyToScratchDirectory(dataDirectory, "atm_load_test_");
+        std::filesystem::current_path(runDirectory);
+    }
+
+    recoverCommit();
+    loadCassettesFromFile();
+    loadOfflineState();
+
+    offline::syncThread = std::thread(syncWorker);
+
+    // an interactive session whose operations are recorded for --replay
+    if (argc > 2 && std::string(argv[1]) == "--capture")
+        startTraceCapture(argv[2]);
+
+    else if (argc > 1) {
+
+        int status = runHeadlessCommand(std::vector <std::string>(argv + 1, argv + argc));
+
+        if (!runDirectory.empty()) {
+
+            std::error_code error;
+
+            stopSyncWorker();
+            std::filesystem::current_path(dataDirectory);
+            std::filesystem::remove_all(runDirectory, error);
+        }
+
+        return status;
+    }
 
     Login();
 
@@ -4,20 +4,120 @@
 #include <limits>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <list>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <functional>
+#include <map>
+#include <unordered_set>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAS_SSE2
+#endif
+
+// the crc32 instruction comes with SSE4.2, its 8-byte form only in 64-bit builds; crc32c checks CPUID at run time,
+// so a default x64 build (no /arch:AVX or -msse4.2) still uses it on CPUs that have it
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSE42_TARGET
+#else
+#include <cpuid.h>
+#define SSE42_TARGET __attribute__((target("sse4.2")))
+#endif
+#define HAS_SSE42
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#define fsync _commit
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
 
 
 // constants
 
 const std::string SEPARATOR = " /##/ ";
 
-const int CLIENT_NOT_FOUND = -1;
 const int USER_NOT_FOUND = -99;
 
+const int PASSWORD_ITERATIONS = 100000;     // PBKDF2-HMAC-SHA256 rounds for new and upgraded password hashes
+
 
 namespace file {
 
     const std::string CLIENTS_FILE = "CLIENTS.txt";
+    const std::string CLIENTS_INDEX_FILE = "CLIENTS.idx";
+    const std::string CLIENTS_QUARANTINE_FILE = "CLIENTS_CORRUPT.txt";
+    const std::string CLIENTS_INDEX_SIZE_KEY = "#size";    // index slot holding the CLIENTS.txt size it was built from
+    const std::string CLIENTS_INDEX_LOCK_FILE = "CLIENTS.lock";    // the bank and the ATMs hold it around every CLIENTS.idx write
+    const std::string HOT_BALANCES_FILE = "BALANCES.idx";  // account number -> latest balance, overrides the one in CLIENTS.txt
+    const std::string HOT_BALANCES_LOCK_FILE = "BALANCES.lock";    // the bank and the ATMs hold it around every BALANCES.idx change
+    const std::string CLIENTS_SHARDS_FILE = "CLIENTS_SHARDS.txt";  // how many shard files CLIENTS.txt is split into, missing means one
     const std::string USERS_FILE = "USERS.txt";
+    const std::string SETTINGS_FILE = "SETTINGS.txt";
+    const std::string HISTORY_INDEX_FILE = "HISTORY.idx";
+    const std::string HISTORY_LOCK_FILE = "HISTORY.lock";   // held from reading the head slot to writing the new one
+    const std::string HISTORY_SEGMENT_PREFIX = "HISTORY_";
+    const std::string STATEMENTS_PREFIX = "STATEMENTS_";
+    const std::string ACCRUAL_JOURNAL_FILE = "ACCRUAL_JOURNAL.dat";
+    const std::string IMPORT_REJECTS_FILE = "IMPORT_REJECTS.txt";
+    const std::string AUDIT_FILE = "AUDIT.dat";
+    const std::string REPLAY_RESULTS_FILE = "REPLAY_RESULTS.txt";
+}
+
+namespace snapshot {
+
+    const std::string MAGIC = "BNKSNAP2";
+    const std::string LEGACY_MAGIC = "BNKSNAP1";       // columns without checksums
+}
+
+namespace settings {
+
+    // requests that arrive within the wait window share one write and one fsync
+    int groupCommitMaxBatch = 64;
+    int groupCommitMaxWaitMs = 2;
+
+    // (minimum balance, rate per accrual) sorted by minimum balance, the highest matching tier wins
+    std::vector <std::pair <float, float>> accrualTiers = { { 0.0f, 0.0005f }, { 10000.0f, 0.001f }, { 100000.0f, 0.0015f } };
+    float maintenanceFee = 2.0f;
+    float feeWaiverBalance = 1000.0f;
+
+    // decoded client records kept for repeated teller lookups
+    int clientCacheCapacity = 4096;
+    int clientCacheRevalidateMs = 100;
+
+    // queued file requests plus pending client mutations before a session has to wait for the disk
+    int persistenceMaxQueue = 1024;
 }
 
 namespace menu {
@@ -46,8 +146,11 @@ enum eTransactionsMenu {
 
     TRANSAC_DEPOSIT = 1,
     TRANSAC_WITHDRAW = 2,
-    TRANSAC_SHOW_ALL_BALANCES = 3,
-    TRANSAC_RETURN_TO_MAIN_MENU = 4,
+    TRANSAC_TRANSFER = 3,
+    TRANSAC_SHOW_ALL_BALANCES = 4,
+    TRANSAC_MINI_STATEMENT = 5,
+    TRANSAC_ANALYTICS = 6,
+    TRANSAC_RETURN_TO_MAIN_MENU = 7,
 };
 
 enum eManageUsersMenu {
@@ -73,6 +176,50 @@ enum ePermissions {
 };
 
 
+enum eHistoryType {
+
+    HISTORY_DEPOSIT = 1,
+    HISTORY_WITHDRAW = 2,
+    HISTORY_TRANSFER_IN = 3,
+    HISTORY_TRANSFER_OUT = 4,
+};
+
+enum eAuditAction {
+
+    AUDIT_NONE = 0,
+    AUDIT_LOGIN = 1,
+    AUDIT_LOGOUT = 2,
+    AUDIT_ADD_CLIENT = 3,
+    AUDIT_SHOW_ALL_CLIENTS = 4,
+    AUDIT_UPDATE_CLIENT = 5,
+    AUDIT_REMOVE_CLIENT = 6,
+    AUDIT_FIND_CLIENT = 7,
+    AUDIT_TRANSACTIONS = 8,
+    AUDIT_MANAGE_USERS = 9,
+    AUDIT_DEPOSIT = 10,
+    AUDIT_WITHDRAW = 11,
+    AUDIT_TRANSFER = 12,
+    AUDIT_SHOW_ALL_BALANCES = 13,
+    AUDIT_MINI_STATEMENT = 14,
+    AUDIT_ANALYTICS = 15,
+    AUDIT_ADD_USER = 16,
+    AUDIT_LIST_USERS = 17,
+    AUDIT_UPDATE_USER = 18,
+    AUDIT_REMOVE_USER = 19,
+    AUDIT_FIND_USER = 20,
+};
+
+// the menu a captured choice was made in; the ATM's menus are numbered after the Bank's so one trace format serves both
+enum eTraceMenu {
+
+    TRACE_NONE = 0,
+    TRACE_BANK_MAIN = 1,
+    TRACE_BANK_TRANSACTIONS = 2,
+    TRACE_BANK_MANAGE_USERS = 3,
+    TRACE_ATM_LOGIN = 4,
+    TRACE_ATM_MAIN = 5,
+};
+
 struct sClient {
 
     std::string accountNum = "";
@@ -83,1402 +230,8727 @@ struct sClient {
     bool isDeleted = false;
 };
 
-struct sUser {
+enum eSnapshotColumn {
 
-    std::string name = "";
-    int password = 0;
-    int permissions = 0;
-    bool isDeleted = false;
+    COLUMN_ACCOUNT_NUMS = 1,
+    COLUMN_PINCODES = 2,
+    COLUMN_NAMES = 3,
+    COLUMN_PHONES = 4,
+    COLUMN_BALANCES = 5,
+    COLUMN_USERS = 6,
 };
 
+struct sCommitRequest {
 
-// utility functions (declaration)
-
-float readNum(const std::string& msg, const std::string& sep = " ");
+    std::string fileName = "";
+    std::string content = "";
+    std::function <std::string()> makeContent;     // costly content is built by the writer, off the session thread
+    bool isAppend = false;
+    long long sequence = 0;
+    std::promise <bool> done;
+};
 
-float readNumInRange(const std::string& msg, float min, float max, const std::string& sep = " ");
+// latest state of one client waiting for the persistence thread
+struct sClientMutation {
 
-float readPositiveNum(const std::string& msg, const std::string& sep = " ");
+    sClient client;
+    bool isBalanceOnly = false;     // only the balance changed: the delta is applied to the record in the file
+    float balanceDelta = 0;
+};
 
-std::string readText(const std::string& msg, const std::string& sep = " ");
+// client changes coalesced between two file requests; the group is written right after the requests it follows
+struct sClientMutationGroup {
 
-char readChar(const std::string& msg, const std::string& sep = " ");
+    long long afterSequence = 0;    // the last file request submitted before the group was opened
+    std::unordered_map <std::string, sClientMutation> mutations;
+};
 
-std::vector <std::string> splitText(const std::string& text, const std::string& sep);
+struct sGroupCommitStats {
+
+    long long batches = 0;
+    long long requests = 0;
+    long long fsyncs = 0;
+    int maxBatchSize = 0;
+    long long batchSizeBuckets[8] = {}; // 1, 2-3, 4-7, ..., 128+
+    long long mutations = 0;
+    long long coalescedMutations = 0;
+    long long mutationBatches = 0;
+    long long droppedMutations = 0;     // the client was no longer in the file
+};
 
-void clearScreen();
+// read-only client whose strings point into a buffer owned by someone else (file content or table pool)
+struct sClientView {
 
-bool addLineToFile(const std::string& line, const std::string& fileName);
+    std::string_view accountNum;
+    int pincode = 0;
+    std::string_view name;
+    std::string_view phoneNum;
+    float balance = 0;
+};
 
+// 32 bytes per client: account number inline, name & phone in the table's side pool
+struct sPackedClient {
 
-// input functions (declaration)
+    char accountNum[16] = {};       // zero-padded, longer numbers spill into the pool
+    uint32_t detailsOffset = 0;     // name followed by phone in the pool
+    uint16_t nameLength = 0;
+    uint16_t phoneLength = 0;
+    float balance = 0;
+    uint32_t pincodeAndFlags = 0;   // pincode in the low 30 bits, then isDeleted & isAccountNumSpilled
+};
 
-int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg = "Enter your choice:");
+namespace packed {
 
-std::string readAccountNum(const std::string& msg = "Enter account number:");
+    const uint32_t PINCODE_MASK = (1u << 30) - 1;
+    const uint32_t IS_DELETED = 1u << 30;
+    const uint32_t IS_ACCOUNT_NUM_SPILLED = 1u << 31;
+}
 
-sClient readClientData(const std::vector <sClient>& vClients);
+struct sClientTable {
 
-sUser readUserData(const std::vector <sUser>& vUsers);
+    std::string pool = "";
+    std::vector <sPackedClient> vClients;
+};
 
-void readUpdatedClientData(sClient& client);
+namespace mvcc {
 
-std::string readUsername(const std::string& msg = "Enter username:");
+    constexpr size_t PAGE_RECORDS = 256;        // 8 KB of packed records, the unit a transaction copies
+    constexpr size_t DIRECTORY_PAGES = 64;
+}
 
-int readPermissionsToSet();
+struct sClientPage {
 
+    sPackedClient records[mvcc::PAGE_RECORDS];
+};
 
-// helper functions (declaration)
+struct sClientPageDirectory {
 
-void addClient(const std::vector <sClient>& vClients);
+    std::shared_ptr <const sClientPage> pages[mvcc::DIRECTORY_PAGES];
+};
 
-int getClientIndexByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients);
+// one immutable, point-in-time version of the client table; versions share every page they didn't change
+struct sClientsVersion {
 
-sClient clientLineToRecord(const std::string& line);
+    uint64_t epoch = 0;
+    size_t count = 0;
+    std::shared_ptr <const std::string> pool;
+    std::vector <std::shared_ptr <const sClientPageDirectory>> vDirectories;
+    std::shared_ptr <const std::unordered_map <std::string, size_t>> positions;   // account number -> record position
+};
 
-sUser userLineToRecord(const std::string& line);
+namespace analytics {
 
-std::string clientRecordToLine(const sClient& client);
+    constexpr int NUM_OF_BUCKETS = 9;           // below 0, then one per power of ten from 0 up to 100M and above
+    constexpr float BUCKET_BOUNDS[NUM_OF_BUCKETS - 1] = { 0, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
 
-void returnToMenu(const std::string& menu = menu::MAIN);
+    constexpr int NUM_OF_PERCENTILES = 6;
+    constexpr double PERCENTILES[NUM_OF_PERCENTILES] = { 10, 25, 50, 90, 99, 99.9 };
+    constexpr const char* PERCENTILE_LABELS[NUM_OF_PERCENTILES] = { "p10", "p25", "p50", "p90", "p99", "p99.9" };
+}
 
-void processUpdating(const std::string& accountNum, std::vector <sClient>& vClients);
+struct sBalanceAnalytics {
 
-void processRemoving(const std::string& accountNum, std::vector <sClient>& vClients);
+    uint64_t count = 0;
+    double total = 0;
+    float minBalance = std::numeric_limits <float>::max();
+    float maxBalance = std::numeric_limits <float>::lowest();
+    uint64_t histogram[analytics::NUM_OF_BUCKETS] = {};
+    float percentiles[analytics::NUM_OF_PERCENTILES] = {};
+    std::vector <const sPackedClient*> vTop;     // highest balance first
+    double seconds = 0;
+};
 
-void processRemoving(int index, std::vector <sUser>& vUsers);
+// 64 bytes per operator action in AUDIT.dat
+struct sAuditEvent {
 
-void processUpdating(int index, std::vector <sUser> vUsers);
+    uint64_t sequence = 0;
+    int64_t timestamp = 0;          // nanoseconds since the epoch
+    char username[16] = {};         // the operator, zero-padded
+    char subject[24] = {};          // client account number or username acted on, empty for screens
+    float amount = 0;
+    uint16_t action = 0;
+    uint16_t isChange = 0;          // 0 when a screen was opened, 1 when something was changed
+};
 
-bool confirmTransaction(int depositAmount, float& balance, bool isDeposit = true);
+// ring slot: state is 2 * lap while free for that lap's producer, 2 * lap + 1 once the event is published
+struct alignas(64) sAuditSlot {
 
-bool isClientExistsByIndex(int index);
+    std::atomic <uint64_t> state { 0 };
+    sAuditEvent event;
+};
 
-bool isUserExistsByIndex(int index);
+// 64 bytes per captured operation in a trace file, same layout in ATM_System
+struct sTraceRecord {
 
-std::string userRecordToLine(const sUser& user);
+    int64_t timestamp = 0;              // nanoseconds since the epoch, paces an original-speed replay
+    char accountNum[24] = {};           // zero-padded, empty when the operation has no client
+    char otherAccountNum[24] = {};      // transfer destination
+    float amount = 0;                   // balance delta, transfer amount, statement length or top N
+    uint16_t menu = 0;
+    uint16_t choice = 0;
+};
 
-int getUserIndexByName(const std::string& username, const std::vector <sUser>& vUsers);
+// latency summary of one replayed operation, in microseconds
+struct sReplayResult {
 
-int getUserIndexByNameAndPassword(const std::string& username, int password, const std::vector <sUser>& vUsers);
+    std::string operation;
+    size_t count = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+    double mean = 0;
+};
 
-void processTransactions(std::vector <sClient>& vClients, bool isDeposit);
+// one fixed-size record per transaction in the monthly HISTORY_<yyyymm>.dat segments
+struct sHistoryRecord {
 
-bool checkPermissionAccess(int permissions, ePermissions permissionToCheck);
+    char accountNum[24] = {};
+    int64_t timestamp = 0;
+    int32_t type = 0;
+    float amount = 0;
+    float balanceAfter = 0;
+    int32_t previousSegment = 0;    // where the account's previous record is, 0 if none
+    int64_t previousOffset = 0;
+};
 
-bool isAdmin(int userPermissions);
+// on-disk open-addressing hash index: a header followed by `capacity` slots
+struct sIndexHeader {
 
+    char magic[8] = { 'B', 'N', 'K', 'I', 'N', 'D', 'X', '1' };
+    uint64_t capacity = 0;
+    uint64_t count = 0;
+};
 
-// output functions (declaration)
+struct sIndexSlot {
 
-void printMainMenu();
+    uint64_t keyHash = 0;   // 0 marks an empty slot
+    char key[40] = {};
+    int64_t first = 0;
+    int64_t second = 0;
+};
 
-void printClientsListHeader(int numOfClients);
+// exclusive lock on a file shared with the other processes (the ATMs), held until destroyed
+struct sFileLock {
 
-void printClientRecord(const sClient& client);
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
 
-void printClientCard(const sClient& client);
+    explicit sFileLock(const std::string& fileName) {
 
-void printClientNotFound(const std::string& accountNum);
+        handle = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
 
-void printTransactionsMenu();
+        OVERLAPPED overlapped = {};
 
-void printBalancesListHeader(int numOfClients);
+        if (handle != INVALID_HANDLE_VALUE)
+            LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+    }
 
-void printManageUsersMenu();
+    ~sFileLock() {
 
-void printUsersListHeader(int numOfUsers);
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+    }
+#else
+    int descriptor = -1;
 
-void printUserCard(const sUser& user);
+    explicit sFileLock(const std::string& fileName) {
 
-void printUserNotFound(const std::string& username);
+        descriptor = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
 
-void printAccessDenied();
+        if (descriptor != -1)
+            flock(descriptor, LOCK_EX);
+    }
 
+    ~sFileLock() {
 
-// data functions (declaration)
+        if (descriptor != -1)
+            close(descriptor);
+    }
+#endif
 
-std::vector <sClient> loadClientsFromFile();
+    sFileLock(const sFileLock&) = delete;
+    sFileLock& operator=(const sFileLock&) = delete;
+};
 
-std::vector <sUser> loadUsersFromFile();
+// in-memory counterpart of a CLIENTS.idx slot, the account number itself stays in the file
+struct sClientOffset {
 
-void saveClientsToFile(const std::vector <sClient> vClients);
+    uint64_t keyHash = 0;   // 0 marks an empty slot
+    int64_t offset = 0;
+    int64_t length = 0;
+};
 
-void saveUsersToFile(const std::vector <sUser> vUsers);
+enum eAccrualState {
 
+    ACCRUAL_BEGIN = 1,
+    ACCRUAL_COMMITTED = 2,
+    ACCRUAL_ABORTED = 3,
+    ACCRUAL_ROLLED_BACK = 4,
+};
 
-// core functions (declaration)
+// ACCRUAL_JOURNAL.dat: this header, then one entry per account
+struct sAccrualJournalHeader {
 
-void addClients(sUser& user);
+    char magic[8] = { 'B', 'N', 'K', 'A', 'C', 'R', 'L', '2' };
+    int64_t batchId = 0;
+    uint64_t count = 0;
+    uint64_t preImageHash = 0;  // hashes of the balances before and after the batch, recovery needs one of them to match
+    uint64_t postImageHash = 0;
+    int32_t state = 0;
+};
 
-void showAllClients(const sUser& user);
+struct sAccrualEntry {
 
-void updateClient(const sUser& user);
+    char accountNum[24] = {};
+    float delta = 0;
+};
 
-void removeClient(const sUser& user);
+// open history files reused across many reads, one reader per thread
+struct sHistoryReader {
 
-void findClient(const sUser& user);
+    std::fstream indexFile;
+    sIndexHeader indexHeader;
+    bool isIndexOpen = false;
 
-void Deposit();
+    std::fstream segmentFile;
+    int32_t openSegment = 0;
+};
 
-void Withdraw();
+// a worker's queue of statement chunks, the owner pops from the back and thieves from the front
+struct sWorkQueue {
 
-void showAllBalances();
+    std::mutex mutex;
+    std::deque <size_t> tasks;
+};
 
-void applyTransaction(eTransactionsMenu choice);
+struct sUser {
 
-void Transactions(const sUser& user);
+    std::string name = "";
+    std::string salt = "";
+    std::string passwordHash = "";
+    int iterations = 0;     // 0: a hash from before PBKDF2, one SHA-256 of salt and password
+    int permissions = 0;
+    bool isDeleted = false;
+};
 
-void addUser(const std::vector <sUser>& vUsers);
+// decoded snapshot rows, one vector per column
+struct sSnapshotData {
 
-void addUsers();
+    std::vector <std::string> vAccountNums;
+    std::vector <int> vPincodes;
+    std::vector <std::string> vNames;
+    std::vector <std::string> vPhones;
+    std::vector <float> vBalances;
+    std::vector <sUser> vUsers;
+};
 
-void showAllUsers();
+// CRC32C tables for slicing-by-8: table k advances a CRC over one byte followed by k zero bytes
+struct sCrc32cTable {
 
-void updateUser();
+    uint32_t values[8][256] = {};
+};
 
-void removeUser();
+constexpr sCrc32cTable buildCrc32cTable() {
 
-void findUser();
+    // Castagnoli polynomial, reflected
+    constexpr uint32_t POLYNOMIAL = 0x82F63B78;
 
-void applyMainMenuChoice(eMainMenu choice, sUser& user);
+    sCrc32cTable table;
 
-void applyManageUsersMenuChoice(eManageUsersMenu choice);
+    for (uint32_t byte = 0; byte < 256; byte++) {
 
-void manageUsers(const sUser& user);
+        uint32_t crc = byte;
 
-void startProgram(sUser& user);
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
 
-void Login();
+        table.values[0][byte] = crc;
+    }
 
+    for (int k = 1; k < 8; k++) {
 
+        for (int byte = 0; byte < 256; byte++)
+            table.values[k][byte] = (table.values[k - 1][byte] >> 8) ^ table.values[0][table.values[k - 1][byte] & 0xFF];
+    }
 
-// utility functions (definition)
+    return table;
+}
 
-float readNum(const std::string& msg, const std::string& sep) {
 
-    float num;
+// caches
 
-    std::cout << msg << sep;
-    std::cin >> num;
+namespace cache {
 
-    while (std::cin.fail()) {
+    // username --> user (salted hash + permissions), kept in sync with USERS_FILE
+    std::unordered_map <std::string, sUser> usersIndex;
 
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    // LRU of client records, most recently used first; emptied when CLIENTS.txt changes behind our back
+    std::list <sClient> hotClients;
+    std::unordered_map <std::string, std::list <sClient>::iterator> hotClientsIndex;
+    long long clientHits = 0;
+    long long clientMisses = 0;
 
-        std::cout << "Invalid Number! Enter a valid number:" << sep;
-        std::cin >> num;
-    }
+    int64_t clientsFileStamp = 0;
+    bool isOwnClientsWrite = false;
+    std::chrono::steady_clock::time_point lastValidation;
 
-    return num;
+    // account number hash -> line of CLIENTS.txt, answers lookups while CLIENTS.idx is missing or stale
+    std::vector <sClientOffset> clientOffsets;
+    int64_t clientOffsetsStamp = 0;
 }
 
-float readNumInRange(const std::string& msg, float min, float max, const std::string& sep) {
-
-    float num;
 
-    do {
+// multi-version client table --> reports read a pinned version while transactions publish new ones
 
-        num = readNum(msg, sep);
+namespace mvcc {
 
-    } while (num < min || num > max);
+    // only accessed through std::atomic_load / std::atomic_store
+    std::shared_ptr <const sClientsVersion> current;
 
-    return num;
+    // writers serialize on this, readers never take it
+    std::mutex writeMutex;
+    uint64_t lastEpoch = 0;
 }
 
-float readPositiveNum(const std::string& msg, const std::string& sep) {
 
-    float num;
+// persistence
 
-    do {
+namespace persistence {
 
-        num = readNum(msg, sep);
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque <sCommitRequest> queue;
 
-    } while (num < 1);
+    // held by the writer while a batch is on its way to disk
+    std::mutex diskMutex;
+    std::vector <sCommitRequest> inflight;
 
-    return num;
-}
+    // client account number -> its pending change, fed by the session thread; a file request queued after a
+    // group closes it, so requests and mutations reach the disk in the order they were submitted
+    std::deque <sClientMutationGroup> clientMutations;
+    std::unordered_map <std::string, sClientMutation> inflightMutations;
+    size_t numOfQueuedMutations = 0;
 
-std::string readText(const std::string& msg, const std::string& sep) {
+    std::condition_variable writesDone;
+    long long submittedSequence = 0;
+    long long completedSequence = 0;
+    int failedWrites = 0;
+    int reportedFailedWrites = 0;
 
-    std::string text;
+    std::thread writer;
+    bool isStopping = false;
 
-    std::cout << msg << sep;
-    std::getline(std::cin >> std::ws, text);
+    sGroupCommitStats stats;
 
-    return text;
-}
+    struct sWriterGuard {
 
-char readChar(const std::string& msg, const std::string& sep) {
+        ~sWriterGuard() {
 
-    char character;
+            {
+                std::lock_guard <std::mutex> lock(queueMutex);
+                isStopping = true;
+            }
 
-    std::cout << msg << sep;
-    std::cin >> character;
+            queueReady.notify_all();
 
-    return character;
+            if (writer.joinable())
+                writer.join();
+        }
+
+    } writerGuard;
 }
 
-std::vector <std::string> splitText(const std::string& text, const std::string& sep) {
 
-    int wordPos = 0;
-    int sepPos;
+// client shards --> CLIENTS.txt split by account-number hash, each shard with its own file, index, hot balances and lock
 
-    std::string word;
-    std::vector <std::string> vWords;
+namespace shards {
 
-    while ((sepPos = text.find(sep, wordPos)) != std::string::npos) {
+    constexpr int MAX_SHARDS = 256;
 
-        word = text.substr(wordPos, sepPos - wordPos);
+    int count = 1;                      // from CLIENTS_SHARDS.txt, one shard is the plain CLIENTS.txt
+    std::mutex mutexes[MAX_SHARDS];     // held while a shard's files are read or rewritten
 
-        if (!word.empty())
-            vWords.push_back(word);
+    // CRC32C and stamp of every shard as last read, a full save leaves the unchanged ones alone
+    std::vector <uint32_t> vCrcs;
+    std::vector <int64_t> vStamps;
+}
 
-        wordPos = sepPos + sep.length();
-    }
 
-    if (wordPos < text.length())
-        vWords.push_back(text.substr(wordPos));
+// record integrity --> every client line ends in a CRC32C, lines that fail it are set aside instead of loaded
 
-    return vWords;
-}
+namespace integrity {
 
-void clearScreen() {
+    constexpr sCrc32cTable CRC32C_TABLE = buildCrc32cTable();
+    constexpr char CHECKSUM_MARKER = '#';
+    constexpr size_t CHECKSUM_LENGTH = 9;              // the marker and 8 hex digits
 
-    system("cls");
+    std::mutex mutex;
+    std::unordered_set <uint32_t> quarantinedLines;   // CRC32C of every line already copied to the quarantine file
+    bool isQuarantineLoaded = false;
+    long long corruptRecords = 0;
+    long long reportedCorruptRecords = 0;
 }
 
-bool addLineToFile(const std::string& line, const std::string& fileName) {
 
-    std::fstream file;
+// audit log --> sessions push events into a lock-free ring, one writer batches them to AUDIT.dat
 
-    file.open(fileName, std::ios::app);
+namespace audit {
 
-    if (file.is_open()) {
+    constexpr size_t QUEUE_CAPACITY = 1 << 14;
+    constexpr size_t MAX_BATCH = 4096;
+    constexpr int FLUSH_INTERVAL_MS = 5;
 
-        file << line << '\n';
+    // the screen each menu choice opens, indexed by the choice
+    constexpr eAuditAction MAIN_MENU_ACTIONS[9] = { AUDIT_NONE, AUDIT_ADD_CLIENT, AUDIT_SHOW_ALL_CLIENTS, AUDIT_UPDATE_CLIENT,
+        AUDIT_REMOVE_CLIENT, AUDIT_FIND_CLIENT, AUDIT_TRANSACTIONS, AUDIT_MANAGE_USERS, AUDIT_LOGOUT };
+    constexpr eAuditAction TRANSACTIONS_MENU_ACTIONS[8] = { AUDIT_NONE, AUDIT_DEPOSIT, AUDIT_WITHDRAW, AUDIT_TRANSFER,
+        AUDIT_SHOW_ALL_BALANCES, AUDIT_MINI_STATEMENT, AUDIT_ANALYTICS, AUDIT_NONE };
+    constexpr eAuditAction MANAGE_USERS_MENU_ACTIONS[7] = { AUDIT_NONE, AUDIT_ADD_USER, AUDIT_LIST_USERS, AUDIT_UPDATE_USER,
+        AUDIT_REMOVE_USER, AUDIT_FIND_USER, AUDIT_NONE };
 
-        file.close();
+    sAuditSlot slots[QUEUE_CAPACITY];
 
-        return true;
-    }
+    alignas(64) std::atomic <uint64_t> enqueuePosition { 0 };
+    alignas(64) uint64_t dequeuePosition = 0;                  // writer only
+    std::atomic <uint64_t> writtenPosition { 0 };
 
-    else
-        return false;
-}
+    std::atomic <long long> fullWaits { 0 };
+    std::atomic <int> failedWrites { 0 };
 
+    // set on login, copied into every event
+    char operatorName[16] = {};
 
-// input functions (definition)
+    std::string fileName;
+    std::thread writer;
+    std::atomic <bool> isStopping { false };
 
-int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg) {
+    struct sWriterGuard {
 
-    return readNumInRange(msg, firstChoice, lastChoice);
-}
+        ~sWriterGuard() {
 
-std::string readAccountNum(const std::string& msg) {
+            isStopping = true;
 
-    return readText(msg);
+            if (writer.joinable())
+                writer.join();
+        }
+
+    } writerGuard;
 }
 
-sClient readClientData(const std::vector <sClient>& vClients) {
 
-    sClient client;
+// workload capture --> every operation of a --capture session goes to a binary trace that --replay re-executes
 
-    client.accountNum = readAccountNum();
-    int index = getClientIndexByAccountNum(client.accountNum, vClients);
+namespace trace {
 
-    while (!isClientExistsByIndex(index)) {
+    constexpr double REGRESSION_PERCENT = 10;     // p99 growth --replay-compare reports as a regression
 
-        std::cout << "\nClient with account number [" << client.accountNum << "] is already added, ";
-        client.accountNum = readAccountNum();
-    }
+    // operation names, indexed by the menu choice; submenus and returns aren't operations
+    const std::string MAIN_MENU_OPERATIONS[9] = { "", "Add Client", "Show All Clients", "Update Client", "Remove Client",
+        "Find Client", "", "", "Logout" };
+    const std::string TRANSACTIONS_MENU_OPERATIONS[8] = { "", "Deposit", "Withdraw", "Transfer", "Show All Balances",
+        "Mini Statement", "Analytics Report", "" };
+    const std::string MANAGE_USERS_MENU_OPERATIONS[7] = { "", "Add User", "List Users", "Update User", "Remove User", "Find User", "" };
 
-    client.pincode = readPositiveNum("Enter pincode:");
-    client.name = readText("Enter client name:");
-    client.phoneNum = readText("Enter phone number:");
-    client.balance = readPositiveNum("Enter balance:", " $");
+    std::string fileName;           // empty while not capturing
+    sTraceRecord current;           // the operation in progress, menu TRACE_NONE when there is none
 
-    return client;
+    volatile size_t replaySink = 0; // keeps the replayed scans from being optimized away
 }
 
-void readUpdatedClientData(sClient& client) {
 
-    client.pincode = readPositiveNum("Enter new pincode:");
-    client.name = readText("Enter new client name:");
-    client.phoneNum = readText("Enter new phone number:");
-    client.balance = readPositiveNum("Enter new balance: ", "$");
-}
+// utility functions (declaration)
 
-std::string readUsername(const std::string& msg) {
+float readNum(const std::string& msg, const std::string& sep = " ");
 
-    return readText(msg);
-}
+float readNumInRange(const std::string& msg, float min, float max, const std::string& sep = " ");
 
-void readCheckAddPermission(const std::string& permissionToCheck, int& permissions, ePermissions allowedPermission) {
+float readPositiveNum(const std::string& msg, const std::string& sep = " ");
 
-    char permission = readChar(permissionToCheck + " (Y/N): ");
+std::string readText(const std::string& msg, const std::string& sep = " ");
 
-    if (toupper(permission) == 'Y')
-        permissions |= allowedPermission;
-}
+char readChar(const std::string& msg, const std::string& sep = " ");
 
-int readPermissionsToSet() {
+std::vector <std::string> splitText(const std::string& text, const std::string& sep);
 
-    char fullAccess = readChar("\nDo you want to give him full access (Y/N):");
+void clearScreen();
 
-    if (toupper(fullAccess) != 'Y') {
+std::future <bool> addLineToFile(const std::string& line, const std::string& fileName);
 
-        int permissions = 0;
+std::string sha256(const std::string& text);
 
+std::string toHex(const std::string& bytes);
 
-        readCheckAddPermission("\nAdd New Client", permissions, ePermissions::ADD_CLIENT);
+std::string hmacSha256(const std::string& key, const std::string& message);
 
-        readCheckAddPermission("Show All Clients", permissions, ePermissions::SHOW_ALL_CLIENTS);
+std::string pbkdf2Sha256(const std::string& password, const std::string& salt, int iterations);
 
-        readCheckAddPermission("Update Client", permissions, ePermissions::UPDATE_CLIENT);
+std::string generateSalt();
 
-        readCheckAddPermission("Remove Client", permissions, ePermissions::REMOVE_CLIENT);
+std::tm toLocalTime(int64_t timestamp);
 
-        readCheckAddPermission("Find Client", permissions, ePermissions::FIND_CLIENT);
+void appendVarint(std::string& out, uint64_t value);
 
-        readCheckAddPermission("Transactions", permissions, ePermissions::TRANSACTIONS);
+bool readVarint(std::string_view& in, uint64_t& value);
 
-        readCheckAddPermission("Manage Users", permissions, ePermissions::MANAGE_USERS);
+void appendBytes(std::string& out, std::string_view bytes);
 
+bool readBytes(std::string_view& in, std::string_view& bytes);
 
-        return permissions;
-    }
+uint64_t zigzagEncode(int64_t value);
 
-    return ePermissions::FULL_ACCESS;
-}
+int64_t zigzagDecode(uint64_t value);
+
+#ifdef HAS_SSE42
+bool hasCrc32Instruction();
+
+SSE42_TARGET uint32_t crc32cHardware(const char* data, size_t length, uint32_t crc);
+#endif
+
+uint32_t crc32cTable(const char* data, size_t length, uint32_t crc);
+
+uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0);
+
+void appendLineChecksum(std::string& content, size_t lineStart);
+
+bool hasLineChecksum(std::string_view line);
+
+bool verifyLineChecksum(std::string_view& line, bool isRequired);
+
+bool isChecksummedContent(std::string_view content);
+
+std::string checksumLegacyLines(const std::string& content);
+
+bool writeFileDurably(const std::string& fileName, const std::string& content, bool isAppend);
+
+bool syncFile(const std::string& fileName);
+
+bool replaceFile(const std::string& fromFileName, const std::string& toFileName);
+
+
+// input functions (declaration)
+
+int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg = "Enter your choice:");
+
+std::string readAccountNum(const std::string& msg = "Enter account number:");
+
+sClient readClientData();
+
+sUser readUserData(const std::vector <sUser>& vUsers);
+
+void readUpdatedClientData(sClient& client);
+
+std::string readUsername(const std::string& msg = "Enter username:");
+
+int readPermissionsToSet();
+
+
+// helper functions (declaration)
+
+void addClient();
+
+
+bool clientLineToView(std::string_view line, sClientView& client, bool isChecksumRequired = false);
+
+bool parseClientLine(std::string_view line, sClient& client, bool isChecksumRequired = false);
+
+void packClient(const sClientView& client, sClientTable& table);
+
+sClientView unpackClient(const sClientTable& table, const sPackedClient& client);
+
+sClientView unpackClient(const std::string& pool, const sPackedClient& client);
+
+size_t getTableResidentBytes(const sClientTable& table);
+
+size_t getClientsResidentBytes(const std::vector <sClient>& vClients);
+
+size_t getTableAllocations(const sClientTable& table);
+
+size_t getClientsAllocations(const std::vector <sClient>& vClients);
+
+bool userLineToRecord(const std::string& line, sUser& user);
+
+std::string clientRecordToLine(const sClient& client);
+
+void returnToMenu(const std::string& menu = menu::MAIN);
+
+void processUpdating(const std::string& accountNum);
+
+void processRemoving(const std::string& accountNum);
+
+void processRemoving(int index, std::vector <sUser>& vUsers);
+
+void processUpdating(int index, std::vector <sUser> vUsers);
+
+bool confirmTransaction(int depositAmount, float& balance, bool isDeposit = true);
+
+bool isUserExistsByIndex(int index);
+
+std::string userRecordToLine(const sUser& user);
+
+int getUserIndexByName(const std::string& username, const std::vector <sUser>& vUsers);
+
+std::string hashPassword(int password, const std::string& salt, int iterations);
+
+void setUserPassword(sUser& user, int password);
+
+bool verifyUserPassword(const sUser& user, int password);
+
+bool findUserByNameAndPassword(const std::string& username, int password, sUser& user);
+
+void saveClientTransaction(sClient& client, float delta, bool isDeposit);
+
+void processTransactions(bool isDeposit);
+
+bool readStoredBalance(const std::string& accountNum, std::vector <std::string>& vContents, float& balance);
+
+bool transferStoredBalances(const std::string& fromAccountNum, const std::string& toAccountNum, float amount, float& fromBalance, float& toBalance);
+
+bool saveTransfer(sClient& fromClient, sClient& toClient, float amount);
+
+void processTransfer();
+
+bool checkPermissionAccess(int permissions, ePermissions permissionToCheck);
+
+bool isAdmin(int userPermissions);
+
+
+// output functions (declaration)
+
+void printMainMenu();
+
+void printClientsListHeader(int numOfClients);
+
+void printClientRecord(const sClient& client);
+
+void printClientRecord(const sClientView& client);
+
+void printClientCard(const sClient& client);
+
+void printClientNotFound(const std::string& accountNum);
+
+void printTransactionsMenu();
+
+void printBalancesListHeader(int numOfClients);
+
+void printManageUsersMenu();
+
+void printUsersListHeader(int numOfUsers);
+
+void printUserCard(const sUser& user);
+
+void printUserNotFound(const std::string& username);
+
+void printAccessDenied();
+
+void printHistoryHeader(const std::string& accountNum, int numOfRecords);
+
+void printHistoryRecord(const sHistoryRecord& record);
+
+void printPersistenceWarnings();
+
+
+// data functions (declaration)
+
+std::vector <sClient> loadClientsFromFile(const std::string& fileName = file::CLIENTS_FILE);
+
+void quarantineClientLines(const std::string& fileName, const std::vector <std::string>& vLines);
+
+uint64_t hashKey(std::string_view key);
+
+bool createIndexFile(const std::string& indexFile, uint64_t capacity);
+
+bool openIndexFile(const std::string& indexFile, std::fstream& file, sIndexHeader& header);
+
+bool probeIndexSlot(std::fstream& file, const sIndexHeader& header, const std::string& key, sIndexSlot& slot, uint64_t& position);
+
+bool readIndexSlot(const std::string& indexFile, const std::string& key, sIndexSlot& slot);
+
+bool growIndexFile(const std::string& indexFile, const sIndexHeader& header);
+
+bool upsertIndexSlot(const std::string& indexFile, const sIndexSlot& newSlot);
+
+sIndexSlot makeIndexSlot(std::string_view key, int64_t first, int64_t second);
+
+sIndexSlot makeBalanceSlot(const std::string& accountNum, float balance);
+
+float getSlotBalance(const sIndexSlot& slot);
+
+std::vector <sIndexSlot> loadHotBalances(int shardIndex);
+
+std::vector <std::vector <sIndexSlot>> loadHotBalances();
+
+bool findHotBalance(const std::vector <sIndexSlot>& vSlots, std::string_view accountNum, float& balance);
+
+bool readHotBalance(const std::string& accountNum, float& balance);
+
+bool writeHotBalances(int shardIndex, const std::vector <sIndexSlot>& vSlots);
+
+bool alignHotBalances(int shardIndex, const std::string& content);
+
+void resetHotBalances(int shardIndex);
+
+bool loadShardCount();
+
+int getClientShard(std::string_view accountNum, int numOfShards = shards::count);
+
+std::string getShardFileName(const std::string& fileName, int shardIndex, int numOfShards = shards::count);
+
+std::vector <std::string> splitClientShards(const std::string& content, int numOfShards = shards::count);
+
+std::vector <std::string_view> sliceAtLines(std::string_view content, int numOfSlices);
+
+std::string readClientShards();
+
+bool writeClientShard(int shardIndex, const std::string& content, bool isAppend);
+
+bool writeClientsIndex(int shardIndex, const std::string& content);
+
+bool upsertClientsIndex(int shardIndex, const std::string& appended, int64_t offset);
+
+int findClientsIndexShard(const std::string& fileName);
+
+bool writeClientShards(const std::string& content, bool isAppend);
+
+void reshardClients(int numOfShards);
+
+int32_t getHistorySegment(int64_t timestamp);
+
+std::string getHistorySegmentFile(int32_t segment);
+
+bool appendHistory(const std::string& accountNum, eHistoryType type, float amount, float balanceAfter);
+
+std::vector <sHistoryRecord> readAccountHistory(const std::string& accountNum, size_t maxRecords, int64_t fromTime = 0, int64_t toTime = INT64_MAX);
+
+std::vector <sHistoryRecord> readAccountHistory(sHistoryReader& reader, const std::string& accountNum, size_t maxRecords, int64_t fromTime = 0, int64_t toTime = INT64_MAX);
+
+sClientTable loadClientTable(const std::string& fileName = file::CLIENTS_FILE);
+
+sClientTable parseClientTable(const std::string& buffer, const std::vector <std::vector <sIndexSlot>>& vHotSlots, int numOfSlices, const std::string& fileName);
+
+std::vector <sUser> loadUsersFromFile();
+
+void saveClientsToFile(const std::vector <sClient> vClients);
+
+void saveUsersToFile(const std::vector <sUser> vUsers);
+
+void buildUsersIndex(const std::vector <sUser>& vUsers);
+
+void loadUsersIndex();
+
+bool parseSetting(const std::string& text, int& setting, int low, int high);
+
+bool parseSetting(const std::string& text, float& setting, float low, float high);
+
+void loadSettingsFromFile();
+
+void groupCommitWriter();
+
+void applyCommitBatch(std::vector <sCommitRequest>& vBatch);
+
+std::future <bool> submitToFile(const std::string& fileName, const std::string& content, bool isAppend = false);
+
+std::future <bool> submitDeferredToFile(const std::string& fileName, std::function <std::string()> makeContent);
+
+bool commitToFile(const std::string& fileName, const std::string& content, bool isAppend = false);
+
+bool flushPersistence();
+
+void submitClientMutation(const sClient& client, bool isBalanceOnly = false, float balanceDelta = 0);
+
+void submitClientMutations(const std::vector <sClientMutation>& vMutations);
+
+bool findPendingMutation(const std::string& accountNum, sClient& client);
+
+bool hasPendingMutations();
+
+void waitForClientMutations();
+
+void applyClientMutations(const std::unordered_map <std::string, sClientMutation>& mutations);
+
+int applyShardMutations(int shardIndex, const std::unordered_map <std::string, sClientMutation>& mutations, size_t& numOfApplied);
+
+bool findStoredClientLine(const std::string& accountNum, std::vector <std::string>& vContents, std::string& line);
+
+void applyBalanceMutations(const std::unordered_map <std::string, sClientMutation>& mutations);
+
+void dropClientsVersion();
+
+void startAuditWriter(const std::string& fileName = file::AUDIT_FILE);
+
+void emitAuditEvent(eAuditAction action, std::string_view subject = "", float amount = 0, bool isChange = false);
+
+void setAuditOperator(const std::string& username);
+
+size_t drainAuditQueue(std::string& batch);
+
+void auditWriter();
+
+void flushAuditLog();
+
+void printAuditLog(size_t count);
+
+void startTraceCapture(const std::string& fileName);
+
+void beginTraceOperation(eTraceMenu menu, int choice);
+
+void setTraceSubject(const std::string& accountNum, float amount = 0, const std::string& otherAccountNum = "");
+
+void endTraceOperation();
+
+std::vector <sTraceRecord> loadTraceFile(const std::string& fileName);
+
+std::string getTraceOperationName(const sTraceRecord& record);
+
+bool readPendingContent(const std::string& fileName, std::string& content, bool& hasImage);
+
+bool hasPendingImage(const std::string& fileName);
+
+std::string readFileContent(const std::string& fileName);
+
+std::string readDiskContent(const std::string& fileName);
+
+std::string clientsToFileContent(const std::vector <sClient>& vClients);
+
+std::string buildClientsIndexContent(const std::string& clientsContent);
+
+int64_t getFileStamp(const std::string& fileName);
+
+void revalidateClientCache();
+
+bool findClientLineInContent(const std::string& content, const std::string& accountNum, size_t& offset, size_t& length);
+
+bool readClientLineAt(int64_t offset, int64_t length, const std::string& accountNum, std::string& line);
+
+std::vector <int64_t> buildClientOffsets(const std::string& content);
+
+bool findClientLineByOffsets(const std::string& accountNum, std::string& line);
+
+bool readClientFromStorage(const std::string& accountNum, sClient& client);
+
+void cacheClient(const sClient& client);
+
+bool findClientCached(const std::string& accountNum, sClient& client);
+
+void refreshCachedClients(const std::vector <sClient>& vClients);
+
+sClientView getVersionClient(const sClientsVersion& version, size_t position);
+
+std::shared_ptr <const sClientsVersion> buildClientsVersion(sClientTable& table, uint64_t epoch);
+
+std::shared_ptr <const sClientsVersion> getClientsSnapshot();
+
+void publishClientsVersion(const std::vector <sClient>& vClients);
+
+bool applyBalanceDeltas(const std::vector <std::pair <std::string, float>>& vDeltas);
+
+int getBalanceBucket(float balance);
+
+sBalanceAnalytics computeBalanceAnalytics(const std::vector <std::pair <const sPackedClient*, size_t>>& vSpans, int topN, int numOfThreads);
+
+void printBalanceAnalytics(const sBalanceAnalytics& analytics, const std::string& pool);
+
+std::vector <std::pair <const sPackedClient*, size_t>> getVersionSpans(const sClientsVersion& version);
+
+std::string usersToFileContent(const std::vector <sUser>& vUsers);
+
+
+// core functions (declaration)
+
+void addClients(sUser& user);
+
+void showAllClients(const sUser& user);
+
+void updateClient(const sUser& user);
+
+void removeClient(const sUser& user);
+
+void findClient(const sUser& user);
+
+void Deposit();
+
+void Withdraw();
+
+void Transfer();
+
+int64_t readDate(const std::string& msg, bool isEndOfDay = false);
+
+void miniStatement();
+
+void showAllBalances();
+
+void analyticsReport();
+
+void applyTransaction(eTransactionsMenu choice);
+
+void Transactions(const sUser& user);
+
+void addUser(const std::vector <sUser>& vUsers);
+
+void addUsers();
+
+void showAllUsers();
+
+void updateUser();
+
+void removeUser();
+
+void findUser();
+
+void applyMainMenuChoice(eMainMenu choice, sUser& user);
+
+void applyManageUsersMenuChoice(eManageUsersMenu choice);
+
+void manageUsers(const sUser& user);
+
+void startProgram(sUser& user);
+
+void Login();
+
+void printGroupCommitStats();
+
+void runCommitBenchmark(int numOfThreads, int transactionsPerThread);
+
+bool parseAmount(const std::string& text, float& amount);
+
+int runHeadlessTransfer(const std::string& fromAccountNum, const std::string& toAccountNum, float amount);
+
+void runTransferBenchmark(int maxThreads, int transfersPerThread);
+
+void printClientCacheStats();
+
+void runClientCacheBenchmark(int numOfHotClients, int numOfLookups);
+
+double sumVersionBalances(const sClientsVersion& version);
+
+void runSnapshotBenchmark(int numOfWriters, double seconds);
+
+void runAnalyticsReport(int topN, int numOfThreads, const std::string& fileName);
+
+void runAuditBenchmark(int numOfThreads, int eventsPerThread);
+
+void runMutationBenchmark(int numOfUpdates);
+
+bool runMutationOrderCheck();
+
+bool replayTraceRecord(const sTraceRecord& record);
+
+double parseReplaySpeed(const std::string& speed);
+
+std::vector <sReplayResult> summarizeReplay(std::map <std::string, std::vector <double>>& latencies);
+
+void printReplayResults(const std::vector <sReplayResult>& vResults);
+
+std::string replayResultsToFileContent(const std::vector <sReplayResult>& vResults);
+
+std::vector <sReplayResult> loadReplayResults(const std::string& fileName);
+
+void runReplay(const std::string& traceFile, double speed, const std::string& resultsFile);
+
+bool printReplayComparison(const std::vector <sReplayResult>& vBaseline, const std::vector <sReplayResult>& vCandidate);
+
+bool runReplayComparison(const std::string& traceFile, const std::string& baseline, const std::string& candidate, const std::string& speed);
+
+bool parseStatementPeriod(const std::string& period, int64_t& fromTime, int64_t& toTime);
+
+void renderStatement(std::string& buffer, const sClientView& client, const std::vector <sHistoryRecord>& vRecords, const std::string& period, int64_t toTime);
+
+void runStatementJob(const std::string& period, int numOfThreads, int numOfShards);
+
+void computeAccrual(const float* balances, float* newBalances, size_t count);
+
+std::string tableToFileContent(const sClientTable& table);
+
+bool writeAccrualJournalState(eAccrualState state);
+
+bool readAccrualJournalHeader(sAccrualJournalHeader& header);
+
+void lockAllShards(std::vector <std::unique_lock <std::mutex>>& vShardLocks, std::deque <sFileLock>& balancesLocks);
+
+sClientTable loadLockedClientTable();
+
+bool writeLockedClientShards(const std::string& content);
+
+uint64_t hashTableBalances(const sClientTable& table);
+
+void recoverAccrualJournal();
+
+void runAccrualJob(int numOfThreads);
+
+void rollbackAccrualJob();
+
+void generateClientsFile(long long numOfClients, const std::string& fileName);
+
+void printLoadReport(const std::string& fileName);
+
+void importClients(const std::string& sourceFileName);
+
+bool isNumericAccountNum(std::string_view accountNum, std::string_view prefix);
+
+std::string encodeAccountNumsColumn(const std::vector <sClientView>& vClients, bool isNumeric);
+
+std::string encodePincodesColumn(const std::vector <sClientView>& vClients);
+
+std::string encodeNamesColumn(const std::vector <sClientView>& vClients);
+
+std::string encodePhonesColumn(const std::vector <sClientView>& vClients);
+
+std::string encodeBalancesColumn(const std::vector <sClientView>& vClients);
+
+std::string encodeUsersColumn(const std::vector <sUser>& vUsers);
+
+bool decodeAccountNumsColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vAccountNums);
+
+bool decodePincodesColumn(std::string_view in, size_t numOfRows, std::vector <int>& vPincodes);
+
+bool decodeNamesColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vNames);
+
+bool decodePhonesColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vPhones);
+
+bool decodeBalancesColumn(std::string_view in, size_t numOfRows, std::vector <float>& vBalances);
+
+bool decodeUsersColumn(std::string_view in, std::vector <sUser>& vUsers);
+
+std::string encodeSnapshot(const sClientTable& table, const std::vector <sUser>& vUsers);
+
+bool decodeSnapshot(std::string_view in, sSnapshotData& data);
+
+void exportSnapshot(const std::string& fileName);
+
+void restoreSnapshot(const std::string& fileName);
+
+int runHeadlessCommand(const std::vector <std::string>& vArgs);
+
+
+
+// utility functions (definition)
+
+float readNum(const std::string& msg, const std::string& sep) {
+
+    float num;
+
+    std::cout << msg << sep;
+    std::cin >> num;
+
+    while (std::cin.fail()) {
+
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+        std::cout << "Invalid Number! Enter a valid number:" << sep;
+        std::cin >> num;
+    }
+
+    return num;
+}
+
+float readNumInRange(const std::string& msg, float min, float max, const std::string& sep) {
+
+    float num;
+
+    do {
+
+        num = readNum(msg, sep);
+
+    } while (num < min || num > max);
+
+    return num;
+}
+
+float readPositiveNum(const std::string& msg, const std::string& sep) {
+
+    float num;
+
+    do {
+
+        num = readNum(msg, sep);
+
+    } while (num < 1);
+
+    return num;
+}
+
+std::string readText(const std::string& msg, const std::string& sep) {
+
+    std::string text;
+
+    std::cout << msg << sep;
+    std::getline(std::cin >> std::ws, text);
+
+    return text;
+}
+
+char readChar(const std::string& msg, const std::string& sep) {
+
+    char character;
+
+    std::cout << msg << sep;
+    std::cin >> character;
+
+    return character;
+}
+
+std::vector <std::string> splitText(const std::string& text, const std::string& sep) {
+
+    int wordPos = 0;
+    int sepPos;
+
+    std::string word;
+    std::vector <std::string> vWords;
+
+    while ((sepPos = text.find(sep, wordPos)) != std::string::npos) {
+
+        word = text.substr(wordPos, sepPos - wordPos);
+
+        if (!word.empty())
+            vWords.push_back(word);
+
+        wordPos = sepPos + sep.length();
+    }
+
+    if (wordPos < text.length())
+        vWords.push_back(text.substr(wordPos));
+
+    return vWords;
+}
+
+void clearScreen() {
+
+    system("cls");
+}
+
+// the future tells whether the append reached the disk; callers that don't wait on it leave failures to the save warning
+std::future <bool> addLineToFile(const std::string& line, const std::string& fileName) {
+
+    if (fileName == file::CLIENTS_FILE)
+        cache::isOwnClientsWrite = true;
+
+    return submitToFile(fileName, line + '\n', true);
+}
+
+bool writeFileDurably(const std::string& fileName, const std::string& content, bool isAppend) {
+
+    // full rewrites go to a temp file that replaces the original, so a crash never leaves half a file
+    std::string targetName = isAppend ? fileName : fileName + ".tmp";
+
+    FILE* file = std::fopen(targetName.c_str(), isAppend ? "a" : "w");
+
+    if (file == nullptr)
+        return false;
+
+    bool isWritten = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+
+    isWritten = (std::fflush(file) == 0) && isWritten;
+    isWritten = (fsync(fileno(file)) == 0) && isWritten;
+    isWritten = (std::fclose(file) == 0) && isWritten;
+
+    if (!isAppend)
+        isWritten = isWritten && replaceFile(targetName, fileName);
+
+    return isWritten;
+}
+
+bool syncFile(const std::string& fileName) {
+
+    FILE* file = std::fopen(fileName.c_str(), "rb+");
+
+    if (file == nullptr)
+        return false;
+
+    bool isSynced = fsync(fileno(file)) == 0;
+
+    std::fclose(file);
+
+    return isSynced;
+}
+
+bool replaceFile(const std::string& fromFileName, const std::string& toFileName) {
+
+#ifdef _WIN32
+    return MoveFileExA(fromFileName.c_str(), toFileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(fromFileName.c_str(), toFileName.c_str()) == 0;
+#endif
+}
+
+std::string sha256(const std::string& text) {
+
+    static const uint32_t K[64] = {
+
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    std::string message = text;
+    uint64_t bitLength = (uint64_t)text.size() * 8;
+
+    message += (char)0x80;
+
+    while (message.size() % 64 != 56)
+        message += (char)0x00;
+
+    for (int i = 7; i >= 0; i--)
+        message += (char)((bitLength >> (i * 8)) & 0xff);
+
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+
+        uint32_t w[64];
+
+        for (int i = 0; i < 16; i++) {
+
+            const unsigned char* p = (const unsigned char*)&message[chunk + i * 4];
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+
+        for (int i = 16; i < 64; i++) {
+
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+
+        for (int i = 0; i < 64; i++) {
+
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    std::string digest(32, '\0');
+
+    for (int i = 0; i < 8; i++) {
+
+        for (int j = 0; j < 4; j++)
+            digest[i * 4 + j] = (char)(h[i] >> (24 - j * 8));
+    }
+
+    return digest;
+}
+
+std::string toHex(const std::string& bytes) {
+
+    static const char digits[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+
+    for (unsigned char byte : bytes) {
+
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0x0f];
+    }
+
+    return hex;
+}
+
+std::string hmacSha256(const std::string& key, const std::string& message) {
+
+    std::string block = (key.size() > 64) ? sha256(key) : key;
+    block.resize(64, '\0');
+
+    std::string inner(64, '\0'), outer(64, '\0');
+
+    for (int i = 0; i < 64; i++) {
+
+        inner[i] = (char)(block[i] ^ 0x36);
+        outer[i] = (char)(block[i] ^ 0x5c);
+    }
+
+    return sha256(outer + sha256(inner + message));
+}
+
+// one 32-byte block is all a SHA-256 sized hash needs, so only block index 1 is derived
+std::string pbkdf2Sha256(const std::string& password, const std::string& salt, int iterations) {
+
+    std::string u = hmacSha256(password, salt + std::string("\0\0\0\1", 4));
+    std::string result = u;
+
+    for (int i = 1; i < iterations; i++) {
+
+        u = hmacSha256(password, u);
+
+        for (size_t j = 0; j < result.size(); j++)
+            result[j] ^= u[j];
+    }
+
+    return toHex(result);
+}
+
+std::tm toLocalTime(int64_t timestamp) {
+
+    std::time_t time = (std::time_t)timestamp;
+    std::tm date = {};
+
+#ifdef _WIN32
+    localtime_s(&date, &time);
+#else
+    localtime_r(&time, &date);
+#endif
+
+    return date;
+}
+
+std::string generateSalt() {
+
+    static std::random_device device;
+
+    std::ostringstream salt;
+
+    for (int i = 0; i < 4; i++)
+        salt << std::hex << std::setw(8) << std::setfill('0') << device();
+
+    return salt.str();
+}
+
+
+void appendVarint(std::string& out, uint64_t value) {
+
+    while (value >= 0x80) {
+
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+
+    out += (char)value;
+}
+
+bool readVarint(std::string_view& in, uint64_t& value) {
+
+    value = 0;
+
+    for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+
+        uint8_t byte = in[0];
+        in.remove_prefix(1);
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+void appendBytes(std::string& out, std::string_view bytes) {
+
+    appendVarint(out, bytes.size());
+    out.append(bytes.data(), bytes.size());
+}
+
+bool readBytes(std::string_view& in, std::string_view& bytes) {
+
+    uint64_t length;
+
+    if (!readVarint(in, length) || length > in.size())
+        return false;
+
+    bytes = in.substr(0, length);
+    in.remove_prefix(length);
+
+    return true;
+}
+
+uint64_t zigzagEncode(int64_t value) {
+
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t zigzagDecode(uint64_t value) {
+
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+#ifdef HAS_SSE42
+// CPUID leaf 1 reports SSE4.2 in bit 20 of ECX
+bool hasCrc32Instruction() {
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+// the crc is taken and returned un-inverted, crc32c does the inversion
+SSE42_TARGET uint32_t crc32cHardware(const char* data, size_t length, uint32_t crc) {
+
+    uint64_t wideCrc = crc;
+
+    for (; length >= 8; data += 8, length -= 8) {
+
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+
+        wideCrc = _mm_crc32_u64(wideCrc, word);
+    }
+
+    crc = (uint32_t)wideCrc;
+
+    // records are short, the tail is a good part of each one
+    if (length >= 4) {
+
+        uint32_t word;
+        std::memcpy(&word, data, 4);
+
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+
+    for (; length > 0; data++, length--)
+        crc = _mm_crc32_u8(crc, (uint8_t)*data);
+
+    return crc;
+}
+#endif
+
+uint32_t crc32cTable(const char* data, size_t length, uint32_t crc) {
+
+    const uint32_t (&table)[8][256] = integrity::CRC32C_TABLE.values;
+
+    // little-endian loads, like every binary record of the program
+    for (; length >= 8; data += 8, length -= 8) {
+
+        uint32_t low, high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+
+        low ^= crc;
+
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+            table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+
+    if (length >= 4) {
+
+        uint32_t word;
+        std::memcpy(&word, data, 4);
+
+        word ^= crc;
+
+        crc = table[3][word & 0xFF] ^ table[2][(word >> 8) & 0xFF] ^ table[1][(word >> 16) & 0xFF] ^ table[0][word >> 24];
+        data += 4;
+        length -= 4;
+    }
+
+    for (; length > 0; data++, length--)
+        crc = table[0][(crc ^ (uint8_t)*data) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+// CRC32C (Castagnoli): the SSE4.2 crc32 instruction 8 bytes at a time on CPUs that have it, slicing-by-8 otherwise
+uint32_t crc32c(const char* data, size_t length, uint32_t crc) {
+
+#ifdef HAS_SSE42
+    static const bool isHardware = hasCrc32Instruction();
+
+    if (isHardware)
+        return ~crc32cHardware(data, length, ~crc);
+#endif
+
+    return ~crc32cTable(data, length, ~crc);
+}
+
+// closes the line that starts at lineStart with SEPARATOR, the marker and the line's CRC32C in hex
+void appendLineChecksum(std::string& content, size_t lineStart) {
+
+    const char digits[] = "0123456789abcdef";
+
+    uint32_t crc = crc32c(content.data() + lineStart, content.size() - lineStart);
+
+    content += SEPARATOR;
+    content += integrity::CHECKSUM_MARKER;
+
+    for (int shift = 28; shift >= 0; shift -= 4)
+        content += digits[(crc >> shift) & 0xF];
+}
+
+bool hasLineChecksum(std::string_view line) {
+
+    if (line.size() < SEPARATOR.size() + integrity::CHECKSUM_LENGTH)
+        return false;
+
+    size_t checksumStart = line.size() - integrity::CHECKSUM_LENGTH;
+
+    return line[checksumStart] == integrity::CHECKSUM_MARKER && line.compare(checksumStart - SEPARATOR.size(), SEPARATOR.size(), SEPARATOR) == 0;
+}
+
+// false for a corrupt line; a valid checksum is stripped, a line written before checksums only passes when none is required
+bool verifyLineChecksum(std::string_view& line, bool isRequired) {
+
+    if (!hasLineChecksum(line))
+        return !isRequired;
+
+    size_t checksumStart = line.size() - integrity::CHECKSUM_LENGTH;
+    uint32_t stored = 0;
+
+    auto parsed = std::from_chars(line.data() + checksumStart + 1, line.data() + line.size(), stored, 16);
+
+    if (parsed.ec != std::errc() || parsed.ptr != line.data() + line.size())
+        return false;
+
+    line = line.substr(0, checksumStart - SEPARATOR.size());
+
+    return crc32c(line.data(), line.size()) == stored;
+}
+
+// files whose first line has a checksum were written whole by this version, so every line of them must have one
+bool isChecksummedContent(std::string_view content) {
+
+    return hasLineChecksum(content.substr(0, content.find('\n')));
+}
+
+// a rewrite of a file written before checksums gives every line one, so the file is never left half checksummed
+std::string checksumLegacyLines(const std::string& content) {
+
+    std::string upgraded;
+
+    upgraded.reserve(content.size() + content.size() / 4);
+
+    for (size_t offset = 0; offset < content.size();) {
+
+        size_t end = content.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = content.size();
+
+        size_t lineStart = upgraded.size();
+
+        upgraded.append(content, offset, end - offset);
+
+        if (end > offset && !hasLineChecksum(std::string_view(content).substr(offset, end - offset)))
+            appendLineChecksum(upgraded, lineStart);
+
+        upgraded += '\n';
+        offset = end + 1;
+    }
+
+    return upgraded;
+}
+
+
+// input functions (definition)
+
+int readMenuChoice(int firstChoice, int lastChoice, const std::string& msg) {
+
+    return readNumInRange(msg, firstChoice, lastChoice);
+}
+
+std::string readAccountNum(const std::string& msg) {
+
+    return readText(msg);
+}
+
+sClient readClientData() {
+
+    sClient client;
+
+    client.accountNum = readAccountNum();
+
+    // one index probe per candidate, the client list itself is never loaded
+    while (findClientCached(client.accountNum, client)) {
+
+        std::cout << "\nClient with account number [" << client.accountNum << "] is already added, ";
+        client.accountNum = readAccountNum();
+    }
+
+    client.pincode = readPositiveNum("Enter pincode:");
+    client.name = readText("Enter client name:");
+    client.phoneNum = readText("Enter phone number:");
+    client.balance = readPositiveNum("Enter balance:", " $");
+
+    return client;
+}
+
+void readUpdatedClientData(sClient& client) {
+
+    client.pincode = readPositiveNum("Enter new pincode:");
+    client.name = readText("Enter new client name:");
+    client.phoneNum = readText("Enter new phone number:");
+    client.balance = readPositiveNum("Enter new balance: ", "$");
+}
+
+std::string readUsername(const std::string& msg) {
+
+    return readText(msg);
+}
+
+void readCheckAddPermission(const std::string& permissionToCheck, int& permissions, ePermissions allowedPermission) {
+
+    char permission = readChar(permissionToCheck + " (Y/N): ");
+
+    if (toupper(permission) == 'Y')
+        permissions |= allowedPermission;
+}
+
+int readPermissionsToSet() {
+
+    char fullAccess = readChar("\nDo you want to give him full access (Y/N):");
+
+    if (toupper(fullAccess) != 'Y') {
+
+        int permissions = 0;
+
+
+        readCheckAddPermission("\nAdd New Client", permissions, ePermissions::ADD_CLIENT);
+
+        readCheckAddPermission("Show All Clients", permissions, ePermissions::SHOW_ALL_CLIENTS);
+
+        readCheckAddPermission("Update Client", permissions, ePermissions::UPDATE_CLIENT);
+
+        readCheckAddPermission("Remove Client", permissions, ePermissions::REMOVE_CLIENT);
+
+        readCheckAddPermission("Find Client", permissions, ePermissions::FIND_CLIENT);
+
+        readCheckAddPermission("Transactions", permissions, ePermissions::TRANSACTIONS);
+
+        readCheckAddPermission("Manage Users", permissions, ePermissions::MANAGE_USERS);
+
+
+        return permissions;
+    }
+
+    return ePermissions::FULL_ACCESS;
+}
 
 sUser readUserData(const std::vector <sUser>& vUsers) {
 
-    sUser user;
+    sUser user;
+
+    user.name = readUsername();
+    int index = getUserIndexByName(user.name, vUsers);
+
+    while ((isUserExistsByIndex(index))) {
+
+        std::cout << "\nUser is already added, ";
+        user.name = readUsername("Enter a valid username:");
+    }
+
+    setUserPassword(user, readPositiveNum("Enter password:"));
+    user.permissions = readPermissionsToSet();
+
+    return user;
+}
+
+
+// helper functions (definition)
+
+void addClient() {
+
+    sClient client = readClientData();
+    addLineToFile(clientRecordToLine(client), file::CLIENTS_FILE);
+    cacheClient(client);
+
+    // the append is a write of our own, so the next report wouldn't notice it in the file stamp
+    dropClientsVersion();
+
+    emitAuditEvent(AUDIT_ADD_CLIENT, client.accountNum, client.balance, true);
+    setTraceSubject(client.accountNum, client.balance);
+}
+
+// false for a torn or corrupted line, whatever it is missing
+bool clientLineToView(std::string_view line, sClientView& client, bool isChecksumRequired) {
+
+    if (!verifyLineChecksum(line, isChecksumRequired))
+        return false;
+
+    std::string_view vFields[5];
+
+    for (int i = 0; i < 5; i++) {
+
+        size_t sepPos = (i < 4) ? line.find(SEPARATOR) : line.size();
+
+        if (sepPos == std::string_view::npos)
+            return false;
+
+        vFields[i] = line.substr(0, sepPos);
+        line.remove_prefix(std::min(line.size(), sepPos + SEPARATOR.length()));
+    }
+
+    client.accountNum = vFields[0];
+    client.name = vFields[2];
+    client.phoneNum = vFields[3];
+
+    auto pincode = std::from_chars(vFields[1].data(), vFields[1].data() + vFields[1].size(), client.pincode);
+    auto balance = std::from_chars(vFields[4].data(), vFields[4].data() + vFields[4].size(), client.balance);
+
+    // a line cut inside its balance still parses, so both numbers have to fill their whole field
+    return pincode.ec == std::errc() && balance.ec == std::errc() && !client.accountNum.empty() &&
+        pincode.ptr == vFields[1].data() + vFields[1].size() && balance.ptr == vFields[4].data() + vFields[4].size();
+}
+
+bool parseClientLine(std::string_view line, sClient& client, bool isChecksumRequired) {
+
+    sClientView view;
+
+    if (!clientLineToView(line, view, isChecksumRequired))
+        return false;
+
+    client.accountNum = view.accountNum;
+    client.pincode = view.pincode;
+    client.name = view.name;
+    client.phoneNum = view.phoneNum;
+    client.balance = view.balance;
+
+    return true;
+}
+
+void packClient(const sClientView& client, sClientTable& table) {
+
+    sPackedClient record;
+
+    record.detailsOffset = table.pool.size();
+    record.nameLength = std::min <size_t>(client.name.size(), UINT16_MAX);
+    record.phoneLength = std::min <size_t>(client.phoneNum.size(), UINT16_MAX);
+    record.balance = client.balance;
+    record.pincodeAndFlags = (uint32_t)client.pincode & packed::PINCODE_MASK;
+
+    table.pool.append(client.name.data(), record.nameLength);
+    table.pool.append(client.phoneNum.data(), record.phoneLength);
+
+    if (client.accountNum.size() <= sizeof(record.accountNum))
+        std::copy(client.accountNum.begin(), client.accountNum.end(), record.accountNum);
+
+    else {
+
+        // spilled: the inline bytes hold the pool offset and length instead
+        uint32_t offset = table.pool.size();
+        uint32_t length = client.accountNum.size();
+
+        table.pool.append(client.accountNum.data(), length);
+
+        std::copy((const char*)&offset, (const char*)&offset + 4, record.accountNum);
+        std::copy((const char*)&length, (const char*)&length + 4, record.accountNum + 4);
+
+        record.pincodeAndFlags |= packed::IS_ACCOUNT_NUM_SPILLED;
+    }
+
+    table.vClients.push_back(record);
+}
+
+sClientView unpackClient(const sClientTable& table, const sPackedClient& client) {
+
+    return unpackClient(table.pool, client);
+}
+
+sClientView unpackClient(const std::string& pool, const sPackedClient& client) {
+
+    sClientView view;
+
+    if (client.pincodeAndFlags & packed::IS_ACCOUNT_NUM_SPILLED) {
+
+        uint32_t offset, length;
+
+        std::copy(client.accountNum, client.accountNum + 4, (char*)&offset);
+        std::copy(client.accountNum + 4, client.accountNum + 8, (char*)&length);
+
+        view.accountNum = std::string_view(pool.data() + offset, length);
+    }
+
+    else
+        view.accountNum = std::string_view(client.accountNum, strnlen(client.accountNum, sizeof(client.accountNum)));
+
+    view.pincode = client.pincodeAndFlags & packed::PINCODE_MASK;
+    view.name = std::string_view(pool.data() + client.detailsOffset, client.nameLength);
+    view.phoneNum = std::string_view(pool.data() + client.detailsOffset + client.nameLength, client.phoneLength);
+    view.balance = client.balance;
+
+    return view;
+}
+
+size_t getTableResidentBytes(const sClientTable& table) {
+
+    return table.pool.capacity() + table.vClients.capacity() * sizeof(sPackedClient);
+}
+
+size_t getClientsResidentBytes(const std::vector <sClient>& vClients) {
+
+    const size_t inlineCapacity = std::string().capacity();
+
+    size_t bytes = vClients.capacity() * sizeof(sClient);
+
+    for (const sClient& client : vClients) {
+
+        for (const std::string* text : { &client.accountNum, &client.name, &client.phoneNum }) {
+
+            if (text->capacity() > inlineCapacity)
+                bytes += text->capacity() + 1;
+        }
+    }
+
+    return bytes;
+}
+
+// heap blocks the loaded table holds, counted from capacities rather than a global operator new
+size_t getTableAllocations(const sClientTable& table) {
+
+    return (table.pool.capacity() > std::string().capacity()) + (table.vClients.capacity() > 0);
+}
+
+// one block for the vector, one for every string too long for its inline buffer
+size_t getClientsAllocations(const std::vector <sClient>& vClients) {
+
+    const size_t inlineCapacity = std::string().capacity();
+
+    size_t numOfAllocations = (vClients.capacity() > 0);
+
+    for (const sClient& client : vClients) {
+
+        for (const std::string* text : { &client.accountNum, &client.name, &client.phoneNum })
+            numOfAllocations += (text->capacity() > inlineCapacity);
+    }
+
+    return numOfAllocations;
+}
+
+// name /##/ salt /##/ iterations /##/ hash /##/ permissions; older lines have no iterations (one SHA-256)
+// or only a plaintext password, a line that is none of these is skipped
+bool userLineToRecord(const std::string& line, sUser& user) {
+
+    std::vector <std::string> vUser = splitText(line, SEPARATOR);
+
+    if ((vUser.size() < 3 || vUser.size() > 5) || vUser[0].empty())
+        return false;
+
+    auto parseField = [](const std::string& text, int& value) {
+
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+    };
+
+    user.name = vUser[0];
+
+    if (!parseField(vUser.back(), user.permissions))
+        return false;
+
+    // legacy lines: name /##/ plaintext password /##/ permissions
+    if (vUser.size() == 3) {
+
+        int password = 0;
+
+        if (!parseField(vUser[1], password) || password < 0)
+            return false;
+
+        setUserPassword(user, password);
+        return true;
+    }
+
+    user.salt = vUser[1];
+    user.passwordHash = vUser[vUser.size() - 2];
+
+    if (vUser.size() == 5 && (!parseField(vUser[2], user.iterations) || user.iterations <= 0))
+        return false;
+
+    return !user.salt.empty() && !user.passwordHash.empty();
+}
+
+std::string clientRecordToLine(const sClient& client) {
+
+    std::string line = "";
+
+    line += client.accountNum + SEPARATOR;
+    line += std::to_string(client.pincode) + SEPARATOR;
+    line += client.name + SEPARATOR;
+    line += client.phoneNum + SEPARATOR;
+    line += std::to_string(client.balance);
+
+    appendLineChecksum(line, 0);
+
+    return line;
+}
+
+std::string userRecordToLine(const sUser& user) {
+
+    std::string line = "";
+
+    line += user.name + SEPARATOR;
+    line += user.salt + SEPARATOR;
+
+    if (user.iterations > 0)
+        line += std::to_string(user.iterations) + SEPARATOR;
+
+    line += user.passwordHash + SEPARATOR;
+    line += std::to_string(user.permissions);
+
+    return line;
+}
+
+void returnToMenu(const std::string& menu) {
+
+    std::cout << "\nPress any key to return to " << menu << "...";
+    system("pause>0");
+
+    clearScreen();
+}
+
+void processUpdating(const std::string& accountNum) {
+
+    sClient client;
+
+    if (findClientCached(accountNum, client)) {
+
+        printClientCard(client);
+
+        char sureToUpdate = readChar("\nAre you sure you want to update client data (Y/N):");
+
+        if (toupper(sureToUpdate) == 'Y') {
+
+            std::cout << '\n';
+
+            readUpdatedClientData(client);
+
+            // applied in memory right away, the persistence thread rewrites the file
+            submitClientMutation(client);
+            dropClientsVersion();
+
+            emitAuditEvent(AUDIT_UPDATE_CLIENT, accountNum, client.balance, true);
+        }
+    }
+
+    else
+        printClientNotFound(accountNum);
+}
+
+void processRemoving(const std::string& accountNum) {
+
+    sClient client;
+
+    if (findClientCached(accountNum, client)) {
+
+        printClientCard(client);
+
+        char sureToUpdate = readChar("\nAre you sure you want to remove client (Y/N):");
+
+        if (toupper(sureToUpdate) == 'Y') {
+
+            client.isDeleted = true;
+
+            submitClientMutation(client);
+            dropClientsVersion();
+
+            emitAuditEvent(AUDIT_REMOVE_CLIENT, accountNum, client.balance, true);
+        }
+    }
+
+    else
+        printClientNotFound(accountNum);
+}
+
+bool confirmTransaction(int amount, float& balance, bool isDeposit) {
+
+    if (!isDeposit) {
+
+        while (amount > balance) {
+
+            std::cout << "\nWithdraw Amount is more than your balance, ";
+            std::cout << "Current Balance --> $" << balance << '\n';
+
+            amount = readPositiveNum("Enter valid withdraw amount:", " $");
+        }
+
+        amount *= -1;
+    }
+
+    char confirm = readChar("\nAre you sure you want to do this transaction (Y/N):");
+
+    if (toupper(confirm) == 'Y') {
+
+        balance += amount;
+
+        std::cout << "\nNew Account Balance: $" << balance << '\n';
+
+        return true;
+    }
+
+    return false;
+}
+
+bool isUserExistsByIndex(int index) {
+
+    return (index != USER_NOT_FOUND);
+}
+
+int getUserIndexByName(const std::string& username, const std::vector <sUser>& vUsers) {
+
+    int index = 0;
+
+    for (const sUser& user : vUsers) {
+
+        if (user.name != username)
+            index++;
+
+        else
+            return index;
+    }
+
+    return USER_NOT_FOUND;
+}
+
+void processRemoving(int index, std::vector <sUser>& vUsers) {
+
+    if (isUserExistsByIndex(index)) {
+
+        if (isAdmin(vUsers[index].permissions))
+            std::cout << "\nYou can't delete this user\n";
+
+        else {
+
+            printUserCard(vUsers[index]);
+
+            char sureToDelete = readChar("\nAre you sure you want to delete this user (Y/N):");
+
+            if (toupper(sureToDelete) == 'Y') {
+
+                vUsers[index].isDeleted = true;
+                saveUsersToFile(vUsers);
+
+                emitAuditEvent(AUDIT_REMOVE_USER, vUsers[index].name, 0, true);
+                vUsers = loadUsersFromFile();
+
+                std::cout << "\nUser Deleted Successfully!\n";
+            }
+
+            else
+                printUserNotFound(vUsers[index].name);
+        }
+
+    }
+}
+
+void processUpdating(int index, std::vector <sUser> vUsers) {
+
+    if (isUserExistsByIndex(index)) {
+
+        if (isAdmin(vUsers[index].permissions))
+            std::cout << "\nYou can't update info of this user !\n";
+
+        else {
+
+            printUserCard(vUsers[index]);
+
+            char sureToUpdate = readChar("\nAre you sure you want to update this user info (Y/N):");
+
+            setUserPassword(vUsers[index], readPositiveNum("\nEnter new password:"));
+            vUsers[index].permissions = readPermissionsToSet();
+
+            saveUsersToFile(vUsers);
+
+            emitAuditEvent(AUDIT_UPDATE_USER, vUsers[index].name, 0, true);
+
+            std::cout << "\nUser Updated Successfully\n";
+        }
+    }
+
+    else
+        printUserNotFound(vUsers[index].name);
+}
+
+// storage side of a confirmed deposit or withdraw, client.balance already holds the new balance
+void saveClientTransaction(sClient& client, float delta, bool isDeposit) {
+
+    submitClientMutation(client, true, delta);
+    applyBalanceDeltas({ { client.accountNum, delta } });
+
+    appendHistory(client.accountNum, isDeposit ? HISTORY_DEPOSIT : HISTORY_WITHDRAW, delta, client.balance);
+
+    emitAuditEvent(isDeposit ? AUDIT_DEPOSIT : AUDIT_WITHDRAW, client.accountNum, delta, true);
+}
+
+void processTransactions(bool isDeposit = true) {
+
+    std::string accountNum = readAccountNum();
+    sClient client;
+
+    setTraceSubject(accountNum);
+
+    if (findClientCached(accountNum, client)) {
+
+        printClientCard(client);
+
+        std::string transaction = (isDeposit) ? "deposit" : "withdraw";
+
+        float amount = readPositiveNum("\nEnter " + transaction + " amount: ", " $");
+
+        float balance = client.balance;
+
+        if (confirmTransaction(amount, balance, isDeposit)) {
+
+            // queued as a delta, the persistence thread adds it to the record as the file holds it then
+            float delta = balance - client.balance;
+
+            client.balance = balance;
+
+            saveClientTransaction(client, delta, isDeposit);
+            setTraceSubject(accountNum, delta);
+        }
+    }
+
+    else
+        printClientNotFound(accountNum);
+}
+
+// caller holds the account's shard mutex and BALANCES lock: the hot slot when there is one, the CLIENTS.txt line otherwise
+bool readStoredBalance(const std::string& accountNum, std::vector <std::string>& vContents, float& balance) {
+
+    if (readHotBalance(accountNum, balance))
+        return true;
+
+    sClient client;
+    std::string line;
+
+    if (!findStoredClientLine(accountNum, vContents, line) || !parseClientLine(line, client))
+        return false;
+
+    balance = client.balance;
+    return true;
+}
+
+// both shards are locked in index order, their mutexes and then their BALANCES locks, so neither the writer, another
+// transfer nor an ATM sync can change either balance between the overdraft check and the write of the new ones
+bool transferStoredBalances(const std::string& fromAccountNum, const std::string& toAccountNum, float amount, float& fromBalance, float& toBalance) {
+
+    if (fromAccountNum == toAccountNum || amount <= 0)
+        return false;
+
+    int fromShard = getClientShard(fromAccountNum);
+    int toShard = getClientShard(toAccountNum);
+
+    std::unique_lock <std::mutex> firstLock(shards::mutexes[std::min(fromShard, toShard)]);
+    std::unique_lock <std::mutex> secondLock;
+
+    if (fromShard != toShard)
+        secondLock = std::unique_lock <std::mutex>(shards::mutexes[std::max(fromShard, toShard)]);
+
+    sFileLock firstBalancesLock(getShardFileName(file::HOT_BALANCES_LOCK_FILE, std::min(fromShard, toShard)));
+    std::unique_ptr <sFileLock> secondBalancesLock;
+
+    if (fromShard != toShard)
+        secondBalancesLock = std::make_unique <sFileLock>(getShardFileName(file::HOT_BALANCES_LOCK_FILE, std::max(fromShard, toShard)));
+
+    std::vector <std::string> vContents(shards::count);
+
+    if (!readStoredBalance(fromAccountNum, vContents, fromBalance) || !readStoredBalance(toAccountNum, vContents, toBalance) || fromBalance < amount)
+        return false;
+
+    sIndexSlot fromSlot = makeBalanceSlot(fromAccountNum, fromBalance - amount);
+    sIndexSlot toSlot = makeBalanceSlot(toAccountNum, toBalance + amount);
+
+    bool isWritten = (fromShard == toShard) ? writeHotBalances(fromShard, { fromSlot, toSlot })
+        : (writeHotBalances(fromShard, { fromSlot }) && writeHotBalances(toShard, { toSlot }));
+
+    if (!isWritten) {
+
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        persistence::failedWrites++;
+        return false;
+    }
+
+    fromBalance -= amount;
+    toBalance += amount;
+
+    return true;
+}
+
+// every transfer (menu, --transfer and replay) goes through here; the balances checked are the stored ones, not the session's copies
+bool saveTransfer(sClient& fromClient, sClient& toClient, float amount) {
+
+    // the queued changes of either account reach the files first, so the check below sees them
+    {
+        std::unique_lock <std::mutex> lock(persistence::queueMutex);
+        sClient pending;
+
+        persistence::writesDone.wait(lock, [&] {
+
+            return !findPendingMutation(fromClient.accountNum, pending) && !findPendingMutation(toClient.accountNum, pending);
+        });
+    }
+
+    float fromBalance = fromClient.balance, toBalance = toClient.balance;
+    bool isTransferred = transferStoredBalances(fromClient.accountNum, toClient.accountNum, amount, fromBalance, toBalance);
+
+    // on a rejection the caller shows the balance that was actually checked
+    fromClient.balance = fromBalance;
+    toClient.balance = toBalance;
+
+    cacheClient(fromClient);
+    cacheClient(toClient);
+
+    if (!isTransferred)
+        return false;
+
+    applyBalanceDeltas({ { fromClient.accountNum, -amount }, { toClient.accountNum, amount } });
+
+    appendHistory(fromClient.accountNum, HISTORY_TRANSFER_OUT, -amount, fromClient.balance);
+    appendHistory(toClient.accountNum, HISTORY_TRANSFER_IN, amount, toClient.balance);
+
+    emitAuditEvent(AUDIT_TRANSFER, fromClient.accountNum, -amount, true);
+    emitAuditEvent(AUDIT_TRANSFER, toClient.accountNum, amount, true);
+
+    return true;
+}
+
+void processTransfer() {
+
+    std::string fromAccountNum = readAccountNum("Enter account number to transfer from:");
+    sClient fromClient;
+
+    if (!findClientCached(fromAccountNum, fromClient)) {
+
+        printClientNotFound(fromAccountNum);
+        return;
+    }
+
+    printClientCard(fromClient);
+
+    std::string toAccountNum = readAccountNum("\nEnter account number to transfer to:");
+    sClient toClient;
+
+    if (!findClientCached(toAccountNum, toClient)) {
+
+        printClientNotFound(toAccountNum);
+        return;
+    }
+
+    if (toAccountNum == fromAccountNum) {
+
+        std::cout << "\nYou can't transfer to the same account\n";
+        return;
+    }
+
+    printClientCard(toClient);
+
+    float amount = readPositiveNum("\nEnter transfer amount: ", " $");
+
+    while (amount > fromClient.balance) {
+
+        std::cout << "\nTransfer Amount is more than the balance, ";
+        std::cout << "Current Balance --> $" << fromClient.balance << '\n';
+
+        amount = readPositiveNum("Enter valid transfer amount:", " $");
+    }
+
+    char confirm = readChar("\nAre you sure you want to do this transfer (Y/N):");
+
+    if (toupper(confirm) == 'Y') {
+
+        if (saveTransfer(fromClient, toClient, amount)) {
+
+            setTraceSubject(fromAccountNum, amount, toAccountNum);
+
+            std::cout << "\nTransfer Done Successfully\n";
+            std::cout << "[" << fromAccountNum << "] New Balance: $" << fromClient.balance << '\n';
+            std::cout << "[" << toAccountNum << "] New Balance: $" << toClient.balance << '\n';
+        }
+
+        else {
+
+            std::cout << "\nTransfer couldn't be done, the balance changed or couldn't be saved, ";
+            std::cout << "Current Balance --> $" << fromClient.balance << '\n';
+        }
+    }
+}
+
+bool checkPermissionAccess(int permissions, ePermissions permissionToCheck) {
+
+    return ((permissions & permissionToCheck) == permissionToCheck);
+}
+
+std::string hashPassword(int password, const std::string& salt, int iterations) {
+
+    if (iterations == 0)
+        return toHex(sha256(salt + std::to_string(password)));
+
+    return pbkdf2Sha256(std::to_string(password), salt, iterations);
+}
+
+void setUserPassword(sUser& user, int password) {
+
+    user.salt = generateSalt();
+    user.iterations = PASSWORD_ITERATIONS;
+    user.passwordHash = hashPassword(password, user.salt, user.iterations);
+}
+
+bool verifyUserPassword(const sUser& user, int password) {
+
+    std::string hash = hashPassword(password, user.salt, user.iterations);
+
+    if (hash.size() != user.passwordHash.size())
+        return false;
+
+    // compare every character so timing doesn't leak the matching prefix
+    unsigned char diff = 0;
+
+    for (size_t i = 0; i < hash.size(); i++)
+        diff |= hash[i] ^ user.passwordHash[i];
+
+    return diff == 0;
+}
+
+bool findUserByNameAndPassword(const std::string& username, int password, sUser& user) {
+
+    auto it = cache::usersIndex.find(username);
+
+    if (it == cache::usersIndex.end() || !verifyUserPassword(it->second, password))
+        return false;
+
+    // the password is only known here, so a hash from before PBKDF2 or with fewer rounds is upgraded on login
+    if (it->second.iterations != PASSWORD_ITERATIONS) {
+
+        std::vector <sUser> vUsers = loadUsersFromFile();
+        int index = getUserIndexByName(username, vUsers);
+
+        if (isUserExistsByIndex(index)) {
+
+            setUserPassword(vUsers[index], password);
+            saveUsersToFile(vUsers);
+        }
+
+        it = cache::usersIndex.find(username);
+
+        if (it == cache::usersIndex.end())
+            return false;
+    }
+
+    user = it->second;
+    return true;
+}
+
+bool isAdmin(int userPermissions) {
+
+    return checkPermissionAccess(userPermissions, ePermissions::FULL_ACCESS);
+}
+
+
+// output functions (definition)
+
+void printMainMenu() {
+
+    std::cout << "=============================\n";
+    std::cout << "\tMain Menu\n";
+    std::cout << "=============================\n";
+    std::cout << "[1] Add New Client\n";
+    std::cout << "[2] Show All Clients\n";
+    std::cout << "[3] Update Client\n";
+    std::cout << "[4] Remove Client\n";
+    std::cout << "[5] Find Client\n";
+    std::cout << "[6] Transactions\n";
+    std::cout << "[7] Manage Users\n";
+    std::cout << "[8] Logout\n";
+    std::cout << "=============================\n";
+}
+
+void printClientsListHeader(int numOfClients) {
+
+    std::cout << '\n' << "\t\t\tClients List [" << numOfClients << "] Client(s)\n";
+
+    std::cout << std::left;
+    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
+    std::cout << "| " << std::setw(17) << "Account Number";
+    std::cout << "| " << std::setw(10) << "Pincode";
+    std::cout << "| " << std::setw(30) << "Client Name";
+    std::cout << "| " << std::setw(17) << "Phone Number";
+    std::cout << "| " << std::setw(10) << "Balance";
+    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
+}
+
+void printClientRecord(const sClient& client) {
+
+    std::cout << "| " << std::setw(17) << client.accountNum;
+    std::cout << "| " << std::setw(10) << client.pincode;
+    std::cout << "| " << std::setw(30) << client.name;
+    std::cout << "| " << std::setw(17) << client.phoneNum;
+    std::cout << "| $" << std::setw(10) << client.balance << '\n';
+}
+
+void printClientRecord(const sClientView& client) {
+
+    std::cout << "| " << std::setw(17) << client.accountNum;
+    std::cout << "| " << std::setw(10) << client.pincode;
+    std::cout << "| " << std::setw(30) << client.name;
+    std::cout << "| " << std::setw(17) << client.phoneNum;
+    std::cout << "| $" << std::setw(10) << client.balance << '\n';
+}
+
+void printClientCard(const sClient& client) {
+
+    std::cout << "\nAccount Number: " << client.accountNum;
+    std::cout << "\nPincode: " << client.pincode;
+    std::cout << "\nClient Name: " << client.name;
+    std::cout << "\nPhone Number: " << client.phoneNum;
+    std::cout << "\nBalance: $" << client.balance << '\n';
+}
+
+void printClientNotFound(const std::string& accountNum) {
+
+    std::cout << "\nClient with account number [" << accountNum << "] isn't founded\n";
+}
+
+void printTransactionsMenu() {
+
+    std::cout << "=============================\n";
+    std::cout << "\tTransactions Menu\n";
+    std::cout << "=============================\n";
+    std::cout << "[1] Deposit\n";
+    std::cout << "[2] Withdraw\n";
+    std::cout << "[3] Transfer\n";
+    std::cout << "[4] Show All Balances\n";
+    std::cout << "[5] Mini Statement\n";
+    std::cout << "[6] Analytics Report\n";
+    std::cout << "[7] Return To Main Menu\n";
+    std::cout << "=============================\n";
+}
+
+void printBalancesListHeader(int numOfClients) {
+
+    std::cout << '\n' << "\t\t\tClients List [" << numOfClients << "] Client(s)\n";
+
+    std::cout << std::left;
+    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
+    std::cout << "| " << std::setw(17) << "Account Number";
+    std::cout << "| " << std::setw(30) << "Client Name";
+    std::cout << "| " << std::setw(10) << "Balance";
+    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
+}
+
+void printManageUsersMenu() {
+
+    std::cout << "=============================\n";
+    std::cout << "\tManage Users Menu\n";
+    std::cout << "=============================\n";
+    std::cout << "[1] Add New User\n";
+    std::cout << "[2] List Users\n";
+    std::cout << "[3] Update User\n";
+    std::cout << "[4] Remove User\n";
+    std::cout << "[5] Find User\n";
+    std::cout << "[6] Return to Main Menu\n";
+    std::cout << "=============================\n";
+}
+
+void printUsersListHeader(int numOfUsers) {
+
+    std::cout << '\n' << "\t\t\tUsers List [" << numOfUsers << "] User(s)\n";
+
+    std::cout << std::left;
+    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
+    std::cout << "| " << std::setw(17) << "Username";
+    std::cout << "| " << std::setw(20) << "Permissions";
+    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
+}
+
+void printUserCard(const sUser& user) {
+
+    std::cout << "\nUsername: " << user.name;
+    std::cout << "\nPermissions: " << user.permissions << '\n';
+}
+
+void printUserNotFound(const std::string& username) {
+
+    std::cout << "\nUser with username [" << username << "] is not found!\n";
+}
+
+void printAccessDenied() {
+
+    std::cout << "\t\t\t\t\t! Access Denied !\n";
+    std::cout << "\t\t\t\t-- Please contact your admin --\n\n";
+}
+
+void printHistoryHeader(const std::string& accountNum, int numOfRecords) {
+
+    std::cout << '\n' << "\t\t\tMini Statement [" << accountNum << "] " << numOfRecords << " Transaction(s)\n";
+
+    std::cout << std::left;
+    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
+    std::cout << "| " << std::setw(20) << "Date";
+    std::cout << "| " << std::setw(15) << "Type";
+    std::cout << "| " << std::setw(12) << "Amount";
+    std::cout << "| " << std::setw(12) << "Balance";
+    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
+}
+
+void printHistoryRecord(const sHistoryRecord& record) {
+
+    const std::string types[5] = { "", "Deposit", "Withdraw", "Transfer In", "Transfer Out" };
+
+    std::tm localDate = toLocalTime(record.timestamp);
+
+    std::ostringstream date;
+    date << std::put_time(&localDate, "%Y-%m-%d %H:%M");
+
+    std::cout << "| " << std::setw(20) << date.str();
+    std::cout << "| " << std::setw(15) << ((record.type >= 1 && record.type <= 4) ? types[record.type] : "?");
+    std::cout << "| $" << std::setw(11) << record.amount;
+    std::cout << "| $" << std::setw(11) << record.balanceAfter << '\n';
+}
+
+void printPersistenceWarnings() {
+
+    {
+        std::lock_guard <std::mutex> lock(integrity::mutex);
+
+        long long newCorrupt = integrity::corruptRecords - integrity::reportedCorruptRecords;
+
+        if (newCorrupt > 0) {
+
+            std::cout << "! Warning: " << newCorrupt << " corrupt client record(s) skipped, see " << file::CLIENTS_QUARANTINE_FILE << " !\n\n";
+            integrity::reportedCorruptRecords = integrity::corruptRecords;
+        }
+    }
+
+    std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+    int newFailures = persistence::failedWrites - persistence::reportedFailedWrites;
+
+    if (newFailures > 0) {
+
+        std::cout << "! Warning: " << newFailures << " save(s) couldn't be written to disk !\n\n";
+        persistence::reportedFailedWrites = persistence::failedWrites;
+    }
+}
+
+
+// data functions (definition)
+
+std::vector <sClient> loadClientsFromFile(const std::string& fileName) {
+
+    std::string content = readFileContent(fileName);
+
+    bool isChecksumRequired = isChecksummedContent(content);
+
+    std::vector <sClient> vClients;
+    std::vector <std::string> vCorrupt;
+    std::vector <std::vector <sIndexSlot>> vHotSlots;
+
+    if (fileName == file::CLIENTS_FILE) {
+
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        if (!hasPendingImage(fileName))
+            vHotSlots = loadHotBalances();
+    }
+
+    // a sharded file is parsed one slice per shard, each on its own thread
+    std::vector <std::string_view> vSlices = sliceAtLines(content, (fileName == file::CLIENTS_FILE) ? shards::count : 1);
+    std::vector <std::vector <sClient>> vSliceClients(vSlices.size());
+    std::vector <std::vector <std::string>> vSliceCorrupt(vSlices.size());
+    std::vector <std::thread> vThreads;
+
+    for (size_t slice = 0; slice < vSlices.size(); slice++) {
+
+        vThreads.emplace_back([&, slice]() {
+
+            std::string_view remaining = vSlices[slice];
+
+            while (!remaining.empty()) {
+
+                size_t lineEnd = remaining.find('\n');
+                std::string_view line = remaining.substr(0, lineEnd);
+
+                sClient client;
+
+                if (parseClientLine(line, client, isChecksumRequired)) {
+
+                    if (!vHotSlots.empty())
+                        findHotBalance(vHotSlots[getClientShard(client.accountNum)], client.accountNum, client.balance);
+
+                    vSliceClients[slice].push_back(client);
+                }
+
+                else if (!line.empty())
+                    vSliceCorrupt[slice].emplace_back(line);
+
+                remaining.remove_prefix((lineEnd == std::string_view::npos) ? remaining.size() : lineEnd + 1);
+            }
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    vClients = std::move(vSliceClients[0]);
+    vCorrupt = std::move(vSliceCorrupt[0]);
+
+    for (size_t slice = 1; slice < vSlices.size(); slice++) {
+
+        std::move(vSliceClients[slice].begin(), vSliceClients[slice].end(), std::back_inserter(vClients));
+        std::move(vSliceCorrupt[slice].begin(), vSliceCorrupt[slice].end(), std::back_inserter(vCorrupt));
+    }
+
+    // the next full save leaves them out of the file, the quarantine keeps them
+    if (!vCorrupt.empty())
+        quarantineClientLines(fileName, vCorrupt);
+
+    return vClients;
+}
+
+// corrupt lines are copied once to the quarantine file and counted for the menu warning
+void quarantineClientLines(const std::string& fileName, const std::vector <std::string>& vLines) {
+
+    std::string content;
+
+    {
+        std::lock_guard <std::mutex> lock(integrity::mutex);
+
+        // lines an earlier run already set aside aren't copied again
+        if (!integrity::isQuarantineLoaded) {
+
+            std::istringstream quarantine(readFileContent(file::CLIENTS_QUARANTINE_FILE));
+            std::string entry;
+
+            while (std::getline(quarantine, entry)) {
+
+                size_t lineStart = entry.find(SEPARATOR);
+
+                if (lineStart != std::string::npos)
+                    integrity::quarantinedLines.insert(crc32c(entry.data() + lineStart + SEPARATOR.size(), entry.size() - lineStart - SEPARATOR.size()));
+            }
+
+            integrity::isQuarantineLoaded = true;
+        }
+
+        for (const std::string& line : vLines) {
+
+            if (!integrity::quarantinedLines.insert(crc32c(line.data(), line.size())).second)
+                continue;
+
+            content += fileName + SEPARATOR + line + '\n';
+            integrity::corruptRecords++;
+        }
+    }
+
+    if (!content.empty())
+        submitToFile(file::CLIENTS_QUARANTINE_FILE, content, true);
+}
+
+sClientTable loadClientTable(const std::string& fileName) {
+
+    std::string buffer = readFileContent(fileName);
+    std::vector <std::vector <sIndexSlot>> vHotSlots;
+
+    // balances changed since CLIENTS.txt was last written whole live in the hot file; a queued whole file already holds them
+    if (fileName == file::CLIENTS_FILE) {
+
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        if (!hasPendingImage(fileName))
+            vHotSlots = loadHotBalances();
+    }
+
+    return parseClientTable(buffer, vHotSlots, (fileName == file::CLIENTS_FILE) ? shards::count : 1, fileName);
+}
+
+sClientTable parseClientTable(const std::string& buffer, const std::vector <std::vector <sIndexSlot>>& vHotSlots, int numOfSlices, const std::string& fileName) {
+
+    // the file is read into one buffer, parsed in place and packed; only the pool outlives the load
+    sClientTable table;
+
+    std::vector <std::string> vCorrupt;
+
+    bool isChecksumRequired = isChecksummedContent(buffer);
+
+    // a sharded file is parsed one slice per shard, each into its own table, and the tables are joined
+    std::vector <std::string_view> vSlices = sliceAtLines(buffer, numOfSlices);
+    std::vector <sClientTable> vTables(vSlices.size());
+    std::vector <std::vector <std::string>> vSliceCorrupt(vSlices.size());
+    std::vector <std::thread> vThreads;
+
+    for (size_t slice = 0; slice < vSlices.size(); slice++) {
+
+        vThreads.emplace_back([&, slice]() {
+
+            std::string_view content = vSlices[slice];
+            sClientTable& part = vTables[slice];
+            size_t numOfLines = std::count(content.begin(), content.end(), '\n') + 1;
+
+            part.vClients.reserve(numOfLines);
+            part.pool.reserve(numOfLines * 24);
+
+            while (!content.empty()) {
+
+                size_t lineEnd = content.find('\n');
+                std::string_view line = content.substr(0, lineEnd);
+
+                sClientView client;
+
+                if (clientLineToView(line, client, isChecksumRequired)) {
+
+                    if (!vHotSlots.empty())
+                        findHotBalance(vHotSlots[getClientShard(client.accountNum)], client.accountNum, client.balance);
+
+                    packClient(client, part);
+                }
+
+                else if (!line.empty())
+                    vSliceCorrupt[slice].emplace_back(line);
+
+                content.remove_prefix((lineEnd == std::string_view::npos) ? content.size() : lineEnd + 1);
+            }
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    table = std::move(vTables[0]);
+    vCorrupt = std::move(vSliceCorrupt[0]);
+
+    for (size_t slice = 1; slice < vSlices.size(); slice++) {
+
+        // pool offsets of the later tables move up by the pool in front of them
+        uint32_t base = table.pool.size();
+
+        table.pool += vTables[slice].pool;
+        table.vClients.reserve(table.vClients.size() + vTables[slice].vClients.size());
+
+        for (sPackedClient record : vTables[slice].vClients) {
+
+            record.detailsOffset += base;
+
+            if (record.pincodeAndFlags & packed::IS_ACCOUNT_NUM_SPILLED) {
+
+                uint32_t offset;
+
+                std::memcpy(&offset, record.accountNum, sizeof(offset));
+                offset += base;
+                std::memcpy(record.accountNum, &offset, sizeof(offset));
+            }
+
+            table.vClients.push_back(record);
+        }
+
+        vTables[slice] = sClientTable();
+        std::move(vSliceCorrupt[slice].begin(), vSliceCorrupt[slice].end(), std::back_inserter(vCorrupt));
+    }
+
+    if (!vCorrupt.empty())
+        quarantineClientLines(fileName, vCorrupt);
+
+    table.pool.shrink_to_fit();
+    table.vClients.shrink_to_fit();
+
+    return table;
+}
+
+std::string clientsToFileContent(const std::vector <sClient>& vClients) {
+
+    std::string content;
+
+    for (const sClient& client : vClients) {
+
+        if (client.isDeleted == false)
+            content += clientRecordToLine(client) + '\n';
+    }
+
+    return content;
+}
+
+std::string usersToFileContent(const std::vector <sUser>& vUsers) {
+
+    std::string content;
+
+    for (const sUser& user : vUsers) {
+
+        if (user.isDeleted == false)
+            content += userRecordToLine(user) + '\n';
+    }
+
+    return content;
+}
+
+int64_t getFileStamp(const std::string& fileName) {
+
+    // a sharded file changes when any of its shards does
+    if (shards::count > 1 && (fileName == file::CLIENTS_FILE || fileName == file::HOT_BALANCES_FILE)) {
+
+        uint64_t stamp = 0;
+
+        for (int shardIndex = 0; shardIndex < shards::count; shardIndex++)
+            stamp = stamp * 31 + (uint64_t)getFileStamp(getShardFileName(fileName, shardIndex));
+
+        return (int64_t)stamp;
+    }
+
+    std::error_code error;
+
+    uintmax_t size = std::filesystem::file_size(fileName, error);
+
+    if (error)
+        return 0;
+
+    auto time = std::filesystem::last_write_time(fileName, error);
+
+    // size in the low bits, modification time in the high ones; only compared for equality
+    return (int64_t)(size ^ ((uint64_t)time.time_since_epoch().count() << 20));
+}
+
+// drops everything when another process (the ATM, a headless job) changed CLIENTS.txt or BALANCES.idx since the last check
+void revalidateClientCache() {
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - cache::lastValidation < std::chrono::milliseconds(settings::clientCacheRevalidateMs))
+        return;
+
+    cache::lastValidation = now;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        std::string pending;
+        bool hasImage;
+
+        // our own rewrite is still queued, the cached records are already newer than the disk
+        if (readPendingContent(file::CLIENTS_FILE, pending, hasImage) || hasPendingMutations())
+            return;
+    }
+
+    int64_t stamp = (int64_t)((uint64_t)getFileStamp(file::CLIENTS_FILE) * 31 + (uint64_t)getFileStamp(file::HOT_BALANCES_FILE));
+
+    if (stamp == cache::clientsFileStamp)
+        return;
+
+    if (!cache::isOwnClientsWrite) {
+
+        cache::hotClients.clear();
+        cache::hotClientsIndex.clear();
+
+        std::atomic_store(&mvcc::current, std::shared_ptr <const sClientsVersion>());
+    }
+
+    cache::clientsFileStamp = stamp;
+    cache::isOwnClientsWrite = false;
+}
+
+bool findClientLineInContent(const std::string& content, const std::string& accountNum, size_t& offset, size_t& length) {
+
+    std::string prefix = accountNum + SEPARATOR;
+
+    for (offset = 0; offset < content.size();) {
+
+        size_t end = content.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = content.size();
+
+        if (content.compare(offset, prefix.size(), prefix) == 0) {
+
+            length = end - offset;
+            return true;
+        }
+
+        offset = end + 1;
+    }
+
+    return false;
+}
+
+// the bytes at (offset, length) of the account's CLIENTS.txt shard, false when they are no longer a whole line of that account
+bool readClientLineAt(int64_t offset, int64_t length, const std::string& accountNum, std::string& line) {
+
+    // from the byte before the record to the byte after it, both must be newlines (or the file's ends)
+    int64_t start = std::max <int64_t>(offset - 1, 0);
+    line.assign((size_t)(offset - start + length + 1), '\0');
+
+    std::fstream file;
+
+    file.open(getShardFileName(file::CLIENTS_FILE, getClientShard(accountNum)), std::ios::in | std::ios::binary);
+    file.seekg(start);
+    file.read(&line[0], line.size());
+
+    line.resize((size_t)file.gcount());
+
+    bool isValid = (offset == 0) || (!line.empty() && line[0] == '\n');
+
+    if (isValid && offset > 0)
+        line.erase(0, 1);
+
+    isValid = isValid && line.size() >= (size_t)length && (line.size() == (size_t)length || line[length] == '\n');
+
+    if (!isValid)
+        return false;
+
+    line.resize(length);
+
+    return line.compare(0, accountNum.size() + SEPARATOR.size(), accountNum + SEPARATOR) == 0;
+}
+
+// one pass over line starts and account numbers, no field is decoded; probed the same way as CLIENTS.idx.
+// offsets are inside each line's shard file, the size of every shard is returned
+std::vector <int64_t> buildClientOffsets(const std::string& content) {
+
+    size_t numOfLines = std::count(content.begin(), content.end(), '\n') + 1;
+    size_t capacity = 1024;
+
+    while (numOfLines * 10 > capacity * 7)
+        capacity *= 2;
+
+    cache::clientOffsets.assign(capacity, sClientOffset());
+
+    std::vector <int64_t> vShardSizes(shards::count, 0);
+
+    for (size_t offset = 0; offset < content.size();) {
+
+        size_t end = content.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = content.size();
+
+        size_t keyEnd = std::min(content.find(SEPARATOR, offset), end);
+        std::string_view accountNum = std::string_view(content).substr(offset, keyEnd - offset);
+
+        int64_t& shardSize = vShardSizes[getClientShard(accountNum)];
+
+        if (keyEnd < end) {
+
+            uint64_t keyHash = hashKey(accountNum);
+            size_t position = keyHash & (capacity - 1);
+
+            while (cache::clientOffsets[position].keyHash != 0)
+                position = (position + 1) & (capacity - 1);
+
+            cache::clientOffsets[position] = { keyHash, shardSize, (int64_t)(end - offset) };
+        }
+
+        shardSize += end - offset + 1;
+        offset = end + 1;
+    }
+
+    return vShardSizes;
+}
+
+// rebuilt only when CLIENTS.txt changed since the last build, every lookup after that is a single line read
+bool findClientLineByOffsets(const std::string& accountNum, std::string& line) {
+
+    int64_t stamp = getFileStamp(file::CLIENTS_FILE);
+
+    if (cache::clientOffsets.empty() || stamp != cache::clientOffsetsStamp) {
+
+        auto content = std::make_shared <std::string>(readFileContent(file::CLIENTS_FILE));
+        sIndexSlot slot;
+
+        std::vector <int64_t> vShardSizes = buildClientOffsets(*content);
+        cache::clientOffsetsStamp = stamp;
+
+        // a stale CLIENTS.idx is rewritten once by the writer thread, so the next session starts with single probes again
+        for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+            std::string indexFile = getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex);
+
+            if (readIndexSlot(indexFile, file::CLIENTS_INDEX_SIZE_KEY, slot) && slot.first == vShardSizes[shardIndex])
+                continue;
+
+            submitDeferredToFile(indexFile, [content, shardIndex]() {
+
+                return buildClientsIndexContent((shards::count == 1) ? *content : splitClientShards(*content)[shardIndex]);
+            });
+        }
+    }
+
+    uint64_t keyHash = hashKey(accountNum);
+    size_t mask = cache::clientOffsets.size() - 1;
+
+    for (size_t position = keyHash & mask; cache::clientOffsets[position].keyHash != 0; position = (position + 1) & mask) {
+
+        const sClientOffset& entry = cache::clientOffsets[position];
+
+        if (entry.keyHash == keyHash && readClientLineAt(entry.offset, entry.length, accountNum, line))
+            return true;
+    }
+
+    return false;
+}
+
+// records are decoded one at a time on first use: a CLIENTS.idx probe, else the in-memory offsets, then one line read
+bool readClientFromStorage(const std::string& accountNum, sClient& client) {
+
+    bool hasPending, hasImage;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        // a change still on its way to the file is the newest state of that client
+        if (findPendingMutation(accountNum, client))
+            return true;
+
+        std::string pending;
+
+        hasPending = readPendingContent(file::CLIENTS_FILE, pending, hasImage);
+    }
+
+    sIndexSlot slot;
+    std::string line;
+
+    // a queued write isn't on disk yet, only the folded content knows where the client is
+    if (hasPending) {
+
+        std::string content = readFileContent(file::CLIENTS_FILE);
+        size_t offset, length;
+
+        if (!findClientLineInContent(content, accountNum, offset, length))
+            return false;
+
+        line = content.substr(offset, length);
+    }
+
+    else if (!readIndexSlot(getShardFileName(file::CLIENTS_INDEX_FILE, getClientShard(accountNum)), accountNum, slot)
+        || !readClientLineAt(slot.first, slot.second, accountNum, line)) {
+
+        if (!findClientLineByOffsets(accountNum, line))
+            return false;
+    }
+
+    if (parseClientLine(line, client)) {
+
+        if (!hasImage)
+            readHotBalance(accountNum, client.balance);
+
+        return true;
+    }
+
+    quarantineClientLines(file::CLIENTS_FILE, { line });
+    return false;
+}
+
+void cacheClient(const sClient& client) {
+
+    auto it = cache::hotClientsIndex.find(client.accountNum);
+
+    if (it != cache::hotClientsIndex.end()) {
+
+        *it->second = client;
+        cache::hotClients.splice(cache::hotClients.begin(), cache::hotClients, it->second);
+        return;
+    }
+
+    cache::hotClients.push_front(client);
+    cache::hotClientsIndex[client.accountNum] = cache::hotClients.begin();
+
+    if ((int)cache::hotClients.size() > settings::clientCacheCapacity) {
+
+        cache::hotClientsIndex.erase(cache::hotClients.back().accountNum);
+        cache::hotClients.pop_back();
+    }
+}
+
+bool findClientCached(const std::string& accountNum, sClient& client) {
+
+    revalidateClientCache();
+
+    auto it = cache::hotClientsIndex.find(accountNum);
+
+    if (it != cache::hotClientsIndex.end()) {
+
+        cache::clientHits++;
+
+        // most recently used first
+        cache::hotClients.splice(cache::hotClients.begin(), cache::hotClients, it->second);
+
+        client = *it->second;
+        return true;
+    }
+
+    cache::clientMisses++;
+
+    if (!readClientFromStorage(accountNum, client) || client.isDeleted)
+        return false;
+
+    cacheClient(client);
+
+    return true;
+}
+
+// called on every save of the full list, so updates and removals never leave a stale record behind
+void refreshCachedClients(const std::vector <sClient>& vClients) {
+
+    if (cache::hotClientsIndex.empty())
+        return;
+
+    for (const sClient& client : vClients) {
+
+        auto it = cache::hotClientsIndex.find(client.accountNum);
+
+        if (it == cache::hotClientsIndex.end())
+            continue;
+
+        if (client.isDeleted) {
+
+            cache::hotClients.erase(it->second);
+            cache::hotClientsIndex.erase(it);
+        }
+
+        else
+            *it->second = client;
+    }
+}
+
+sClientView getVersionClient(const sClientsVersion& version, size_t position) {
+
+    const sClientPageDirectory& directory = *version.vDirectories[position / (mvcc::PAGE_RECORDS * mvcc::DIRECTORY_PAGES)];
+    const sClientPage& page = *directory.pages[(position / mvcc::PAGE_RECORDS) % mvcc::DIRECTORY_PAGES];
+
+    return unpackClient(*version.pool, page.records[position % mvcc::PAGE_RECORDS]);
+}
+
+std::shared_ptr <const sClientsVersion> buildClientsVersion(sClientTable& table, uint64_t epoch) {
+
+    auto version = std::make_shared <sClientsVersion>();
+    auto positions = std::make_shared <std::unordered_map <std::string, size_t>>();
+
+    version->epoch = epoch;
+    version->count = table.vClients.size();
+
+    positions->reserve(table.vClients.size());
+
+    const size_t directoryRecords = mvcc::PAGE_RECORDS * mvcc::DIRECTORY_PAGES;
+
+    for (size_t first = 0; first < table.vClients.size(); first += directoryRecords) {
+
+        auto directory = std::make_shared <sClientPageDirectory>();
+
+        for (size_t pageFirst = first, i = 0; pageFirst < table.vClients.size() && i < mvcc::DIRECTORY_PAGES; pageFirst += mvcc::PAGE_RECORDS, i++) {
+
+            auto page = std::make_shared <sClientPage>();
+            size_t count = std::min(mvcc::PAGE_RECORDS, table.vClients.size() - pageFirst);
+
+            std::copy(table.vClients.begin() + pageFirst, table.vClients.begin() + pageFirst + count, page->records);
+
+            directory->pages[i] = page;
+        }
+
+        version->vDirectories.push_back(directory);
+    }
+
+    for (size_t position = 0; position < table.vClients.size(); position++)
+        (*positions)[std::string(unpackClient(table, table.vClients[position]).accountNum)] = position;
+
+    version->pool = std::make_shared <const std::string>(std::move(table.pool));
+    version->positions = positions;
+
+    return version;
+}
+
+// readers never lock: they pin whatever version is current and keep it alive for as long as they hold it
+std::shared_ptr <const sClientsVersion> getClientsSnapshot() {
+
+    revalidateClientCache();
+
+    std::shared_ptr <const sClientsVersion> snapshot = std::atomic_load(&mvcc::current);
+
+    if (snapshot)
+        return snapshot;
+
+    std::lock_guard <std::mutex> lock(mvcc::writeMutex);
+
+    snapshot = std::atomic_load(&mvcc::current);
+
+    if (!snapshot) {
+
+        sClientTable table = loadClientTable();
+
+        snapshot = buildClientsVersion(table, ++mvcc::lastEpoch);
+        std::atomic_store(&mvcc::current, snapshot);
+    }
+
+    return snapshot;
+}
+
+// a full rewrite of the list (add, update, remove) replaces the whole version
+void publishClientsVersion(const std::vector <sClient>& vClients) {
+
+    sClientTable table;
+
+    for (const sClient& client : vClients) {
+
+        if (client.isDeleted)
+            continue;
+
+        sClientView view;
+
+        view.accountNum = client.accountNum;
+        view.pincode = client.pincode;
+        view.name = client.name;
+        view.phoneNum = client.phoneNum;
+        view.balance = client.balance;
+
+        packClient(view, table);
+    }
+
+    std::lock_guard <std::mutex> lock(mvcc::writeMutex);
+
+    std::atomic_store(&mvcc::current, buildClientsVersion(table, ++mvcc::lastEpoch));
+}
+
+// copy-on-write: only the touched pages, their directories and the directory list are copied
+bool applyBalanceDeltas(const std::vector <std::pair <std::string, float>>& vDeltas) {
+
+    std::lock_guard <std::mutex> lock(mvcc::writeMutex);
+
+    std::shared_ptr <const sClientsVersion> base = std::atomic_load(&mvcc::current);
+
+    if (!base)
+        return false;
+
+    auto version = std::make_shared <sClientsVersion>(*base);
+
+    version->epoch = ++mvcc::lastEpoch;
+
+    std::unordered_map <size_t, std::shared_ptr <sClientPageDirectory>> copiedDirectories;
+    std::unordered_map <size_t, std::shared_ptr <sClientPage>> copiedPages;
+
+    for (const std::pair <std::string, float>& delta : vDeltas) {
+
+        auto it = version->positions->find(delta.first);
+
+        if (it == version->positions->end())
+            return false;
+
+        size_t directoryIndex = it->second / (mvcc::PAGE_RECORDS * mvcc::DIRECTORY_PAGES);
+        size_t pageIndex = it->second / mvcc::PAGE_RECORDS;
+
+        std::shared_ptr <sClientPageDirectory>& directory = copiedDirectories[directoryIndex];
+
+        if (!directory) {
+
+            directory = std::make_shared <sClientPageDirectory>(*version->vDirectories[directoryIndex]);
+            version->vDirectories[directoryIndex] = directory;
+        }
+
+        std::shared_ptr <sClientPage>& page = copiedPages[pageIndex];
+
+        if (!page) {
+
+            page = std::make_shared <sClientPage>(*directory->pages[pageIndex % mvcc::DIRECTORY_PAGES]);
+            directory->pages[pageIndex % mvcc::DIRECTORY_PAGES] = page;
+        }
+
+        page->records[it->second % mvcc::PAGE_RECORDS].balance += delta.second;
+    }
+
+    std::atomic_store(&mvcc::current, std::shared_ptr <const sClientsVersion>(version));
+
+    return true;
+}
+
+int getBalanceBucket(float balance) {
+
+    int bucket = 0;
+
+    while (bucket < analytics::NUM_OF_BUCKETS - 1 && balance >= analytics::BUCKET_BOUNDS[bucket])
+        bucket++;
+
+    return bucket;
+}
+
+// per-thread partial results (count, sum, min/max, histogram, top-N heap) merged at the end; percentiles come from a parallel-filled column
+sBalanceAnalytics computeBalanceAnalytics(const std::vector <std::pair <const sPackedClient*, size_t>>& vSpans, int topN, int numOfThreads) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector <size_t> vColumnOffsets(vSpans.size() + 1, 0);
+
+    for (size_t i = 0; i < vSpans.size(); i++)
+        vColumnOffsets[i + 1] = vColumnOffsets[i] + vSpans[i].second;
+
+    std::vector <float> vColumn(vColumnOffsets.back());
+    std::vector <sBalanceAnalytics> vPartials(numOfThreads);
+    std::vector <std::thread> vThreads;
+
+    typedef std::pair <float, const sPackedClient*> tTopEntry;
+
+    std::vector <std::vector <tTopEntry>> vPartialTops(numOfThreads);
+
+    for (int t = 0; t < numOfThreads; t++) {
+
+        vThreads.emplace_back([&, t]() {
+
+            sBalanceAnalytics& partial = vPartials[t];
+            std::priority_queue <tTopEntry, std::vector <tTopEntry>, std::greater <tTopEntry>> topHeap;
+
+            size_t firstSpan = vSpans.size() * t / numOfThreads;
+            size_t lastSpan = vSpans.size() * (t + 1) / numOfThreads;
+
+            for (size_t span = firstSpan; span < lastSpan; span++) {
+
+                const sPackedClient* records = vSpans[span].first;
+                float* column = vColumn.data() + vColumnOffsets[span];
+
+                for (size_t i = 0; i < vSpans[span].second; i++) {
+
+                    if (records[i].pincodeAndFlags & packed::IS_DELETED)
+                        continue;
+
+                    float balance = records[i].balance;
+
+                    column[i] = balance;
+                    partial.count++;
+                    partial.total += balance;
+                    partial.minBalance = std::min(partial.minBalance, balance);
+                    partial.maxBalance = std::max(partial.maxBalance, balance);
+                    partial.histogram[getBalanceBucket(balance)]++;
+
+                    if ((int)topHeap.size() < topN)
+                        topHeap.push({ balance, &records[i] });
+
+                    else if (topN > 0 && balance > topHeap.top().first) {
+
+                        topHeap.pop();
+                        topHeap.push({ balance, &records[i] });
+                    }
+                }
+            }
+
+            while (!topHeap.empty()) {
+
+                vPartialTops[t].push_back(topHeap.top());
+                topHeap.pop();
+            }
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    sBalanceAnalytics result;
+    std::vector <tTopEntry> vTop;
+
+    for (int t = 0; t < numOfThreads; t++) {
+
+        result.count += vPartials[t].count;
+        result.total += vPartials[t].total;
+        result.minBalance = std::min(result.minBalance, vPartials[t].minBalance);
+        result.maxBalance = std::max(result.maxBalance, vPartials[t].maxBalance);
+
+        for (int bucket = 0; bucket < analytics::NUM_OF_BUCKETS; bucket++)
+            result.histogram[bucket] += vPartials[t].histogram[bucket];
+
+        vTop.insert(vTop.end(), vPartialTops[t].begin(), vPartialTops[t].end());
+    }
+
+    std::sort(vTop.begin(), vTop.end(), std::greater <tTopEntry>());
+
+    if ((int)vTop.size() > topN)
+        vTop.resize(topN);
+
+    for (const tTopEntry& entry : vTop)
+        result.vTop.push_back(entry.second);
+
+    // deleted records left holes in the column; they are rare, so they are squeezed out before selecting
+    if (result.count != vColumn.size()) {
+
+        vColumn.clear();
+
+        for (const std::pair <const sPackedClient*, size_t>& span : vSpans) {
+
+            for (size_t i = 0; i < span.second; i++) {
+
+                if (!(span.first[i].pincodeAndFlags & packed::IS_DELETED))
+                    vColumn.push_back(span.first[i].balance);
+            }
+        }
+    }
+
+    // exact percentiles, each selection only searches the part above the previous one
+    auto from = vColumn.begin();
+
+    for (int p = 0; p < analytics::NUM_OF_PERCENTILES && !vColumn.empty(); p++) {
+
+        auto nth = vColumn.begin() + std::min(vColumn.size() - 1, (size_t)(analytics::PERCENTILES[p] / 100.0 * vColumn.size()));
+
+        std::nth_element(from, nth, vColumn.end());
+
+        result.percentiles[p] = *nth;
+        from = nth;
+    }
+
+    result.seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+void printBalanceAnalytics(const sBalanceAnalytics& analytics, const std::string& pool) {
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    std::cout << "\nAccounts: " << analytics.count << ", Total: $" << analytics.total;
+    std::cout << ", Mean: $" << (analytics.count ? analytics.total / analytics.count : 0) << '\n';
+
+    if (analytics.count == 0) {
+
+        std::cout << std::defaultfloat << std::setprecision(6);
+        return;
+    }
+
+    std::cout << "Min: $" << analytics.minBalance << ", Max: $" << analytics.maxBalance << "\n\n";
+
+    std::cout << "Percentiles\n";
+
+    for (int p = 0; p < analytics::NUM_OF_PERCENTILES; p++)
+        std::cout << "| " << std::left << std::setw(7) << analytics::PERCENTILE_LABELS[p] << std::right << "| $" << analytics.percentiles[p] << '\n';
+
+    std::cout << "\nBalance Distribution\n";
+
+    uint64_t largestBucket = *std::max_element(analytics.histogram, analytics::NUM_OF_BUCKETS + analytics.histogram);
+
+    for (int bucket = 0; bucket < analytics::NUM_OF_BUCKETS; bucket++) {
+
+        std::string label = (bucket == 0) ? "< 0" : (bucket == analytics::NUM_OF_BUCKETS - 1)
+            ? ">= " + std::to_string((long long)analytics::BUCKET_BOUNDS[bucket - 1])
+            : std::to_string((long long)analytics::BUCKET_BOUNDS[bucket - 1]) + " - " + std::to_string((long long)analytics::BUCKET_BOUNDS[bucket]);
+
+        int barLength = largestBucket ? (int)(40 * analytics.histogram[bucket] / largestBucket) : 0;
+
+        std::cout << "| " << std::left << std::setw(22) << label << std::right << "| " << std::setw(10) << analytics.histogram[bucket];
+        std::cout << " " << std::string(barLength, '#') << '\n';
+    }
+
+    std::cout << "\nTop " << analytics.vTop.size() << " Accounts By Balance\n";
+
+    for (size_t i = 0; i < analytics.vTop.size(); i++) {
+
+        sClientView client = unpackClient(pool, *analytics.vTop[i]);
+
+        std::cout << "| " << std::setw(4) << i + 1 << " | " << std::left << std::setw(17) << client.accountNum;
+        std::cout << "| " << std::setw(30) << client.name << std::right << "| $" << client.balance << '\n';
+    }
+
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+std::vector <std::pair <const sPackedClient*, size_t>> getVersionSpans(const sClientsVersion& version) {
+
+    std::vector <std::pair <const sPackedClient*, size_t>> vSpans;
+
+    for (size_t first = 0; first < version.count; first += mvcc::PAGE_RECORDS) {
+
+        const sClientPageDirectory& directory = *version.vDirectories[first / (mvcc::PAGE_RECORDS * mvcc::DIRECTORY_PAGES)];
+        const sClientPage& page = *directory.pages[(first / mvcc::PAGE_RECORDS) % mvcc::DIRECTORY_PAGES];
+
+        vSpans.push_back({ page.records, std::min(mvcc::PAGE_RECORDS, version.count - first) });
+    }
+
+    return vSpans;
+}
+
+// CLIENTS.idx lets the ATM read a single client line: account number -> (line offset, line length)
+std::string buildClientsIndexContent(const std::string& clientsContent) {
+
+    std::vector <sIndexSlot> vEntries;
+
+    vEntries.reserve(std::count(clientsContent.begin(), clientsContent.end(), '\n') + 2);
+    vEntries.push_back(makeIndexSlot(file::CLIENTS_INDEX_SIZE_KEY, clientsContent.size(), 0));
+
+    for (size_t offset = 0; offset < clientsContent.size();) {
+
+        size_t end = clientsContent.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = clientsContent.size();
+
+        size_t keyEnd = clientsContent.find(SEPARATOR, offset);
+
+        if (keyEnd < end)
+            vEntries.push_back(makeIndexSlot(std::string_view(clientsContent).substr(offset, keyEnd - offset), offset, end - offset));
+
+        offset = end + 1;
+    }
+
+    sIndexHeader header;
+
+    header.capacity = 1024;
+
+    while (vEntries.size() * 10 > header.capacity * 7)
+        header.capacity *= 2;
+
+    header.count = vEntries.size();
+
+    std::vector <sIndexSlot> vSlots(header.capacity);
+
+    for (const sIndexSlot& entry : vEntries) {
+
+        uint64_t position = entry.keyHash % header.capacity;
+
+        while (vSlots[position].keyHash != 0)
+            position = (position + 1) % header.capacity;
+
+        vSlots[position] = entry;
+    }
+
+    std::string content((const char*)&header, sizeof(header));
+    content.append((const char*)vSlots.data(), vSlots.size() * sizeof(sIndexSlot));
+
+    return content;
+}
+
+void saveClientsToFile(const std::vector <sClient> vClients) {
+
+    std::string content = clientsToFileContent(vClients);
+
+    refreshCachedClients(vClients);
+    cache::isOwnClientsWrite = true;
+
+    if (std::atomic_load(&mvcc::current))
+        publishClientsVersion(vClients);
+
+    // the writer rebuilds the index of every shard it rewrites
+    submitToFile(file::CLIENTS_FILE, content);
+}
+
+void saveUsersToFile(const std::vector <sUser> vUsers) {
+
+    submitToFile(file::USERS_FILE, usersToFileContent(vUsers));
+
+    buildUsersIndex(vUsers);
+}
+
+std::vector <sUser> loadUsersFromFile() {
+
+    std::istringstream file(readFileContent(file::USERS_FILE));
+
+    std::vector <sUser> vUsers;
+
+    std::string line;
+
+    while (std::getline(file, line)) {
+
+        sUser user;
+
+        if (userLineToRecord(line, user))
+            vUsers.push_back(user);
+    }
+
+    return vUsers;
+}
+
+void buildUsersIndex(const std::vector <sUser>& vUsers) {
+
+    cache::usersIndex.clear();
+    cache::usersIndex.reserve(vUsers.size());
+
+    for (const sUser& user : vUsers) {
+
+        if (user.isDeleted == false)
+            cache::usersIndex[user.name] = user;
+    }
+}
+
+void loadUsersIndex() {
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    bool hasLegacyPasswords = false;
+
+    std::fstream file;
+
+    file.open(file::USERS_FILE, std::ios::in);
+
+    if (file.is_open()) {
+
+        std::string line;
+
+        while (std::getline(file, line) && !hasLegacyPasswords)
+            hasLegacyPasswords = (splitText(line, SEPARATOR).size() == 3);
+
+        file.close();
+    }
+
+    // rewriting the file replaces plaintext passwords with the salted hashes generated on load
+    if (hasLegacyPasswords)
+        saveUsersToFile(vUsers);
+
+    else
+        buildUsersIndex(vUsers);
+}
+
+// a malformed or empty value leaves the setting at its default, a valid one is clamped to [low, high]
+bool parseSetting(const std::string& text, int& setting, int low, int high) {
+
+    int value = 0;
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size())
+        return false;
+
+    setting = std::clamp(value, low, high);
+
+    return true;
+}
+
+bool parseSetting(const std::string& text, float& setting, float low, float high) {
+
+    float value = 0.0f;
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size() || !std::isfinite(value))
+        return false;
+
+    setting = std::clamp(value, low, high);
+
+    return true;
+}
+
+void loadSettingsFromFile() {
+
+    std::fstream file;
+
+    file.open(file::SETTINGS_FILE, std::ios::in);
+
+    if (file.is_open()) {
+
+        std::string line;
+
+        while (std::getline(file, line)) {
+
+            std::vector <std::string> vSetting = splitText(line, SEPARATOR);
+
+            if (vSetting.size() != 2)
+                continue;
+
+            if (vSetting[0] == "groupCommitMaxBatch")
+                parseSetting(vSetting[1], settings::groupCommitMaxBatch, 1, 4096);
+
+            else if (vSetting[0] == "groupCommitMaxWaitMs")
+                parseSetting(vSetting[1], settings::groupCommitMaxWaitMs, 0, 1000);
+
+            else if (vSetting[0] == "persistenceMaxQueue")
+                parseSetting(vSetting[1], settings::persistenceMaxQueue, 1, 1000000);
+
+            else if (vSetting[0] == "maintenanceFee")
+                parseSetting(vSetting[1], settings::maintenanceFee, 0.0f, 1000.0f);
+
+            else if (vSetting[0] == "feeWaiverBalance")
+                parseSetting(vSetting[1], settings::feeWaiverBalance, 0.0f, 1.0e9f);
+
+            // accrualTiers /##/ 0:0.0005,10000:0.001,100000:0.0015
+            // malformed tiers are skipped, and the defaults stay when none of them parses
+            else if (vSetting[0] == "accrualTiers") {
+
+                std::vector <std::pair <float, float>> vTiers;
+
+                for (const std::string& tier : splitText(vSetting[1], ",")) {
+
+                    std::vector <std::string> vTier = splitText(tier, ":");
+                    std::pair <float, float> parsedTier;
+
+                    if (vTier.size() == 2 && parseSetting(vTier[0], parsedTier.first, 0.0f, 1.0e9f)
+                        && parseSetting(vTier[1], parsedTier.second, 0.0f, 1.0f))
+                        vTiers.push_back(parsedTier);
+                }
+
+                if (!vTiers.empty()) {
+
+                    std::sort(vTiers.begin(), vTiers.end());
+                    settings::accrualTiers = vTiers;
+                }
+            }
+        }
+
+        file.close();
+    }
+}
+
+void applyCommitBatch(std::vector <sCommitRequest>& vBatch) {
+
+    // per file: the last full rewrite wins, appends after it are kept in order
+    std::vector <std::string> vFileNames;
+    std::unordered_map <std::string, std::pair <bool, std::string>> pendingWrites;
+
+    for (sCommitRequest& request : vBatch) {
+
+        if (request.makeContent)
+            request.content = request.makeContent();
+
+        auto it = pendingWrites.find(request.fileName);
+
+        if (it == pendingWrites.end()) {
+
+            vFileNames.push_back(request.fileName);
+            it = pendingWrites.emplace(request.fileName, std::make_pair(true, std::string())).first;
+        }
+
+        if (request.isAppend)
+            it->second.second += request.content;
+
+        else
+            it->second = std::make_pair(false, request.content);
+    }
+
+    std::unordered_map <std::string, bool> results;
+
+    for (const std::string& fileName : vFileNames) {
+
+        const std::pair <bool, std::string>& write = pendingWrites[fileName];
+
+        // CLIENTS.txt is split over its shards, each written with its index
+        if (fileName == file::CLIENTS_FILE)
+            results[fileName] = writeClientShards(write.second, write.first);
+
+        else if (findClientsIndexShard(fileName) != -1)
+            results[fileName] = writeClientsIndex(findClientsIndexShard(fileName), write.second);
+
+        else
+            results[fileName] = writeFileDurably(fileName, write.second, write.first);
+    }
+
+    int failedWrites = 0;
+
+    for (const std::string& fileName : vFileNames) {
+
+        if (!results[fileName])
+            failedWrites++;
+    }
+
+    for (sCommitRequest& request : vBatch)
+        request.done.set_value(results[request.fileName]);
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        persistence::completedSequence = vBatch.back().sequence;
+        persistence::failedWrites += failedWrites;
+
+        sGroupCommitStats& stats = persistence::stats;
+
+        int batchSize = vBatch.size();
+        int bucket = 0;
+
+        while (bucket < 7 && (2 << bucket) <= batchSize)
+            bucket++;
+
+        stats.batches++;
+        stats.requests += batchSize;
+        stats.fsyncs += vFileNames.size();
+        stats.maxBatchSize = std::max(stats.maxBatchSize, batchSize);
+        stats.batchSizeBuckets[bucket]++;
+    }
+}
+
+void groupCommitWriter() {
+
+    std::unique_lock <std::mutex> lock(persistence::queueMutex);
+
+    while (true) {
+
+        persistence::queueReady.wait(lock, [] {
+
+            return persistence::isStopping || !persistence::queue.empty() || !persistence::clientMutations.empty();
+        });
+
+        if (persistence::queue.empty() && persistence::clientMutations.empty())
+            return;
+
+        // hold the batch open for the wait window unless it is already full
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(settings::groupCommitMaxWaitMs);
+
+        persistence::queueReady.wait_until(lock, deadline, [] {
+
+            return persistence::isStopping || (int)persistence::queue.size() >= settings::groupCommitMaxBatch;
+        });
+
+        // the batch stops at the oldest mutation group: requests submitted after it are written after it
+        auto isBeforeMutations = [] {
+
+            return persistence::clientMutations.empty() || persistence::queue.front().sequence <= persistence::clientMutations.front().afterSequence;
+        };
+
+        while (!persistence::queue.empty() && (int)persistence::inflight.size() < settings::groupCommitMaxBatch && isBeforeMutations()) {
+
+            persistence::inflight.push_back(std::move(persistence::queue.front()));
+            persistence::queue.pop_front();
+        }
+
+        // a group waits until every request queued before it is written, so an older rewrite or append can't undo it
+        bool hasMutations = !persistence::clientMutations.empty() && (persistence::queue.empty() || !isBeforeMutations());
+
+        if (hasMutations) {
+
+            persistence::inflightMutations.swap(persistence::clientMutations.front().mutations);
+            persistence::numOfQueuedMutations -= persistence::inflightMutations.size();
+            persistence::clientMutations.pop_front();
+        }
+
+        lock.unlock();
+
+        {
+            std::lock_guard <std::mutex> diskLock(persistence::diskMutex);
+
+            if (!persistence::inflight.empty())
+                applyCommitBatch(persistence::inflight);
+
+            if (hasMutations)
+                applyClientMutations(persistence::inflightMutations);
+
+            lock.lock();
+            persistence::inflight.clear();
+            persistence::inflightMutations.clear();
+        }
+
+        persistence::writesDone.notify_all();
+    }
+}
+
+std::future <bool> submitToFile(const std::string& fileName, const std::string& content, bool isAppend) {
+
+    std::future <bool> isDurable;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        if (!persistence::writer.joinable())
+            persistence::writer = std::thread(groupCommitWriter);
+
+        sCommitRequest request;
+
+        request.fileName = fileName;
+        request.content = content;
+        request.isAppend = isAppend;
+        request.sequence = ++persistence::submittedSequence;
+
+        isDurable = request.done.get_future();
+        persistence::queue.push_back(std::move(request));
+    }
+
+    persistence::queueReady.notify_all();
+
+    return isDurable;
+}
+
+// a full rewrite whose content is only produced when the writer gets to it
+std::future <bool> submitDeferredToFile(const std::string& fileName, std::function <std::string()> makeContent) {
+
+    std::future <bool> isDurable;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        if (!persistence::writer.joinable())
+            persistence::writer = std::thread(groupCommitWriter);
+
+        sCommitRequest request;
+
+        request.fileName = fileName;
+        request.makeContent = std::move(makeContent);
+        request.sequence = ++persistence::submittedSequence;
+
+        isDurable = request.done.get_future();
+        persistence::queue.push_back(std::move(request));
+    }
+
+    persistence::queueReady.notify_all();
+
+    return isDurable;
+}
+
+bool commitToFile(const std::string& fileName, const std::string& content, bool isAppend) {
+
+    // the caller is acknowledged only once its batch has been fsynced
+    return submitToFile(fileName, content, isAppend).get();
+}
+
+bool flushPersistence() {
+
+    std::unique_lock <std::mutex> lock(persistence::queueMutex);
+
+    long long target = persistence::submittedSequence;
+    int failedWritesBefore = persistence::reportedFailedWrites;
+
+    persistence::writesDone.wait(lock, [target] { return persistence::completedSequence >= target && !hasPendingMutations(); });
+
+    return persistence::failedWrites == failedWritesBefore;
+}
+
+void submitClientMutation(const sClient& client, bool isBalanceOnly, float balanceDelta) {
+
+    submitClientMutations({ { client, isBalanceOnly, balanceDelta } });
+}
+
+// single producer: the session thread records the new state of its clients and returns, the writer rewrites the file later;
+// mutations submitted together are swapped out in the same batch, so they reach the file together
+void submitClientMutations(const std::vector <sClientMutation>& vMutations) {
+
+    {
+        std::unique_lock <std::mutex> lock(persistence::queueMutex);
+
+        if (!persistence::writer.joinable())
+            persistence::writer = std::thread(groupCommitWriter);
+
+        // backpressure: a session that outruns the disk waits here instead of growing the queue without bound
+        persistence::writesDone.wait(lock, [] {
+
+            return (int)(persistence::queue.size() + persistence::numOfQueuedMutations) < settings::persistenceMaxQueue;
+        });
+
+        if (persistence::clientMutations.empty() || persistence::clientMutations.back().afterSequence != persistence::submittedSequence) {
+
+            persistence::clientMutations.emplace_back();
+            persistence::clientMutations.back().afterSequence = persistence::submittedSequence;
+        }
+
+        std::unordered_map <std::string, sClientMutation>& mutations = persistence::clientMutations.back().mutations;
+
+        for (const sClientMutation& newMutation : vMutations) {
+
+            // repeated changes to the same client within a group collapse into its latest state, balance deltas add up
+            auto inserted = mutations.try_emplace(newMutation.client.accountNum);
+            sClientMutation& mutation = inserted.first->second;
+
+            if (inserted.second || !newMutation.isBalanceOnly)
+                mutation.isBalanceOnly = newMutation.isBalanceOnly;
+
+            mutation.client = newMutation.client;
+            mutation.balanceDelta = (inserted.second ? 0 : mutation.balanceDelta) + newMutation.balanceDelta;
+
+            persistence::stats.mutations++;
+
+            if (inserted.second)
+                persistence::numOfQueuedMutations++;
+
+            else
+                persistence::stats.coalescedMutations++;
+        }
+    }
+
+    persistence::queueReady.notify_all();
+
+    cache::isOwnClientsWrite = true;
+
+    for (const sClientMutation& mutation : vMutations) {
+
+        if (!mutation.client.isDeleted) {
+
+            cacheClient(mutation.client);
+            continue;
+        }
+
+        auto it = cache::hotClientsIndex.find(mutation.client.accountNum);
+
+        if (it != cache::hotClientsIndex.end()) {
+
+            cache::hotClients.erase(it->second);
+            cache::hotClientsIndex.erase(it);
+        }
+    }
+}
+
+bool findPendingMutation(const std::string& accountNum, sClient& client) {
+
+    // caller holds queueMutex; later groups are newer, and every queued group is newer than the one being written
+    for (auto group = persistence::clientMutations.rbegin(); group != persistence::clientMutations.rend(); group++) {
+
+        auto it = group->mutations.find(accountNum);
+
+        if (it != group->mutations.end()) {
+
+            client = it->second.client;
+            return true;
+        }
+    }
+
+    auto it = persistence::inflightMutations.find(accountNum);
+
+    if (it == persistence::inflightMutations.end())
+        return false;
+
+    client = it->second.client;
+    return true;
+}
+
+bool hasPendingMutations() {
+
+    // caller holds queueMutex
+    return !persistence::clientMutations.empty() || !persistence::inflightMutations.empty();
+}
+
+// full-list readers wait for the queued mutations to reach the file
+void waitForClientMutations() {
+
+    std::unique_lock <std::mutex> lock(persistence::queueMutex);
+
+    persistence::writesDone.wait(lock, [] { return !hasPendingMutations(); });
+}
+
+// writer side, with diskMutex held: balance-only batches touch BALANCES.idx, anything else rewrites the shards of the changed clients
+void applyClientMutations(const std::unordered_map <std::string, sClientMutation>& mutations) {
+
+    bool isBalanceOnly = std::all_of(mutations.begin(), mutations.end(), [](const auto& entry) { return entry.second.isBalanceOnly; });
+
+    if (isBalanceOnly) {
+
+        applyBalanceMutations(mutations);
+        return;
+    }
+
+    std::vector <std::unordered_map <std::string, sClientMutation>> vShardMutations(shards::count);
+
+    for (const auto& entry : mutations)
+        vShardMutations[getClientShard(entry.first)].insert(entry);
+
+    std::vector <size_t> vApplied(shards::count, 0);
+    std::vector <int> vFailed(shards::count, 0);
+    std::vector <std::thread> vThreads;
+
+    // the untouched shards aren't read or written, the touched ones are rewritten in parallel
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        if (!vShardMutations[shardIndex].empty())
+            vThreads.emplace_back([&, shardIndex]() { vFailed[shardIndex] = applyShardMutations(shardIndex, vShardMutations[shardIndex], vApplied[shardIndex]); });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+    persistence::failedWrites += std::accumulate(vFailed.begin(), vFailed.end(), 0);
+    persistence::stats.mutationBatches++;
+    persistence::stats.fsyncs += 2 * vThreads.size();
+    persistence::stats.droppedMutations += mutations.size() - std::accumulate(vApplied.begin(), vApplied.end(), (size_t)0);
+}
+
+// one pass over the shard applies every mutation of the batch that belongs to it; returns the failed writes
+int applyShardMutations(int shardIndex, const std::unordered_map <std::string, sClientMutation>& mutations, size_t& numOfApplied) {
+
+    std::lock_guard <std::mutex> shardLock(shards::mutexes[shardIndex]);
+
+    // no ATM sync can land a balance between the read of the hot table and its reset
+    sFileLock balancesLock(getShardFileName(file::HOT_BALANCES_LOCK_FILE, shardIndex));
+
+    std::string content = readDiskContent(getShardFileName(file::CLIENTS_FILE, shardIndex));
+    std::vector <sIndexSlot> vHotSlots = loadHotBalances(shardIndex);
+    std::vector <sIndexSlot> vChangedSlots;
+    std::string newContent;
+
+    newContent.reserve(content.size() + mutations.size() * 64);
+
+    for (size_t offset = 0; offset < content.size();) {
+
+        size_t end = content.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = content.size();
+
+        size_t keyEnd = content.find(SEPARATOR, offset);
+        std::string_view accountNum = (keyEnd < end) ? std::string_view(content).substr(offset, keyEnd - offset) : std::string_view();
+
+        auto it = accountNum.empty() ? mutations.end() : mutations.find(std::string(accountNum));
+
+        sClient client;
+        float hotBalance;
+
+        // the hot file is emptied after this write, so its balances are folded into the lines they belong to
+        bool isHot = !accountNum.empty() && findHotBalance(vHotSlots, accountNum, hotBalance);
+
+        if (it == mutations.end()) {
+
+            if (isHot && parseClientLine(std::string_view(content).substr(offset, end - offset), client)) {
+
+                client.balance = hotBalance;
+                newContent += clientRecordToLine(client) + '\n';
+            }
+
+            else
+                newContent.append(content, offset, end - offset + 1);
+        }
+
+        else if (it->second.isBalanceOnly) {
+
+            // the delta goes on top of whatever the files hold now, so an ATM withdrawal in between isn't lost;
+            // a corrupt line is replaced by the session's copy of the client, the best state left
+            if (parseClientLine(std::string_view(content).substr(offset, end - offset), client))
+                client.balance = (isHot ? hotBalance : client.balance) + it->second.balanceDelta;
+            else
+                client = it->second.client;
+
+            newContent += clientRecordToLine(client) + '\n';
+            vChangedSlots.push_back(makeBalanceSlot(client.accountNum, client.balance));
+            numOfApplied++;
+        }
+
+        else {
+
+            if (!it->second.client.isDeleted) {
+
+                bool isParsed = parseClientLine(std::string_view(content).substr(offset, end - offset), client);
+
+                if (!isParsed || (isHot ? hotBalance : client.balance) != it->second.client.balance)
+                    vChangedSlots.push_back(makeBalanceSlot(it->first, it->second.client.balance));
+
+                newContent += clientRecordToLine(it->second.client) + '\n';
+            }
+
+            numOfApplied++;
+        }
+
+        offset = end + 1;
+    }
+
+    if (!newContent.empty() && newContent.back() != '\n')
+        newContent += '\n';
+
+    // the mutated lines now carry checksums, the untouched legacy ones have to get theirs too
+    if (!isChecksummedContent(content))
+        newContent = checksumLegacyLines(newContent);
+
+    // while the hot table exists it overrides the file, so it takes the changed balances first: a crash before the
+    // rename still shows all of them, one before the reset finds slots that agree with the file
+    if (!vHotSlots.empty() && !writeHotBalances(shardIndex, vChangedSlots))
+        return 1;
+
+    // the index and the data are both rewritten, the shard's hot balances are folded in and reset
+    return writeClientShard(shardIndex, newContent, false) ? 0 : 1;
+}
+
+// writer side: the line CLIENTS.txt holds for the account now, through the shard's CLIENTS.idx or one read of the shard per batch
+bool findStoredClientLine(const std::string& accountNum, std::vector <std::string>& vContents, std::string& line) {
+
+    int shardIndex = getClientShard(accountNum);
+    sIndexSlot slot;
+
+    if (readIndexSlot(getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex), accountNum, slot) && readClientLineAt(slot.first, slot.second, accountNum, line))
+        return true;
+
+    std::string& content = vContents[shardIndex];
+
+    if (content.empty())
+        content = readDiskContent(getShardFileName(file::CLIENTS_FILE, shardIndex));
+
+    size_t offset, length;
+
+    if (!findClientLineInContent(content, accountNum, offset, length))
+        return false;
+
+    line = content.substr(offset, length);
+    return true;
+}
+
+// deposits, withdrawals and transfers: one 64-byte slot per account and one fsync, CLIENTS.txt isn't rewritten
+void applyBalanceMutations(const std::unordered_map <std::string, sClientMutation>& mutations) {
+
+    std::vector <std::vector <const sClientMutation*>> vShardMutations(shards::count);
+    std::vector <std::string> vContents(shards::count);
+
+    for (const auto& entry : mutations)
+        vShardMutations[getClientShard(entry.first)].push_back(&entry.second);
+
+    size_t numOfApplied = 0;
+    int failedWrites = 0, numOfSyncs = 0;
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        if (vShardMutations[shardIndex].empty())
+            continue;
+
+        std::lock_guard <std::mutex> shardLock(shards::mutexes[shardIndex]);
+
+        // the stored balances are read and overwritten under the lock the ATM syncs take, so none of theirs slips in between
+        sFileLock balancesLock(getShardFileName(file::HOT_BALANCES_LOCK_FILE, shardIndex));
+        std::vector <sIndexSlot> vSlots;
+
+        for (const sClientMutation* mutation : vShardMutations[shardIndex]) {
+
+            const std::string& accountNum = mutation->client.accountNum;
+
+            sClient client;
+            std::string line;
+
+            // the delta goes on top of the latest stored balance, so an ATM withdrawal in between isn't lost
+            if (readHotBalance(accountNum, client.balance))
+                vSlots.push_back(makeBalanceSlot(accountNum, client.balance + mutation->balanceDelta));
+
+            else if (findStoredClientLine(accountNum, vContents, line)) {
+
+                // a corrupt line keeps its quarantined copy, the session's copy of the client supplies the balance
+                if (parseClientLine(line, client))
+                    vSlots.push_back(makeBalanceSlot(accountNum, client.balance + mutation->balanceDelta));
+                else
+                    vSlots.push_back(makeBalanceSlot(accountNum, mutation->client.balance));
+            }
+        }
+
+        if (!writeHotBalances(shardIndex, vSlots))
+            failedWrites++;
+
+        numOfApplied += vSlots.size();
+        numOfSyncs++;
+    }
+
+    std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+    persistence::failedWrites += failedWrites;
+    persistence::stats.mutationBatches++;
+    persistence::stats.fsyncs += numOfSyncs;
+    persistence::stats.droppedMutations += mutations.size() - numOfApplied;
+}
+
+void dropClientsVersion() {
+
+    // the next snapshot is built from the file again
+    std::lock_guard <std::mutex> lock(mvcc::writeMutex);
+    std::atomic_store(&mvcc::current, std::shared_ptr <const sClientsVersion>());
+}
+
+void startAuditWriter(const std::string& fileName) {
+
+    if (audit::writer.joinable())
+        return;
+
+    audit::fileName = fileName;
+    audit::isStopping = false;
+    audit::writer = std::thread(auditWriter);
+}
+
+// producer side: one fetch_add to claim a slot, a 64-byte copy and one release store, no lock and no syscall
+void emitAuditEvent(eAuditAction action, std::string_view subject, float amount, bool isChange) {
+
+    uint64_t position = audit::enqueuePosition.fetch_add(1, std::memory_order_relaxed);
+
+    sAuditSlot& slot = audit::slots[position % audit::QUEUE_CAPACITY];
+    uint64_t lap = position / audit::QUEUE_CAPACITY;
+
+    // only waits when the writer is a whole ring behind
+    if (slot.state.load(std::memory_order_acquire) != lap * 2) {
+
+        audit::fullWaits.fetch_add(1, std::memory_order_relaxed);
+
+        while (slot.state.load(std::memory_order_acquire) != lap * 2)
+            std::this_thread::yield();
+    }
+
+    sAuditEvent& event = slot.event;
+
+    event.sequence = position;
+    event.timestamp = std::chrono::duration_cast <std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    event.action = (uint16_t)action;
+    event.isChange = isChange;
+    event.amount = amount;
+
+    std::memcpy(event.username, audit::operatorName, sizeof(event.username));
+    std::memset(event.subject, 0, sizeof(event.subject));
+    std::memcpy(event.subject, subject.data(), std::min(subject.size(), sizeof(event.subject)));
+
+    slot.state.store(lap * 2 + 1, std::memory_order_release);
+}
+
+void setAuditOperator(const std::string& username) {
+
+    std::memset(audit::operatorName, 0, sizeof(audit::operatorName));
+    std::memcpy(audit::operatorName, username.data(), std::min(username.size(), sizeof(audit::operatorName)));
+}
+
+size_t drainAuditQueue(std::string& batch) {
+
+    size_t numOfEvents = 0;
+
+    while (numOfEvents < audit::MAX_BATCH) {
+
+        sAuditSlot& slot = audit::slots[audit::dequeuePosition % audit::QUEUE_CAPACITY];
+        uint64_t lap = audit::dequeuePosition / audit::QUEUE_CAPACITY;
+
+        if (slot.state.load(std::memory_order_acquire) != lap * 2 + 1)
+            break;
+
+        batch.append((const char*)&slot.event, sizeof(sAuditEvent));
+
+        // hands the slot to the producer one lap ahead
+        slot.state.store((lap + 1) * 2, std::memory_order_release);
+
+        audit::dequeuePosition++;
+        numOfEvents++;
+    }
+
+    return numOfEvents;
+}
+
+void auditWriter() {
+
+    std::string batch;
+
+    batch.reserve(audit::MAX_BATCH * sizeof(sAuditEvent));
+
+    while (true) {
+
+        // read before draining, so a stop is only honoured once everything emitted before it is written
+        bool isStopping = audit::isStopping.load();
+
+        batch.clear();
+
+        if (drainAuditQueue(batch) > 0) {
+
+            if (!writeFileDurably(audit::fileName, batch, true))
+                audit::failedWrites++;
+
+            audit::writtenPosition.store(audit::dequeuePosition, std::memory_order_release);
+            continue;
+        }
+
+        if (isStopping)
+            return;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(audit::FLUSH_INTERVAL_MS));
+    }
+}
+
+// waits until every event emitted so far is on disk
+void flushAuditLog() {
+
+    if (!audit::writer.joinable())
+        return;
+
+    uint64_t target = audit::enqueuePosition.load();
+
+    while (audit::writtenPosition.load(std::memory_order_acquire) < target)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void printAuditLog(size_t count) {
+
+    const std::string actions[21] = { "?", "Login", "Logout", "Add Client", "Show All Clients", "Update Client", "Remove Client",
+        "Find Client", "Transactions", "Manage Users", "Deposit", "Withdraw", "Transfer", "Show All Balances", "Mini Statement",
+        "Analytics Report", "Add User", "List Users", "Update User", "Remove User", "Find User" };
+
+    std::string content = readFileContent(file::AUDIT_FILE);
+
+    size_t numOfEvents = content.size() / sizeof(sAuditEvent);
+    size_t first = numOfEvents - std::min(count, numOfEvents);
+
+    std::cout << "\nAudit Log [" << file::AUDIT_FILE << "] last " << numOfEvents - first << " of " << numOfEvents << " event(s)\n\n";
+    std::cout << std::left;
+    std::cout << "| " << std::setw(10) << "Sequence" << "| " << std::setw(20) << "Time" << "| " << std::setw(16) << "User";
+    std::cout << "| " << std::setw(18) << "Action" << "| " << std::setw(8) << "Kind" << "| " << std::setw(24) << "Subject" << "| Amount\n";
+
+    for (size_t i = first; i < numOfEvents; i++) {
+
+        sAuditEvent event;
+        std::memcpy(&event, content.data() + i * sizeof(sAuditEvent), sizeof(sAuditEvent));
+
+        std::tm localDate = toLocalTime(event.timestamp / 1000000000);
+
+        std::ostringstream date;
+        date << std::put_time(&localDate, "%Y-%m-%d %H:%M:%S");
+
+        std::cout << "| " << std::setw(10) << event.sequence << "| " << std::setw(20) << date.str();
+        std::cout << "| " << std::setw(16) << std::string(event.username, strnlen(event.username, sizeof(event.username)));
+        std::cout << "| " << std::setw(18) << actions[(event.action < 21) ? event.action : 0] << "| " << std::setw(8) << (event.isChange ? "Change" : "Screen");
+        std::cout << "| " << std::setw(24) << std::string(event.subject, strnlen(event.subject, sizeof(event.subject)));
+        std::cout << "| " << event.amount << '\n';
+    }
+
+    std::cout << std::right;
+}
+
+void startTraceCapture(const std::string& fileName) {
+
+    trace::fileName = fileName;
+}
+
+void beginTraceOperation(eTraceMenu menu, int choice) {
+
+    if (trace::fileName.empty())
+        return;
+
+    trace::current = sTraceRecord();
+
+    trace::current.timestamp = std::chrono::duration_cast <std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    trace::current.menu = (uint16_t)menu;
+    trace::current.choice = (uint16_t)choice;
+
+    if (getTraceOperationName(trace::current).empty())
+        trace::current.menu = TRACE_NONE;
+}
+
+void setTraceSubject(const std::string& accountNum, float amount, const std::string& otherAccountNum) {
+
+    if (trace::current.menu == TRACE_NONE)
+        return;
+
+    std::memset(trace::current.accountNum, 0, sizeof(trace::current.accountNum));
+    std::memcpy(trace::current.accountNum, accountNum.data(), std::min(accountNum.size(), sizeof(trace::current.accountNum)));
+
+    std::memset(trace::current.otherAccountNum, 0, sizeof(trace::current.otherAccountNum));
+    std::memcpy(trace::current.otherAccountNum, otherAccountNum.data(), std::min(otherAccountNum.size(), sizeof(trace::current.otherAccountNum)));
+
+    trace::current.amount = amount;
+}
+
+// appended by the persistence thread, the session never waits on the trace
+void endTraceOperation() {
+
+    if (trace::current.menu == TRACE_NONE)
+        return;
+
+    submitToFile(trace::fileName, std::string((const char*)&trace::current, sizeof(sTraceRecord)), true);
+
+    trace::current.menu = TRACE_NONE;
+}
+
+std::vector <sTraceRecord> loadTraceFile(const std::string& fileName) {
+
+    std::string content = readFileContent(fileName);
+    std::vector <sTraceRecord> vRecords(content.size() / sizeof(sTraceRecord));
+
+    if (!vRecords.empty())
+        std::memcpy(vRecords.data(), content.data(), vRecords.size() * sizeof(sTraceRecord));
+
+    return vRecords;
+}
+
+std::string getTraceOperationName(const sTraceRecord& record) {
+
+    if (record.menu == TRACE_BANK_MAIN && record.choice < 9)
+        return trace::MAIN_MENU_OPERATIONS[record.choice];
+
+    if (record.menu == TRACE_BANK_TRANSACTIONS && record.choice < 8)
+        return trace::TRANSACTIONS_MENU_OPERATIONS[record.choice];
+
+    if (record.menu == TRACE_BANK_MANAGE_USERS && record.choice < 7)
+        return trace::MANAGE_USERS_MENU_OPERATIONS[record.choice];
+
+    return "";
+}
+
+bool readPendingContent(const std::string& fileName, std::string& content, bool& hasImage) {
+
+    // caller holds queueMutex; folds the not-yet-written requests for the file, oldest first
+    bool hasPending = false;
+
+    content.clear();
+    hasImage = false;
+
+    auto fold = [&](const sCommitRequest& request) {
+
+        if (request.fileName != fileName)
+            return;
+
+        hasPending = true;
+
+        if (request.isAppend)
+            content += request.content;
+
+        else {
+
+            content = request.content;
+            hasImage = true;
+        }
+    };
+
+    for (const sCommitRequest& request : persistence::inflight)
+        fold(request);
+
+    for (const sCommitRequest& request : persistence::queue)
+        fold(request);
+
+    return hasPending;
+}
+
+bool hasPendingImage(const std::string& fileName) {
+
+    // caller holds queueMutex; true when a whole new content for the file is still to be written
+    auto isImage = [&](const sCommitRequest& request) { return request.fileName == fileName && !request.isAppend; };
+
+    return std::any_of(persistence::inflight.begin(), persistence::inflight.end(), isImage)
+        || std::any_of(persistence::queue.begin(), persistence::queue.end(), isImage);
+}
+
+std::string readFileContent(const std::string& fileName) {
+
+    if (fileName == file::CLIENTS_FILE)
+        waitForClientMutations();
+
+    std::string pending;
+    bool hasImage;
+
+    // a queued full rewrite already is the newest content, no need to touch the disk
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+        if (readPendingContent(fileName, pending, hasImage) && hasImage)
+            return pending;
+    }
+
+    std::lock_guard <std::mutex> diskLock(persistence::diskMutex);
+    std::lock_guard <std::mutex> lock(persistence::queueMutex);
+
+    readPendingContent(fileName, pending, hasImage);
+
+    if (hasImage)
+        return pending;
+
+    return readDiskContent(fileName) + pending;
+}
+
+std::string readDiskContent(const std::string& fileName) {
+
+    // a sharded CLIENTS.txt is its shard files one after another
+    if (fileName == file::CLIENTS_FILE && shards::count > 1)
+        return readClientShards();
+
+    std::fstream file;
+    std::string content;
+
+    file.open(fileName, std::ios::in);
+
+    if (file.is_open()) {
+
+        // size the buffer once and read the file in a single call
+        file.seekg(0, std::ios::end);
+        content.resize((size_t)file.tellg());
+        file.seekg(0, std::ios::beg);
+
+        file.read(&content[0], content.size());
+        content.resize((size_t)file.gcount());
+
+        file.close();
+    }
+
+    return content;
+}
+
+bool isNumericAccountNum(std::string_view accountNum, std::string_view prefix) {
+
+    if (accountNum.size() <= prefix.size() || accountNum.size() - prefix.size() > 18 || accountNum.substr(0, prefix.size()) != prefix)
+        return false;
+
+    std::string_view digits = accountNum.substr(prefix.size());
+
+    // a leading zero wouldn't survive the round trip through an integer
+    if (digits.size() > 1 && digits[0] == '0')
+        return false;
+
+    return std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+std::string encodeAccountNumsColumn(const std::vector <sClientView>& vClients, bool isNumeric) {
+
+    std::string out;
+
+    out += (char)isNumeric;
+
+    if (isNumeric) {
+
+        // shared prefix once, then the deltas between consecutive sorted numbers
+        std::string_view prefix = vClients.empty() ? std::string_view() : vClients[0].accountNum;
+        prefix = prefix.substr(0, prefix.find_first_of("0123456789"));
+
+        appendBytes(out, prefix);
+
+        uint64_t previous = 0;
+
+        for (const sClientView& client : vClients) {
+
+            uint64_t number = std::stoull(std::string(client.accountNum.substr(prefix.size())));
+
+            appendVarint(out, number - previous);
+            previous = number;
+        }
+    }
+
+    else {
+
+        // front coding: length shared with the previous number, then the rest
+        std::string_view previous;
+
+        for (const sClientView& client : vClients) {
+
+            size_t shared = 0;
+
+            while (shared < previous.size() && shared < client.accountNum.size() && previous[shared] == client.accountNum[shared])
+                shared++;
+
+            appendVarint(out, shared);
+            appendBytes(out, client.accountNum.substr(shared));
+
+            previous = client.accountNum;
+        }
+    }
+
+    return out;
+}
+
+std::string encodePincodesColumn(const std::vector <sClientView>& vClients) {
+
+    std::string out;
+
+    for (const sClientView& client : vClients)
+        appendVarint(out, (uint32_t)client.pincode);
+
+    return out;
+}
+
+std::string encodeNamesColumn(const std::vector <sClientView>& vClients) {
+
+    // dictionary of words, then every name as a word count followed by word ids
+    std::unordered_map <std::string_view, uint32_t> wordIds;
+    std::vector <std::string_view> vWords;
+    std::string rows;
+
+    // when every name has the same number of words, the count is written once for the column
+    size_t fixedWordCount = vClients.empty() ? 0 : std::count(vClients[0].name.begin(), vClients[0].name.end(), ' ') + 1;
+
+    for (const sClientView& client : vClients) {
+
+        if ((size_t)std::count(client.name.begin(), client.name.end(), ' ') + 1 != fixedWordCount) {
+
+            fixedWordCount = 0;
+            break;
+        }
+    }
+
+    for (const sClientView& client : vClients) {
+
+        std::vector <uint32_t> vIds;
+        std::string_view name = client.name;
+
+        while (true) {
+
+            size_t spacePos = name.find(' ');
+            std::string_view word = name.substr(0, spacePos);
+
+            auto it = wordIds.find(word);
+
+            if (it == wordIds.end()) {
+
+                it = wordIds.emplace(word, (uint32_t)vWords.size()).first;
+                vWords.push_back(word);
+            }
+
+            vIds.push_back(it->second);
+
+            if (spacePos == std::string_view::npos)
+                break;
+
+            name.remove_prefix(spacePos + 1);
+        }
+
+        if (fixedWordCount == 0)
+            appendVarint(rows, vIds.size());
+
+        for (uint32_t id : vIds)
+            appendVarint(rows, id);
+    }
+
+    std::string out;
+
+    appendVarint(out, fixedWordCount);
+    appendVarint(out, vWords.size());
+
+    for (std::string_view word : vWords)
+        appendBytes(out, word);
+
+    return out + rows;
+}
+
+std::string encodePhonesColumn(const std::vector <sClientView>& vClients) {
+
+    // all-digit phones are stored as an integer plus their length to restore leading zeros
+    auto isNumericPhone = [](std::string_view phone) {
+
+        return !phone.empty() && phone.size() <= 19 && std::all_of(phone.begin(), phone.end(), [](char c) { return c >= '0' && c <= '9'; });
+    };
+
+    // when every phone is numeric with the same length, the length is written once for the column
+    size_t fixedLength = vClients.empty() ? 0 : vClients[0].phoneNum.size();
+
+    for (const sClientView& client : vClients) {
+
+        if (client.phoneNum.size() != fixedLength || !isNumericPhone(client.phoneNum)) {
+
+            fixedLength = 0;
+            break;
+        }
+    }
+
+    std::string out;
+
+    appendVarint(out, fixedLength);
+
+    for (const sClientView& client : vClients) {
+
+        std::string_view phone = client.phoneNum;
+        bool isNumeric = isNumericPhone(phone);
+
+        if (fixedLength == 0)
+            appendVarint(out, (phone.size() << 1) | (isNumeric ? 1 : 0));
+
+        if (isNumeric) {
+
+            uint64_t number = 0;
+            std::from_chars(phone.data(), phone.data() + phone.size(), number);
+
+            appendVarint(out, number);
+        }
+
+        else
+            out.append(phone.data(), phone.size());
+    }
+
+    return out;
+}
+
+std::string encodeBalancesColumn(const std::vector <sClientView>& vClients) {
+
+    // balances in cents, or in whole dollars when no balance has cents
+    std::vector <int64_t> vCents;
+    vCents.reserve(vClients.size());
+
+    bool isWholeDollars = true;
+    bool isExact = true;
+
+    for (const sClientView& client : vClients) {
+
+        // accrual leaves fractions of a cent; a balance that doesn't come back from its cents exactly keeps its bits
+        if (!std::isfinite(client.balance) || std::fabs(client.balance) > 1e15f) {
+
+            isExact = false;
+            break;
+        }
+
+        vCents.push_back(std::llround((double)client.balance * 100));
+        isWholeDollars = isWholeDollars && (vCents.back() % 100 == 0);
+        isExact = isExact && (float)((double)vCents.back() / 100) == client.balance;
+    }
+
+    std::string out;
+
+    // the scale is the column's mode: 100 or 1 for varints in dollars or cents, 0 for the raw float bits
+    if (!isExact) {
+
+        appendVarint(out, 0);
+
+        for (const sClientView& client : vClients)
+            out.append((const char*)&client.balance, sizeof(client.balance));
+
+        return out;
+    }
+
+    int64_t scale = isWholeDollars ? 100 : 1;
+
+    appendVarint(out, scale);
+
+    for (int64_t cents : vCents)
+        appendVarint(out, zigzagEncode(cents / scale));
+
+    return out;
+}
+
+std::string encodeUsersColumn(const std::vector <sUser>& vUsers) {
+
+    std::string out;
+
+    appendVarint(out, vUsers.size());
+
+    for (const sUser& user : vUsers) {
+
+        appendBytes(out, user.name);
+        appendBytes(out, user.salt);
+        appendBytes(out, user.passwordHash);
+        appendVarint(out, zigzagEncode(user.permissions));
+    }
+
+    // the PBKDF2 rounds trail the users, a snapshot without them decodes as hashes from before PBKDF2
+    for (const sUser& user : vUsers)
+        appendVarint(out, user.iterations);
+
+    return out;
+}
+
+bool decodeAccountNumsColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vAccountNums) {
+
+    if (in.empty())
+        return numOfRows == 0;
+
+    bool isNumeric = in[0];
+    in.remove_prefix(1);
+
+    vAccountNums.resize(numOfRows);
+
+    if (isNumeric) {
+
+        std::string_view prefix;
+        uint64_t number = 0;
+
+        if (!readBytes(in, prefix))
+            return false;
+
+        for (std::string& accountNum : vAccountNums) {
+
+            uint64_t delta;
+
+            if (!readVarint(in, delta))
+                return false;
+
+            char digits[20];
+
+            number += delta;
+
+            accountNum.assign(prefix.data(), prefix.size());
+            accountNum.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+        }
+    }
+
+    else {
+
+        std::string previous;
+
+        for (std::string& accountNum : vAccountNums) {
+
+            uint64_t shared;
+            std::string_view suffix;
+
+            if (!readVarint(in, shared) || shared > previous.size() || !readBytes(in, suffix))
+                return false;
+
+            accountNum = previous.substr(0, shared);
+            accountNum.append(suffix.data(), suffix.size());
+
+            previous = accountNum;
+        }
+    }
+
+    return true;
+}
+
+bool decodePincodesColumn(std::string_view in, size_t numOfRows, std::vector <int>& vPincodes) {
+
+    vPincodes.resize(numOfRows);
+
+    for (int& pincode : vPincodes) {
+
+        uint64_t value;
+
+        if (!readVarint(in, value))
+            return false;
+
+        pincode = (int)value;
+    }
+
+    return true;
+}
+
+bool decodeNamesColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vNames) {
+
+    uint64_t fixedWordCount, numOfWords;
+
+    if (!readVarint(in, fixedWordCount) || !readVarint(in, numOfWords) || numOfWords > in.size())
+        return false;
+
+    std::vector <std::string_view> vWords(numOfWords);
+
+    for (std::string_view& word : vWords) {
+
+        if (!readBytes(in, word))
+            return false;
+    }
+
+    vNames.resize(numOfRows);
+
+    for (std::string& name : vNames) {
+
+        uint64_t wordsInName = fixedWordCount;
+
+        if (fixedWordCount == 0 && !readVarint(in, wordsInName))
+            return false;
+
+        for (uint64_t i = 0; i < wordsInName; i++) {
+
+            uint64_t id;
+
+            if (!readVarint(in, id) || id >= vWords.size())
+                return false;
+
+            if (i > 0)
+                name += ' ';
+
+            name.append(vWords[id].data(), vWords[id].size());
+        }
+    }
+
+    return true;
+}
+
+bool decodePhonesColumn(std::string_view in, size_t numOfRows, std::vector <std::string>& vPhones) {
+
+    uint64_t fixedLength;
+
+    if (!readVarint(in, fixedLength) || fixedLength > 19)
+        return false;
+
+    vPhones.resize(numOfRows);
+
+    for (std::string& phone : vPhones) {
+
+        uint64_t header = (fixedLength << 1) | 1;
+
+        if (fixedLength == 0 && !readVarint(in, header))
+            return false;
+
+        size_t length = header >> 1;
+
+        if (header & 1) {
+
+            uint64_t number;
+            char digits[20];
+
+            if (!readVarint(in, number))
+                return false;
+
+            size_t numOfDigits = std::to_chars(digits, digits + sizeof(digits), number).ptr - digits;
+
+            if (numOfDigits > length)
+                return false;
+
+            phone.assign(length - numOfDigits, '0');
+            phone.append(digits, numOfDigits);
+        }
+
+        else {
+
+            if (length > in.size())
+                return false;
+
+            phone = std::string(in.substr(0, length));
+            in.remove_prefix(length);
+        }
+    }
+
+    return true;
+}
+
+bool decodeBalancesColumn(std::string_view in, size_t numOfRows, std::vector <float>& vBalances) {
+
+    uint64_t scale;
+
+    if (!readVarint(in, scale))
+        return false;
+
+    if (scale == 0) {
+
+        if (in.size() != numOfRows * sizeof(float))
+            return false;
+
+        vBalances.resize(numOfRows);
+        std::memcpy(vBalances.data(), in.data(), in.size());
+
+        return true;
+    }
+
+    vBalances.resize(numOfRows);
+
+    for (float& balance : vBalances) {
+
+        uint64_t value;
+
+        if (!readVarint(in, value))
+            return false;
+
+        balance = (float)((double)zigzagDecode(value) * scale / 100);
+    }
+
+    return true;
+}
+
+bool decodeUsersColumn(std::string_view in, std::vector <sUser>& vUsers) {
+
+    uint64_t numOfUsers;
+
+    if (!readVarint(in, numOfUsers) || numOfUsers > in.size())
+        return false;
+
+    vUsers.resize(numOfUsers);
+
+    for (sUser& user : vUsers) {
+
+        std::string_view name, salt, hash;
+        uint64_t permissions;
+
+        if (!readBytes(in, name) || !readBytes(in, salt) || !readBytes(in, hash) || !readVarint(in, permissions))
+            return false;
+
+        user.name = std::string(name);
+        user.salt = std::string(salt);
+        user.passwordHash = std::string(hash);
+        user.permissions = (int)zigzagDecode(permissions);
+    }
+
+    if (in.empty())
+        return true;
+
+    for (sUser& user : vUsers) {
+
+        uint64_t iterations;
+
+        if (!readVarint(in, iterations) || iterations > INT32_MAX)
+            return false;
+
+        user.iterations = (int)iterations;
+    }
+
+    return true;
+}
+
+std::string encodeSnapshot(const sClientTable& table, const std::vector <sUser>& vUsers) {
+
+    std::vector <sClientView> vClients;
+    vClients.reserve(table.vClients.size());
+
+    for (const sPackedClient& client : table.vClients)
+        vClients.push_back(unpackClient(table, client));
+
+    // numeric account numbers are sorted by value so their deltas stay small
+    std::string_view prefix = vClients.empty() ? std::string_view() : vClients[0].accountNum;
+    prefix = prefix.substr(0, prefix.find_first_of("0123456789"));
+
+    bool isNumeric = std::all_of(vClients.begin(), vClients.end(), [&](const sClientView& client) {
+
+        return isNumericAccountNum(client.accountNum, prefix);
+    });
+
+    std::sort(vClients.begin(), vClients.end(), [isNumeric](const sClientView& a, const sClientView& b) {
+
+        if (isNumeric && a.accountNum.size() != b.accountNum.size())
+            return a.accountNum.size() < b.accountNum.size();
+
+        return a.accountNum < b.accountNum;
+    });
+
+    // every column is encoded on its own thread
+    std::vector <std::pair <eSnapshotColumn, std::future <std::string>>> vColumns;
+
+    vColumns.emplace_back(COLUMN_ACCOUNT_NUMS, std::async(std::launch::async, [&] { return encodeAccountNumsColumn(vClients, isNumeric); }));
+    vColumns.emplace_back(COLUMN_PINCODES, std::async(std::launch::async, [&] { return encodePincodesColumn(vClients); }));
+    vColumns.emplace_back(COLUMN_NAMES, std::async(std::launch::async, [&] { return encodeNamesColumn(vClients); }));
+    vColumns.emplace_back(COLUMN_PHONES, std::async(std::launch::async, [&] { return encodePhonesColumn(vClients); }));
+    vColumns.emplace_back(COLUMN_BALANCES, std::async(std::launch::async, [&] { return encodeBalancesColumn(vClients); }));
+    vColumns.emplace_back(COLUMN_USERS, std::async(std::launch::async, [&] { return encodeUsersColumn(vUsers); }));
+
+    std::string out = snapshot::MAGIC;
+
+    appendVarint(out, vClients.size());
+    appendVarint(out, vColumns.size());
+
+    for (auto& column : vColumns) {
+
+        std::string bytes = column.second.get();
+        uint32_t crc = crc32c(bytes.data(), bytes.size());
+
+        out += (char)column.first;
+        appendBytes(out, bytes);
+        out.append((const char*)&crc, sizeof(crc));
+    }
+
+    return out;
+}
+
+bool decodeSnapshot(std::string_view in, sSnapshotData& data) {
+
+    uint64_t numOfRows, numOfColumns;
+
+    bool hasChecksums = in.substr(0, snapshot::MAGIC.size()) == snapshot::MAGIC;
+
+    if (!hasChecksums && in.substr(0, snapshot::LEGACY_MAGIC.size()) != snapshot::LEGACY_MAGIC)
+        return false;
+
+    in.remove_prefix(snapshot::MAGIC.size());
+
+    if (!readVarint(in, numOfRows) || !readVarint(in, numOfColumns))
+        return false;
+
+    std::vector <std::future <bool>> vDecoded;
+
+    for (uint64_t i = 0; i < numOfColumns; i++) {
+
+        std::string_view column;
+
+        if (in.empty())
+            return false;
+
+        eSnapshotColumn id = (eSnapshotColumn)in[0];
+        in.remove_prefix(1);
+
+        if (!readBytes(in, column))
+            return false;
+
+        // a damaged column is caught before any of it is decoded
+        if (hasChecksums) {
+
+            uint32_t crc;
+
+            if (in.size() < sizeof(crc))
+                return false;
+
+            std::memcpy(&crc, in.data(), sizeof(crc));
+            in.remove_prefix(sizeof(crc));
+
+            if (crc32c(column.data(), column.size()) != crc)
+                return false;
+        }
+
+        // every column is decoded on its own thread into its own vector
+        switch (id) {
+
+        case COLUMN_ACCOUNT_NUMS:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column, numOfRows] { return decodeAccountNumsColumn(column, numOfRows, data.vAccountNums); }));
+            break;
+
+        case COLUMN_PINCODES:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column, numOfRows] { return decodePincodesColumn(column, numOfRows, data.vPincodes); }));
+            break;
+
+        case COLUMN_NAMES:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column, numOfRows] { return decodeNamesColumn(column, numOfRows, data.vNames); }));
+            break;
+
+        case COLUMN_PHONES:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column, numOfRows] { return decodePhonesColumn(column, numOfRows, data.vPhones); }));
+            break;
+
+        case COLUMN_BALANCES:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column, numOfRows] { return decodeBalancesColumn(column, numOfRows, data.vBalances); }));
+            break;
+
+        case COLUMN_USERS:
+
+            vDecoded.push_back(std::async(std::launch::async, [&data, column] { return decodeUsersColumn(column, data.vUsers); }));
+            break;
+
+        default:
+
+            break;
+        }
+    }
+
+    bool isDecoded = true;
+
+    for (std::future <bool>& decoded : vDecoded)
+        isDecoded = decoded.get() && isDecoded;
+
+    return isDecoded && data.vAccountNums.size() == numOfRows && data.vPincodes.size() == numOfRows &&
+        data.vNames.size() == numOfRows && data.vPhones.size() == numOfRows && data.vBalances.size() == numOfRows;
+}
+
+uint64_t hashKey(std::string_view key) {
+
+    // FNV-1a, 0 is reserved for empty index slots
+    uint64_t hash = 14695981039346656037ull;
+
+    for (unsigned char c : key) {
+
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash ? hash : 1;
+}
+
+bool createIndexFile(const std::string& indexFile, uint64_t capacity) {
+
+    std::fstream file;
+
+    file.open(indexFile, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+        return false;
+
+    sIndexHeader header;
+    header.capacity = capacity;
+
+    file.write((const char*)&header, sizeof(header));
+
+    std::vector <sIndexSlot> vEmptySlots(1024);
+
+    for (uint64_t written = 0; written < capacity; written += vEmptySlots.size())
+        file.write((const char*)vEmptySlots.data(), std::min <uint64_t>(vEmptySlots.size(), capacity - written) * sizeof(sIndexSlot));
+
+    file.close();
+
+    return !file.fail();
+}
+
+bool openIndexFile(const std::string& indexFile, std::fstream& file, sIndexHeader& header) {
+
+    file.open(indexFile, std::ios::in | std::ios::out | std::ios::binary);
+
+    if (!file.is_open()) {
+
+        if (!createIndexFile(indexFile, 1024))
+            return false;
+
+        file.open(indexFile, std::ios::in | std::ios::out | std::ios::binary);
+    }
+
+    file.read((char*)&header, sizeof(header));
+
+    return file.good() && std::memcmp(header.magic, "BNKINDX1", 8) == 0 && header.capacity > 0;
+}
+
+bool probeIndexSlot(std::fstream& file, const sIndexHeader& header, const std::string& key, sIndexSlot& slot, uint64_t& position) {
+
+    // linear probing from the key's home slot, stops at the key or at the first empty slot
+    uint64_t keyHash = hashKey(key);
+
+    for (uint64_t probe = 0; probe < header.capacity; probe++) {
+
+        position = (keyHash + probe) % header.capacity;
+
+        file.clear();
+        file.seekg(sizeof(sIndexHeader) + position * sizeof(sIndexSlot));
+        file.read((char*)&slot, sizeof(slot));
+
+        if (!file.good())
+            return false;
+
+        if (slot.keyHash == 0)
+            return false;
+
+        if (slot.keyHash == keyHash && key.compare(0, sizeof(slot.key) - 1, slot.key) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool readIndexSlot(const std::string& indexFile, const std::string& key, sIndexSlot& slot) {
+
+    std::fstream file;
+    sIndexHeader header;
+    uint64_t position;
+
+    file.open(indexFile, std::ios::in | std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    file.read((char*)&header, sizeof(header));
+
+    if (!file.good() || std::memcmp(header.magic, "BNKINDX1", 8) != 0 || header.capacity == 0)
+        return false;
+
+    return probeIndexSlot(file, header, key, slot, position);
+}
+
+bool growIndexFile(const std::string& indexFile, const sIndexHeader& header) {
+
+    std::fstream oldFile;
+
+    oldFile.open(indexFile, std::ios::in | std::ios::binary);
+    oldFile.seekg(sizeof(sIndexHeader));
+
+    std::vector <sIndexSlot> vSlots(header.capacity);
+    oldFile.read((char*)vSlots.data(), vSlots.size() * sizeof(sIndexSlot));
+    oldFile.close();
+
+    std::string grownFile = indexFile + ".grow";
+
+    if (!createIndexFile(grownFile, header.capacity * 2))
+        return false;
+
+    for (const sIndexSlot& slot : vSlots) {
+
+        if (slot.keyHash != 0 && !upsertIndexSlot(grownFile, slot))
+            return false;
+    }
+
+    return replaceFile(grownFile, indexFile);
+}
+
+bool upsertIndexSlot(const std::string& indexFile, const sIndexSlot& newSlot) {
+
+    std::fstream file;
+    sIndexHeader header;
+
+    if (!openIndexFile(indexFile, file, header))
+        return false;
+
+    sIndexSlot slot;
+    uint64_t position;
+
+    bool isFound = probeIndexSlot(file, header, newSlot.key, slot, position);
+
+    if (!isFound) {
+
+        // keep the table at most 70% full so probes stay short
+        if ((header.count + 1) * 10 > header.capacity * 7) {
+
+            file.close();
+
+            return growIndexFile(indexFile, header) && upsertIndexSlot(indexFile, newSlot);
+        }
+
+        header.count++;
+
+        file.clear();
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+    }
+
+    file.clear();
+    file.seekp(sizeof(sIndexHeader) + position * sizeof(sIndexSlot));
+    file.write((const char*)&newSlot, sizeof(newSlot));
+
+    file.close();
+
+    return !file.fail();
+}
+
+sIndexSlot makeIndexSlot(std::string_view key, int64_t first, int64_t second) {
+
+    sIndexSlot slot;
+
+    slot.keyHash = hashKey(key);
+    key.copy(slot.key, sizeof(slot.key) - 1);
+    slot.first = first;
+    slot.second = second;
+
+    return slot;
+}
+
+// BALANCES.idx: the slot layout of CLIENTS.idx, first holds the float's bits
+sIndexSlot makeBalanceSlot(const std::string& accountNum, float balance) {
+
+    uint32_t bits;
+
+    std::memcpy(&bits, &balance, sizeof(bits));
+
+    return makeIndexSlot(accountNum, bits, 0);
+}
+
+float getSlotBalance(const sIndexSlot& slot) {
+
+    uint32_t bits = (uint32_t)slot.first;
+    float balance;
+
+    std::memcpy(&balance, &bits, sizeof(balance));
+
+    return balance;
+}
+
+// the whole hot table of a shard, empty when no balance changed since the shard was last written whole
+std::vector <sIndexSlot> loadHotBalances(int shardIndex) {
+
+    std::fstream file;
+    sIndexHeader header;
+
+    file.open(getShardFileName(file::HOT_BALANCES_FILE, shardIndex), std::ios::in | std::ios::binary);
+
+    if (!file.is_open())
+        return {};
+
+    file.read((char*)&header, sizeof(header));
+
+    if (!file.good() || std::memcmp(header.magic, "BNKINDX1", 8) != 0 || header.count == 0)
+        return {};
+
+    std::vector <sIndexSlot> vSlots(header.capacity);
+    file.read((char*)vSlots.data(), vSlots.size() * sizeof(sIndexSlot));
+
+    if (!file.good())
+        return {};
+
+    return vSlots;
+}
+
+// every shard's hot table for full loads, empty when none has one
+std::vector <std::vector <sIndexSlot>> loadHotBalances() {
+
+    std::vector <std::vector <sIndexSlot>> vShardSlots(shards::count);
+    bool hasHotBalances = false;
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        vShardSlots[shardIndex] = loadHotBalances(shardIndex);
+        hasHotBalances = hasHotBalances || !vShardSlots[shardIndex].empty();
+    }
+
+    if (!hasHotBalances)
+        return {};
+
+    return vShardSlots;
+}
+
+bool findHotBalance(const std::vector <sIndexSlot>& vSlots, std::string_view accountNum, float& balance) {
+
+    if (vSlots.empty())
+        return false;
+
+    uint64_t keyHash = hashKey(accountNum);
+
+    for (uint64_t probe = 0; probe < vSlots.size(); probe++) {
+
+        const sIndexSlot& slot = vSlots[(keyHash + probe) % vSlots.size()];
+
+        if (slot.keyHash == 0)
+            return false;
+
+        if (slot.keyHash == keyHash && accountNum.substr(0, sizeof(slot.key) - 1) == slot.key) {
+
+            balance = getSlotBalance(slot);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool readHotBalance(const std::string& accountNum, float& balance) {
+
+    sIndexSlot slot;
+
+    if (!readIndexSlot(getShardFileName(file::HOT_BALANCES_FILE, getClientShard(accountNum)), accountNum, slot))
+        return false;
+
+    balance = getSlotBalance(slot);
+    return true;
+}
+
+// caller holds the shard's mutex and BALANCES lock; slots are overwritten in place, one fsync covers the whole batch
+bool writeHotBalances(int shardIndex, const std::vector <sIndexSlot>& vSlots) {
+
+    if (vSlots.empty())
+        return true;
+
+    std::string fileName = getShardFileName(file::HOT_BALANCES_FILE, shardIndex);
+
+    for (const sIndexSlot& slot : vSlots) {
+
+        if (!upsertIndexSlot(fileName, slot))
+            return false;
+    }
+
+    FILE* file = std::fopen(fileName.c_str(), "rb+");
+
+    if (file == nullptr)
+        return false;
+
+    bool isSynced = fsync(fileno(file)) == 0;
+
+    std::fclose(file);
+
+    return isSynced;
+}
+
+// caller holds the shard's mutex and BALANCES lock; a whole new shard from a full image is compared line by line with
+// the old one, and the hot table takes every balance it changes before the shard is replaced
+bool alignHotBalances(int shardIndex, const std::string& content) {
+
+    std::vector <sIndexSlot> vHotSlots = loadHotBalances(shardIndex);
+
+    // without a table the old file alone is a consistent state to crash back to
+    if (vHotSlots.empty())
+        return true;
+
+    std::string oldContent = readDiskContent(getShardFileName(file::CLIENTS_FILE, shardIndex));
+    std::unordered_map <std::string_view, float> newBalances;
+
+    auto forEachClient = [](std::string_view lines, auto visit) {
+
+        while (!lines.empty()) {
+
+            size_t lineEnd = lines.find('\n');
+            sClientView client;
+
+            if (clientLineToView(lines.substr(0, lineEnd), client, false))
+                visit(client);
+
+            lines.remove_prefix((lineEnd == std::string_view::npos) ? lines.size() : lineEnd + 1);
+        }
+    };
+
+    forEachClient(content, [&](const sClientView& client) { newBalances[client.accountNum] = client.balance; });
+
+    std::vector <sIndexSlot> vSlots;
+
+    forEachClient(oldContent, [&](const sClientView& client) {
+
+        float oldBalance = client.balance;
+        auto it = newBalances.find(client.accountNum);
+
+        findHotBalance(vHotSlots, client.accountNum, oldBalance);
+
+        if (it != newBalances.end() && it->second != oldBalance)
+            vSlots.push_back(makeBalanceSlot(std::string(client.accountNum), it->second));
+    });
+
+    return writeHotBalances(shardIndex, vSlots);
+}
+
+void resetHotBalances(int shardIndex) {
+
+    std::error_code error;
+
+    std::filesystem::remove(getShardFileName(file::HOT_BALANCES_FILE, shardIndex), error);
+}
+
+bool loadShardCount() {
+
+    // a missing or empty file is the single CLIENTS.txt; anything else has to be a count in range, guessing one
+    // would route every account to the wrong shard
+    std::string content = readDiskContent(file::CLIENTS_SHARDS_FILE);
+    size_t end = content.find_last_not_of(" \t\r\n") + 1;
+    int numOfShards = 1;
+
+    if (end != 0) {
+
+        auto parsed = std::from_chars(content.data(), content.data() + end, numOfShards);
+
+        if (parsed.ec != std::errc() || parsed.ptr != content.data() + end || numOfShards < 1 || numOfShards > shards::MAX_SHARDS) {
+
+            std::cout << file::CLIENTS_SHARDS_FILE << " holds \"" << content.substr(0, end) << "\", not a shard count from 1 to " << shards::MAX_SHARDS << '\n';
+            return false;
+        }
+    }
+
+    shards::count = numOfShards;
+    shards::vCrcs.assign(shards::count, 0);
+    shards::vStamps.assign(shards::count, 0);
+
+    return true;
+}
+
+// CRC32C rather than hashKey, so the accounts of one shard still spread over its index slots
+int getClientShard(std::string_view accountNum, int numOfShards) {
+
+    return (numOfShards == 1) ? 0 : (int)(crc32c(accountNum.data(), accountNum.size()) % numOfShards);
+}
+
+// CLIENTS.txt -> CLIENTS_2_of_8.txt; the count is part of the name, so two layouts never share a file
+std::string getShardFileName(const std::string& fileName, int shardIndex, int numOfShards) {
+
+    if (numOfShards == 1)
+        return fileName;
+
+    size_t extension = fileName.rfind('.');
+
+    return fileName.substr(0, extension) + "_" + std::to_string(shardIndex) + "_of_" + std::to_string(numOfShards) + fileName.substr(extension);
+}
+
+// the lines of each shard in the order they appear in the content
+std::vector <std::string> splitClientShards(const std::string& content, int numOfShards) {
+
+    std::vector <std::string> vParts(numOfShards);
+
+    for (std::string& part : vParts)
+        part.reserve(content.size() / numOfShards + content.size() / 16);
+
+    for (size_t offset = 0; offset < content.size();) {
+
+        size_t end = content.find('\n', offset);
+
+        if (end == std::string::npos)
+            end = content.size();
+
+        std::string_view line = std::string_view(content).substr(offset, end - offset);
+        std::string& part = vParts[getClientShard(line.substr(0, line.find(SEPARATOR)), numOfShards)];
+
+        part.append(line.data(), line.size());
+        part += '\n';
+
+        offset = end + 1;
+    }
+
+    return vParts;
+}
+
+// about equal slices that never cut a line in two, no more than there are cores to parse them
+std::vector <std::string_view> sliceAtLines(std::string_view content, int numOfSlices) {
+
+    numOfSlices = std::max(1, std::min(numOfSlices, (int)std::thread::hardware_concurrency()));
+
+    std::vector <std::string_view> vSlices;
+    size_t start = 0;
+
+    for (int slice = 1; slice <= numOfSlices; slice++) {
+
+        size_t end = (slice == numOfSlices) ? content.size() : std::max(start, content.size() * slice / numOfSlices);
+
+        if (end < content.size())
+            end = std::min(content.find('\n', end), content.size() - 1) + 1;
+
+        vSlices.push_back(content.substr(start, end - start));
+        start = end;
+    }
+
+    return vSlices;
+}
+
+// one thread per shard file, joined in shard order
+std::string readClientShards() {
+
+    std::vector <std::string> vParts(shards::count);
+    std::vector <std::thread> vThreads;
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        vThreads.emplace_back([&vParts, shardIndex]() {
+
+            std::string fileName = getShardFileName(file::CLIENTS_FILE, shardIndex);
+            std::lock_guard <std::mutex> lock(shards::mutexes[shardIndex]);
+
+            vParts[shardIndex] = readDiskContent(fileName);
+            shards::vCrcs[shardIndex] = crc32c(vParts[shardIndex].data(), vParts[shardIndex].size());
+            shards::vStamps[shardIndex] = getFileStamp(fileName);
+
+            if (!vParts[shardIndex].empty() && vParts[shardIndex].back() != '\n')
+                vParts[shardIndex] += '\n';
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    std::string content;
+    size_t size = 0;
+
+    for (const std::string& part : vParts)
+        size += part.size();
+
+    content.reserve(size);
+
+    for (const std::string& part : vParts)
+        content += part;
+
+    return content;
+}
+
+// caller holds the shard's mutex and BALANCES lock and has put the balances the shard changes into the hot table;
+// a whole shard is written with its index and takes over the shard's hot balances
+bool writeClientShard(int shardIndex, const std::string& content, bool isAppend) {
+
+    std::string fileName = getShardFileName(file::CLIENTS_FILE, shardIndex);
+
+    // the ATMs rebuild CLIENTS.idx from the shard file, so the file and its index change together under the index lock
+    sFileLock indexLock(getShardFileName(file::CLIENTS_INDEX_LOCK_FILE, shardIndex));
+
+    if (isAppend) {
+
+        std::error_code error;
+        int64_t offset = (int64_t)std::filesystem::file_size(fileName, error);
+
+        shards::vStamps[shardIndex] = 0;
+
+        if (!writeFileDurably(fileName, content, true))
+            return false;
+
+        // a missing or stale index is rebuilt by its next reader, the append itself is already durable
+        upsertClientsIndex(shardIndex, content, error ? 0 : offset);
+
+        return true;
+    }
+
+    bool isWritten = writeFileDurably(getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex), buildClientsIndexContent(content), false);
+
+    if (!writeFileDurably(fileName, content, false))
+        return false;
+
+    resetHotBalances(shardIndex);
+
+    shards::vCrcs[shardIndex] = crc32c(content.data(), content.size());
+    shards::vStamps[shardIndex] = getFileStamp(fileName);
+
+    return isWritten;
+}
+
+bool writeClientsIndex(int shardIndex, const std::string& content) {
+
+    sFileLock indexLock(getShardFileName(file::CLIENTS_INDEX_LOCK_FILE, shardIndex));
+
+    return writeFileDurably(getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex), content, false);
+}
+
+// the appended lines get their slots first and #size last, a reader that sees the new size finds every line
+bool upsertClientsIndex(int shardIndex, const std::string& appended, int64_t offset) {
+
+    std::string indexFile = getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex);
+
+    for (size_t lineStart = 0; lineStart < appended.size();) {
+
+        size_t end = appended.find('\n', lineStart);
+
+        if (end == std::string::npos)
+            end = appended.size();
+
+        size_t keyEnd = appended.find(SEPARATOR, lineStart);
+
+        if (keyEnd < end && !upsertIndexSlot(indexFile, makeIndexSlot(std::string_view(appended).substr(lineStart, keyEnd - lineStart), offset + lineStart, end - lineStart)))
+            return false;
+
+        lineStart = end + 1;
+    }
+
+    return upsertIndexSlot(indexFile, makeIndexSlot(file::CLIENTS_INDEX_SIZE_KEY, offset + appended.size(), 0));
+}
+
+int findClientsIndexShard(const std::string& fileName) {
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        if (fileName == getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex))
+            return shardIndex;
+    }
+
+    return -1;
+}
+
+// a whole CLIENTS.txt only rewrites the shards whose lines changed, each on its own thread
+bool writeClientShards(const std::string& content, bool isAppend) {
+
+    if (shards::count == 1) {
+
+        std::lock_guard <std::mutex> lock(shards::mutexes[0]);
+        sFileLock balancesLock(file::HOT_BALANCES_LOCK_FILE);
+
+        return (isAppend || alignHotBalances(0, content)) && writeClientShard(0, content, isAppend);
+    }
+
+    std::vector <std::string> vParts = splitClientShards(content);
+    std::vector <char> vResults(shards::count, true);
+    std::vector <std::thread> vThreads;
+
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
+
+        if (isAppend && vParts[shardIndex].empty())
+            continue;
+
+        vThreads.emplace_back([&, shardIndex]() {
+
+            const std::string& part = vParts[shardIndex];
+            std::lock_guard <std::mutex> lock(shards::mutexes[shardIndex]);
+            sFileLock balancesLock(getShardFileName(file::HOT_BALANCES_LOCK_FILE, shardIndex));
+            std::error_code error;
+
+            // the same lines as last read and no hot balance to fold in: the file already is this shard
+            bool isUnchanged = !isAppend && shards::vStamps[shardIndex] != 0
+                && shards::vStamps[shardIndex] == getFileStamp(getShardFileName(file::CLIENTS_FILE, shardIndex))
+                && shards::vCrcs[shardIndex] == crc32c(part.data(), part.size())
+                && !std::filesystem::exists(getShardFileName(file::HOT_BALANCES_FILE, shardIndex), error);
+
+            if (!isUnchanged)
+                vResults[shardIndex] = (isAppend || alignHotBalances(shardIndex, part)) && writeClientShard(shardIndex, part, isAppend);
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    return std::all_of(vResults.begin(), vResults.end(), [](char isWritten) { return isWritten; });
+}
+
+// the new shards are written next to the old ones; the layout switches when CLIENTS_SHARDS.txt names it, then the old files go
+void reshardClients(int numOfShards) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (numOfShards < 1 || numOfShards > shards::MAX_SHARDS) {
+
+        std::cout << "The shard count must be between 1 and " << shards::MAX_SHARDS << '\n';
+        return;
+    }
+
+    if (numOfShards == shards::count) {
+
+        std::cout << file::CLIENTS_FILE << " already is in " << numOfShards << " shard(s)\n";
+        return;
+    }
+
+    // the hot balances are folded in, the new shards start without any
+    std::vector <sClient> vClients = loadClientsFromFile();
+    std::vector <std::string> vParts = splitClientShards(clientsToFileContent(vClients), numOfShards);
+    std::vector <char> vResults(numOfShards, false);
+    std::vector <std::thread> vThreads;
+
+    for (int shardIndex = 0; shardIndex < numOfShards; shardIndex++) {
+
+        vThreads.emplace_back([&, shardIndex]() {
+
+            std::error_code error;
+
+            // left behind by an earlier reshard to this count that never switched over
+            std::filesystem::remove(getShardFileName(file::HOT_BALANCES_FILE, shardIndex, numOfShards), error);
+
+            vResults[shardIndex] = writeFileDurably(getShardFileName(file::CLIENTS_FILE, shardIndex, numOfShards), vParts[shardIndex], false)
+                && writeFileDurably(getShardFileName(file::CLIENTS_INDEX_FILE, shardIndex, numOfShards), buildClientsIndexContent(vParts[shardIndex]), false);
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    if (!std::all_of(vResults.begin(), vResults.end(), [](char isWritten) { return isWritten; })
+        || !writeFileDurably(file::CLIENTS_SHARDS_FILE, std::to_string(numOfShards) + '\n', false)) {
+
+        std::cout << "Couldn't write the new shards, " << file::CLIENTS_FILE << " is still in " << shards::count << " shard(s)\n";
+        return;
+    }
+
+    int oldCount = shards::count;
+
+    for (int shardIndex = 0; shardIndex < oldCount; shardIndex++) {
+
+        std::error_code error;
+
+        for (const std::string& fileName : { file::CLIENTS_FILE, file::CLIENTS_INDEX_FILE, file::CLIENTS_INDEX_LOCK_FILE, file::HOT_BALANCES_FILE, file::HOT_BALANCES_LOCK_FILE })
+            std::filesystem::remove(getShardFileName(fileName, shardIndex, oldCount), error);
+    }
+
+    loadShardCount();
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    auto sizes = std::minmax_element(vParts.begin(), vParts.end(), [](const std::string& a, const std::string& b) { return a.size() < b.size(); });
+
+    std::cout << "Resharded " << vClients.size() << " client(s) from " << oldCount << " into " << numOfShards << " shard(s) in " << seconds << "s\n";
+    std::cout << "Smallest Shard: " << sizes.first->size() << " bytes, Largest Shard: " << sizes.second->size() << " bytes\n";
+}
+
+int32_t getHistorySegment(int64_t timestamp) {
+
+    std::tm date = toLocalTime(timestamp);
+
+    return (date.tm_year + 1900) * 100 + date.tm_mon + 1;
+}
+
+std::string getHistorySegmentFile(int32_t segment) {
+
+    return file::HISTORY_SEGMENT_PREFIX + std::to_string(segment) + ".dat";
+}
+
+bool appendHistory(const std::string& accountNum, eHistoryType type, float amount, float balanceAfter) {
+
+    sHistoryRecord record;
+
+    accountNum.copy(record.accountNum, sizeof(record.accountNum) - 1);
+    record.timestamp = (int64_t)std::time(nullptr);
+    record.type = type;
+    record.amount = amount;
+    record.balanceAfter = balanceAfter;
+
+    // the new record points back at the account's previous one, the index then points at the new record;
+    // the bank and the ATMs both append, so the lock keeps two records from taking the same previous one
+    sFileLock historyLock(file::HISTORY_LOCK_FILE);
+    sIndexSlot head;
+
+    if (readIndexSlot(file::HISTORY_INDEX_FILE, accountNum, head)) {
+
+        record.previousSegment = (int32_t)head.first;
+        record.previousOffset = head.second;
+    }
+
+    int32_t segment = getHistorySegment(record.timestamp);
+
+    FILE* file = std::fopen(getHistorySegmentFile(segment).c_str(), "ab");
+
+    if (file == nullptr)
+        return false;
+
+    std::fseek(file, 0, SEEK_END);
+    int64_t offset = std::ftell(file);
+
+    // the record is on disk before the head slot points at it
+    bool isWritten = std::fwrite(&record, sizeof(record), 1, file) == 1;
+
+    isWritten = (std::fflush(file) == 0) && isWritten;
+    isWritten = (fsync(fileno(file)) == 0) && isWritten;
+    isWritten = (std::fclose(file) == 0) && isWritten;
+
+    // the head slot is on disk before the lock lets the next append read it
+    return isWritten && offset >= 0 && upsertIndexSlot(file::HISTORY_INDEX_FILE, makeIndexSlot(accountNum, segment, offset))
+        && syncFile(file::HISTORY_INDEX_FILE);
+}
+
+std::vector <sHistoryRecord> readAccountHistory(const std::string& accountNum, size_t maxRecords, int64_t fromTime, int64_t toTime) {
+
+    sHistoryReader reader;
+
+    return readAccountHistory(reader, accountNum, maxRecords, fromTime, toTime);
+}
+
+std::vector <sHistoryRecord> readAccountHistory(sHistoryReader& reader, const std::string& accountNum, size_t maxRecords, int64_t fromTime, int64_t toTime) {
+
+    std::vector <sHistoryRecord> vRecords;
+
+    if (!reader.isIndexOpen) {
+
+        reader.indexFile.open(file::HISTORY_INDEX_FILE, std::ios::in | std::ios::binary);
+        reader.indexFile.read((char*)&reader.indexHeader, sizeof(reader.indexHeader));
+
+        reader.isIndexOpen = reader.indexFile.good() && std::memcmp(reader.indexHeader.magic, "BNKINDX1", 8) == 0 && reader.indexHeader.capacity > 0;
+
+        if (!reader.isIndexOpen)
+            return vRecords;
+    }
+
+    sIndexSlot head;
+    uint64_t position;
+
+    if (!probeIndexSlot(reader.indexFile, reader.indexHeader, accountNum, head, position))
+        return vRecords;
+
+    int32_t segment = (int32_t)head.first;
+    int64_t offset = head.second;
+
+    std::fstream& file = reader.segmentFile;
+
+    // walk the account's chain newest first, only its own records are ever read
+    while (segment != 0 && vRecords.size() < maxRecords) {
+
+        if (segment != reader.openSegment) {
+
+            file.close();
+            file.clear();
+            file.open(getHistorySegmentFile(segment), std::ios::in | std::ios::binary);
+
+            reader.openSegment = segment;
+        }
+
+        sHistoryRecord record;
+
+        file.clear();
+        file.seekg(offset);
+        file.read((char*)&record, sizeof(record));
+
+        if (!file.good())
+            break;
+
+        if (record.timestamp < fromTime)
+            break;
+
+        if (record.timestamp <= toTime)
+            vRecords.push_back(record);
+
+        segment = record.previousSegment;
+        offset = record.previousOffset;
+    }
+
+    return vRecords;
+}
+
+
+// core functions (definition)
+
+void addClients(sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::ADD_CLIENT)) {
+
+        printAccessDenied();
+    }
+
+    else {
+
+        std::cout << "\t\t----------------------------\n";
+        std::cout << "\t\t\tAdd New Client\n";
+        std::cout << "\t\t----------------------------\n\n";
+
+        char addOtherClient;
+
+        do {
+
+            std::cout << "\nAdding New Client:\n\n";
+
+            addClient();
+
+            addOtherClient = readChar("\nDo you want to add another client (Y/N):");
+
+        } while (toupper(addOtherClient) == 'Y');
+    }
+
+
+    returnToMenu();
+}
+
+void showAllClients(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::SHOW_ALL_CLIENTS)) {
+
+        printAccessDenied();
+    }
+
+    else {
+
+        std::cout << "\t\t----------------------------\n";
+        std::cout << "\t\t\tShow All Clients\n";
+        std::cout << "\t\t----------------------------\n";
+
+        // a pinned version: transactions committing meanwhile neither wait for the report nor show up half-applied
+        std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+
+        printClientsListHeader(snapshot->count);
+
+        for (size_t i = 0; i < snapshot->count; i++) {
+
+            printClientRecord(getVersionClient(*snapshot, i));
+        }
+
+        std::cout << "\n-------------------------------------------------------------------------------------------\n";
+    }
+
+
+    returnToMenu();
+}
+
+void updateClient(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::UPDATE_CLIENT)) {
+
+        printAccessDenied();
+    }
+
+    else {
+
+        std::cout << "\t\t---------------------------\n";
+        std::cout << "\t\t\tUpdate Client\n";
+        std::cout << "\t\t---------------------------\n\n";
+
+        std::string accountNum = readAccountNum();
+
+        setTraceSubject(accountNum);
+        processUpdating(accountNum);
+    }
+
+
+    returnToMenu();
+}
+
+void removeClient(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::REMOVE_CLIENT)) {
+
+        printAccessDenied();
+        returnToMenu();
+
+        return;
+    }
+
+    std::cout << "\t\t----------------------------\n";
+    std::cout << "\t\t\tRemove Client\n";
+    std::cout << "\t\t----------------------------\n\n";
+
+    std::string accountNum = readAccountNum();
+
+    setTraceSubject(accountNum);
+    processRemoving(accountNum);
+
+    returnToMenu();
+}
+
+void findClient(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::FIND_CLIENT)) {
+
+        printAccessDenied();
+        returnToMenu();
+
+        return;
+    }
+
+    std::cout << "\t\t------------------------\n";
+    std::cout << "\t\t\tFind Client\n";
+    std::cout << "\t\t------------------------\n\n";
+
+    std::string accountNum = readAccountNum();
+
+    setTraceSubject(accountNum);
+
+    sClient client;
+
+    if (findClientCached(accountNum, client)) {
+
+        printClientCard(client);
+    }
+
+    else
+        printClientNotFound(accountNum);
+
+
+    returnToMenu();
+}
+
+void Deposit() {
+
+    std::cout << "\t\t------------------------\n";
+    std::cout << "\t\t\tDeposit\n";
+    std::cout << "\t\t------------------------\n\n";
+
+    processTransactions();
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+void Withdraw() {
+
+    std::cout << "\t\t------------------------\n";
+    std::cout << "\t\t\tWithdraw\n";
+    std::cout << "\t\t------------------------\n\n";
+
+    processTransactions(false);
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+void Transfer() {
+
+    std::cout << "\t\t------------------------\n";
+    std::cout << "\t\t\tTransfer\n";
+    std::cout << "\t\t------------------------\n\n";
+
+    processTransfer();
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+int64_t readDate(const std::string& msg, bool isEndOfDay) {
+
+    std::tm date = {};
+
+    while (true) {
+
+        std::istringstream text(readText(msg));
+        text >> std::get_time(&date, "%Y-%m-%d");
+
+        if (!text.fail())
+            break;
+
+        std::cout << "Invalid date! Use YYYY-MM-DD\n";
+    }
+
+    date.tm_isdst = -1;
+
+    if (isEndOfDay) {
+
+        date.tm_hour = 23;
+        date.tm_min = 59;
+        date.tm_sec = 59;
+    }
+
+    return (int64_t)std::mktime(&date);
+}
+
+void miniStatement() {
+
+    std::cout << "\t\t----------------------------\n";
+    std::cout << "\t\t\tMini Statement\n";
+    std::cout << "\t\t----------------------------\n\n";
+
+    std::string accountNum = readAccountNum();
+
+    std::vector <sHistoryRecord> vRecords;
+
+    char byDate = readChar("Filter by date range (Y/N):");
+
+    if (toupper(byDate) == 'Y') {
+
+        int64_t fromTime = readDate("Enter start date (YYYY-MM-DD):");
+        int64_t toTime = readDate("Enter end date (YYYY-MM-DD):", true);
+
+        vRecords = readAccountHistory(accountNum, SIZE_MAX, fromTime, toTime);
+
+        setTraceSubject(accountNum);
+    }
+
+    else {
+
+        int numOfRecords = readPositiveNum("Enter number of transactions to show:");
+
+        vRecords = readAccountHistory(accountNum, numOfRecords);
+
+        setTraceSubject(accountNum, numOfRecords);
+    }
+
+    printHistoryHeader(accountNum, vRecords.size());
+
+    for (const sHistoryRecord& record : vRecords)
+        printHistoryRecord(record);
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+void showAllBalances() {
+
+    std::cout << "\t\t-------------------------------\n";
+    std::cout << "\t\t\tShow All Balances\n";
+    std::cout << "\t\t-------------------------------\n";
+
+    std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+
+    printBalancesListHeader(snapshot->count);
+
+    int totalBalance = 0;
+
+    for (size_t i = 0; i < snapshot->count; i++) {
+
+        sClientView client = getVersionClient(*snapshot, i);
+
+        std::cout << "| " << std::setw(17) << client.accountNum;
+        std::cout << "| " << std::setw(30) << client.name;
+        std::cout << "| $" << std::setw(10) << client.balance << '\n';
+
+        totalBalance += client.balance;
+    }
+
+    std::cout << "\n\n-- Total Balance: $" << totalBalance << "\n\n";
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+void analyticsReport() {
+
+    std::cout << "\t\t-------------------------------\n";
+    std::cout << "\t\t\tAnalytics Report\n";
+    std::cout << "\t\t-------------------------------\n\n";
+
+    int topN = (int)readNumInRange("How many top accounts to show (1-100)?", 1, 100);
+
+    setTraceSubject("", topN);
+
+    std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+
+    int numOfThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    sBalanceAnalytics analytics = computeBalanceAnalytics(getVersionSpans(*snapshot), topN, numOfThreads);
+
+    printBalanceAnalytics(analytics, *snapshot->pool);
+
+    std::cout << "\n-- Computed in " << analytics.seconds * 1000 << " ms on " << numOfThreads << " thread(s)\n\n";
+
+    returnToMenu(menu::TRANSACTIONS);
+}
+
+void applyTransaction(eTransactionsMenu choice) {
+
+    if (audit::TRANSACTIONS_MENU_ACTIONS[choice] != AUDIT_NONE)
+        emitAuditEvent(audit::TRANSACTIONS_MENU_ACTIONS[choice]);
+
+    beginTraceOperation(TRACE_BANK_TRANSACTIONS, choice);
+
+    clearScreen();
+
+    switch (choice) {
+
+    case eTransactionsMenu::TRANSAC_DEPOSIT:
+
+        Deposit();
+        break;
+
+    case eTransactionsMenu::TRANSAC_WITHDRAW:
+
+        Withdraw();
+        break;
+
+    case eTransactionsMenu::TRANSAC_TRANSFER:
+
+        Transfer();
+        break;
+
+    case eTransactionsMenu::TRANSAC_SHOW_ALL_BALANCES:
+
+        showAllBalances();
+        break;
+
+    case eTransactionsMenu::TRANSAC_MINI_STATEMENT:
+
+        miniStatement();
+        break;
+
+    case eTransactionsMenu::TRANSAC_ANALYTICS:
+
+        analyticsReport();
+        break;
+
+    case eTransactionsMenu::TRANSAC_RETURN_TO_MAIN_MENU:
+
+        return;
+    }
+
+    endTraceOperation();
+}
+
+void Transactions(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::TRANSACTIONS)) {
+
+        printAccessDenied();
+    }
+
+    else {
+
+        eTransactionsMenu choice;
+
+        do {
+
+            printTransactionsMenu();
+            choice = (eTransactionsMenu)readMenuChoice(1, 7);
+
+            applyTransaction(choice);
+
+        } while (choice != eTransactionsMenu::TRANSAC_RETURN_TO_MAIN_MENU);
+    }
+}
+
+void addUser(const std::vector <sUser>& vUsers) {
+
+    sUser user = readUserData(vUsers);
+
+    if (addLineToFile(userRecordToLine(user), file::USERS_FILE).get()) {
+
+        cache::usersIndex[user.name] = user;
+        emitAuditEvent(AUDIT_ADD_USER, user.name, 0, true);
+    }
+}
+
+void addUsers() {
+
+    std::cout << "\t\t-------------------------\n";
+    std::cout << "\t\t\tAdd User\n";
+    std::cout << "\t\t-------------------------\n";
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    std::cout << "\nAdding New User:\n\n";
+
+    char addAnotherUser;
+
+    do {
+
+        addUser(vUsers);
+
+        addAnotherUser = readChar("\nDo you want to add another user (Y/N):");
+
+    } while (toupper(addAnotherUser) == 'Y');
+
+
+    std::cout << '\n';
+    returnToMenu(menu::MANAGE_USERS);
+}
+
+void showAllUsers() {
+
+    std::cout << "\t\t----------------------------\n";
+    std::cout << "\t\t\tShow All Users\n";
+    std::cout << "\t\t----------------------------\n";
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    printUsersListHeader(vUsers.size());
+
+    for (const sUser& user : vUsers) {
+
+        std::cout << "| " << std::setw(17) << user.name;
+        std::cout << "| " << std::setw(20) << user.permissions << '\n';
+    }
+
+    returnToMenu(menu::MANAGE_USERS);
+}
+
+void updateUser() {
+
+    std::cout << "\t\t-----------------------------\n";
+    std::cout << "\t\t\tUpdate User\n";
+    std::cout << "\t\t-----------------------------\n\n";
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    std::string username = readUsername();
+    int index = getUserIndexByName(username, vUsers);
+
+    processUpdating(index, vUsers);
+
+    returnToMenu(menu::MANAGE_USERS);
+}
+
+void removeUser() {
+
+    std::cout << "\t\t-----------------------------\n";
+    std::cout << "\t\t\tDelete User\n";
+    std::cout << "\t\t-----------------------------\n\n";
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    std::string username = readUsername();
+    int index = getUserIndexByName(username, vUsers);
+
+    processRemoving(index, vUsers);
+
+    std::cout << '\n';
+    returnToMenu(menu::MANAGE_USERS);
+}
+
+void findUser() {
+
+    std::cout << "\t\t-----------------------------\n";
+    std::cout << "\t\t\tFind User\n";
+    std::cout << "\t\t-----------------------------\n";
+
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    std::string username = readUsername();
+    int index = getUserIndexByName(username, vUsers);
+
+    if (isUserExistsByIndex(index)) {
+
+        printUserCard(vUsers[index]);
+    }
+
+    else
+        printUserNotFound(username);
+
+
+    returnToMenu(menu::MANAGE_USERS);
+}
+
+void applyManageUsersMenuChoice(eManageUsersMenu choice) {
+
+    if (audit::MANAGE_USERS_MENU_ACTIONS[choice] != AUDIT_NONE)
+        emitAuditEvent(audit::MANAGE_USERS_MENU_ACTIONS[choice]);
+
+    beginTraceOperation(TRACE_BANK_MANAGE_USERS, choice);
+
+    clearScreen();
+
+    switch (choice) {
+
+    case eManageUsersMenu::ADD_NEW_USER:
+
+        addUsers();
+        break;
+
+    case eManageUsersMenu::LIST_USERS:
+
+        showAllUsers();
+        break;
+
+    case eManageUsersMenu::UPDATE_USER:
+
+        updateUser();
+        break;
+
+    case eManageUsersMenu::REMOVE_USER:
+
+        removeUser();
+        break;
+
+    case eManageUsersMenu::FIND_USER:
+
+        findUser();
+        break;
+
+    case eManageUsersMenu::RETURN_TO_MAIN_MENU:
+
+        return;
+    }
+
+    endTraceOperation();
+}
+
+void manageUsers(const sUser& user) {
+
+    if (!checkPermissionAccess(user.permissions, ePermissions::MANAGE_USERS)) {
+
+        printAccessDenied();
+    }
+
+    else {
+
+        eManageUsersMenu choice;
+
+        do {
+
+            printManageUsersMenu();
+            choice = (eManageUsersMenu)readMenuChoice(1, 6);
+
+            applyManageUsersMenuChoice(choice);
+
+        } while (choice != eManageUsersMenu::RETURN_TO_MAIN_MENU);
+    }
+}
+
+void applyMainMenuChoice(eMainMenu choice, sUser& user) {
+
+    emitAuditEvent(audit::MAIN_MENU_ACTIONS[choice]);
+
+    beginTraceOperation(TRACE_BANK_MAIN, choice);
+
+    clearScreen();
+
+    switch (choice) {
+
+    case eMainMenu::MENU_ADD_CLIENT:
+
+        addClients(user);
+        break;
+
+    case eMainMenu::MENU_SHOW_ALL_CLIENTS:
+
+        showAllClients(user);
+        break;
+
+    case eMainMenu::MENU_UPDATE_CLIENT:
+
+        updateClient(user);
+        break;
+
+    case eMainMenu::MENU_REMOVE_CLIENT:
+
+        removeClient(user);
+        break;
+
+    case eMainMenu::MENU_FIND_CLIENT:
+
+        findClient(user);
+        break;
+
+    case eMainMenu::MENU_TRANSACTIONS:
+
+        Transactions(user);
+        break;
+
+    case eMainMenu::MENU_MANAGE_USERS:
+
+        manageUsers(user);
+        break;
+
+    case eMainMenu::MENU_LOGOUT:
+
+        endTraceOperation();
+
+        // logout is the durability point: everything the session changed is on disk after it
+        if (!flushPersistence())
+            printPersistenceWarnings();
+
+        flushAuditLog();
+
+        Login();
+        break;
+    }
+
+    endTraceOperation();
+}
+
+void startProgram(sUser& user) {
+
+    eMainMenu choice;
+
+    do {
+
+        printPersistenceWarnings();
+        printMainMenu();
+        choice = (eMainMenu)readMenuChoice(1, 8);
+
+        applyMainMenuChoice(choice, user);
+
+    } while (choice != eMainMenu::MENU_LOGOUT);
+}
+
+void Login() {
+
+    std::cout << "\t\t----------------------------\n";
+    std::cout << "\t\t\tLogin Screen\n";
+    std::cout << "\t\t----------------------------\n\n";
+
+    if (cache::usersIndex.empty())
+        loadUsersIndex();
+
+    sUser user;
+
+    while (true) {
+
+        std::string username = readUsername("Enter username:");
+        int password = readPositiveNum("Enter password:");
+
+        if (findUserByNameAndPassword(username, password, user))
+            break;
+
+        std::cout << "\nInvalid username/password\n";
+    };
+
+    setAuditOperator(user.name);
+    emitAuditEvent(AUDIT_LOGIN);
+
+    clearScreen();
+
+    startProgram(user);
+}
+
+void printGroupCommitStats() {
+
+    sGroupCommitStats stats;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+        stats = persistence::stats;
+    }
+
+    std::cout << "\nGroup Commit Stats\n";
+    std::cout << "Requests: " << stats.requests << ", Batches: " << stats.batches << ", Fsyncs: " << stats.fsyncs << '\n';
+    std::cout << "Average Batch Size: " << (stats.batches ? (double)stats.requests / stats.batches : 0);
+    std::cout << ", Max Batch Size: " << stats.maxBatchSize << '\n';
+
+    const std::string bucketLabels[8] = { "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64-127", "128+" };
+
+    for (int i = 0; i < 8; i++)
+        std::cout << "| " << std::setw(8) << bucketLabels[i] << "| " << stats.batchSizeBuckets[i] << '\n';
+
+    std::cout << "Client Mutations: " << stats.mutations << ", Coalesced: " << stats.coalescedMutations;
+    std::cout << ", File Rewrites: " << stats.mutationBatches << ", Dropped: " << stats.droppedMutations << '\n';
+}
+
+void runCommitBenchmark(int numOfThreads, int transactionsPerThread) {
+
+    std::vector <sClient> vClients = loadClientsFromFile();
+
+    if (vClients.empty()) {
+
+        std::cout << "No clients in " << file::CLIENTS_FILE << " to run the benchmark on\n";
+        return;
+    }
+
+    // deposits go to a scratch copy so the benchmark never touches real balances
+    const std::string benchFile = "COMMIT_BENCH.txt";
+
+    std::mutex clientsMutex;
+    std::vector <std::thread> vThreads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < numOfThreads; t++) {
+
+        vThreads.emplace_back([&, t] {
+
+            std::mt19937 generator(t);
+            std::uniform_int_distribution <size_t> pickClient(0, vClients.size() - 1);
+
+            for (int i = 0; i < transactionsPerThread; i++) {
+
+                std::string content;
+
+                {
+                    std::lock_guard <std::mutex> lock(clientsMutex);
+
+                    vClients[pickClient(generator)].balance += 1;
+                    content = clientsToFileContent(vClients);
+                }
+
+                commitToFile(benchFile, content);
+            }
+        });
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    std::remove(benchFile.c_str());
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+    int totalTransactions = numOfThreads * transactionsPerThread;
+
+    std::cout << totalTransactions << " durable deposits in " << seconds << "s ";
+    std::cout << "(" << (int)(totalTransactions / seconds) << " TPS) with " << numOfThreads << " thread(s)\n";
+
+    printGroupCommitStats();
+}
+
+void generateClientsFile(long long numOfClients, const std::string& fileName) {
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution <int> pickPincode(1000, 9999);
+    std::uniform_int_distribution <int> pickBalance(0, 500000);
+
+    const std::string firstNames[8] = { "Ahmed", "Mona", "Youssef", "Sara", "Omar", "Laila", "Karim", "Nour" };
+    const std::string lastNames[8] = { "Salah", "Hassan", "Ali", "Mostafa", "Ibrahim", "Adel", "Fathy", "Samir" };
+
+    std::string content;
+    bool isAppend = false;
+
+    for (long long i = 0; i < numOfClients; i++) {
+
+        sClient client;
+
+        client.accountNum = "A" + std::to_string(100000 + i);
+        client.pincode = pickPincode(generator);
+        client.name = firstNames[generator() % 8] + " " + lastNames[generator() % 8];
+        client.phoneNum = "010" + std::to_string(10000000 + generator() % 90000000);
+        client.balance = pickBalance(generator);
+
+        content += clientRecordToLine(client) + '\n';
+
+        if (content.size() > (1 << 22)) {
+
+            writeFileDurably(fileName, content, isAppend);
+            content.clear();
+
+            isAppend = true;
+        }
+    }
+
+    writeFileDurably(fileName, content, isAppend);
+
+    std::cout << "Generated " << numOfClients << " client(s) in " << fileName << '\n';
+}
+
+void printLoadReport(const std::string& fileName) {
+
+    auto measure = [](auto load, double& seconds) {
+
+        auto start = std::chrono::steady_clock::now();
+        auto result = load();
+        seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+        return result;
+    };
+
+    double recordSeconds, tableSeconds;
+    size_t recordCount, tableCount, recordResident, tableResident, recordAllocations, tableAllocations;
+
+    {
+        std::vector <sClient> vClients = measure([&] { return loadClientsFromFile(fileName); }, recordSeconds);
+
+        recordCount = vClients.size();
+        recordResident = getClientsResidentBytes(vClients);
+        recordAllocations = getClientsAllocations(vClients);
+    }
+
+    {
+        sClientTable table = measure([&] { return loadClientTable(fileName); }, tableSeconds);
+
+        tableCount = table.vClients.size();
+        tableResident = getTableResidentBytes(table);
+        tableAllocations = getTableAllocations(table);
+    }
+
+    std::cout << "\nLoad Report [" << fileName << "]\n\n";
+    std::cout << std::left;
+    std::cout << "| " << std::setw(22) << "Loader" << "| " << std::setw(10) << "Records";
+    std::cout << "| " << std::setw(15) << "Resident Bytes" << "| " << std::setw(12) << "Allocations" << "| " << std::setw(10) << "Seconds" << '\n';
+
+    std::cout << "| " << std::setw(22) << "loadClientsFromFile" << "| " << std::setw(10) << recordCount;
+    std::cout << "| " << std::setw(15) << recordResident << "| " << std::setw(12) << recordAllocations << "| " << std::setw(10) << recordSeconds << '\n';
+
+    std::cout << "| " << std::setw(22) << "loadClientTable" << "| " << std::setw(10) << tableCount;
+    std::cout << "| " << std::setw(15) << tableResident << "| " << std::setw(12) << tableAllocations << "| " << std::setw(10) << tableSeconds << '\n';
+}
+
+// one hash set for the store and the batch, one append for all the accepted lines, one index rebuild
+void importClients(const std::string& sourceFileName) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::string source = readFileContent(sourceFileName);
+
+    if (source.empty()) {
+
+        std::cout << "Nothing to import from " << sourceFileName << '\n';
+        return;
+    }
+
+    // queued rewrites have to reach the disk first, the duplicate check reads the file itself
+    flushPersistence();
+
+    std::string existing = readFileContent(file::CLIENTS_FILE);
+
+    std::unordered_map <std::string_view, bool> accountNums;     // account number -> came from the store
+
+    accountNums.reserve((std::count(existing.begin(), existing.end(), '\n') + std::count(source.begin(), source.end(), '\n') + 2) * 10 / 7);
+
+    for (std::string_view content = existing; !content.empty();) {
+
+        size_t lineEnd = content.find('\n');
+        size_t keyEnd = content.find(SEPARATOR);
+
+        if (keyEnd < lineEnd)
+            accountNums.emplace(content.substr(0, keyEnd), true);
+
+        content.remove_prefix((lineEnd == std::string_view::npos) ? content.size() : lineEnd + 1);
+    }
+
+    std::string accepted, rejects;
+    long long numOfLines = 0, numOfAccepted = 0, numOfMalformed = 0, numOfInStore = 0, numOfInBatch = 0;
+
+    if (!existing.empty() && existing.back() != '\n')
+        accepted += '\n';
+
+    for (std::string_view content = source; !content.empty();) {
+
+        size_t lineEnd = content.find('\n');
+        std::string_view line = content.substr(0, lineEnd);
+
+        content.remove_prefix((lineEnd == std::string_view::npos) ? content.size() : lineEnd + 1);
+        numOfLines++;
+
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        if (line.empty())
+            continue;
+
+        sClientView client;
+        std::string reason;
+
+        if (!clientLineToView(line, client) || client.accountNum.empty()) {
+
+            reason = "Malformed line";
+            numOfMalformed++;
+        }
+
+        else {
+
+            auto inserted = accountNums.emplace(client.accountNum, false);
+
+            if (inserted.second) {
+
+                size_t lineStart = accepted.size();
+
+                accepted.append(line.data(), line.size());
+
+                if (!hasLineChecksum(line))
+                    appendLineChecksum(accepted, lineStart);
+
+                accepted += '\n';
+                numOfAccepted++;
+                continue;
+            }
+
+            if (inserted.first->second) {
+
+                reason = "Already in " + file::CLIENTS_FILE;
+                numOfInStore++;
+            }
+
+            else {
+
+                reason = "Duplicate within the batch";
+                numOfInBatch++;
+            }
+        }
+
+        rejects += std::to_string(numOfLines) + SEPARATOR + reason + SEPARATOR;
+        rejects.append(line.data(), line.size());
+        rejects += '\n';
+    }
+
+    if (numOfAccepted > 0) {
+
+        cache::isOwnClientsWrite = true;
+
+        // the next report builds a fresh version with the new clients in it; the append adds their CLIENTS.idx slots
+        dropClientsVersion();
+
+        if (!commitToFile(file::CLIENTS_FILE, accepted, true)) {
+
+            std::cout << "Couldn't write " << file::CLIENTS_FILE << ", nothing was imported\n";
+            return;
+        }
+    }
+
+    commitToFile(file::IMPORT_REJECTS_FILE, rejects);
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Imported " << numOfAccepted << " of " << numOfLines << " line(s) from " << sourceFileName << '\n';
+    std::cout << "Rejected: " << numOfMalformed << " malformed, " << numOfInStore << " already in " << file::CLIENTS_FILE;
+    std::cout << ", " << numOfInBatch << " duplicate(s) within the batch";
+
+    if (!rejects.empty())
+        std::cout << " (see " << file::IMPORT_REJECTS_FILE << ")";
+
+    std::cout << "\nTook " << seconds << "s, " << (long long)(numOfLines / std::max(seconds, 1e-9)) << " lines/s\n";
+}
+
+void exportSnapshot(const std::string& fileName) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    sClientTable table = loadClientTable();
+    std::vector <sUser> vUsers = loadUsersFromFile();
+
+    std::string encoded = encodeSnapshot(table, vUsers);
+
+    if (!commitToFile(fileName, encoded)) {
+
+        std::cout << "Couldn't write snapshot to " << fileName << '\n';
+        return;
+    }
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+    size_t textBytes = readFileContent(file::CLIENTS_FILE).size() + readFileContent(file::USERS_FILE).size();
+
+    std::cout << "Exported " << table.vClients.size() << " client(s) and " << vUsers.size() << " user(s) to " << fileName << " in " << seconds << "s\n";
+    std::cout << "Text Bytes: " << textBytes << ", Snapshot Bytes: " << encoded.size();
+    std::cout << ", Ratio: " << (encoded.empty() ? 0 : (double)textBytes / encoded.size()) << "x\n";
+}
+
+void restoreSnapshot(const std::string& fileName) {
+
+    std::fstream file;
+
+    file.open(fileName, std::ios::in | std::ios::binary);
+
+    if (!file.is_open()) {
+
+        std::cout << "Couldn't open snapshot " << fileName << '\n';
+        return;
+    }
+
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+
+    std::string encoded = buffer.str();
+
+    file.close();
+
+    auto start = std::chrono::steady_clock::now();
+
+    sSnapshotData data;
+
+    if (!decodeSnapshot(encoded, data)) {
+
+        std::cout << "Snapshot " << fileName << " is corrupted, nothing was restored\n";
+        return;
+    }
+
+    double decodeSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string clientsContent;
+    clientsContent.reserve(data.vAccountNums.size() * 80);
+
+    for (size_t i = 0; i < data.vAccountNums.size(); i++) {
+
+        sClient client;
+
+        client.accountNum = std::move(data.vAccountNums[i]);
+        client.pincode = data.vPincodes[i];
+        client.name = std::move(data.vNames[i]);
+        client.phoneNum = std::move(data.vPhones[i]);
+        client.balance = data.vBalances[i];
+
+        clientsContent += clientRecordToLine(client) + '\n';
+    }
+
+    bool isRestored = commitToFile(file::CLIENTS_FILE, clientsContent);
+    isRestored = commitToFile(file::USERS_FILE, usersToFileContent(data.vUsers)) && isRestored;
+
+    buildUsersIndex(data.vUsers);
+
+    double totalSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    size_t parsedClients = loadClientTable().vClients.size();
+    double parseSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!isRestored)
+        std::cout << "Restore from " << fileName << " failed while writing the data files\n";
+
+    std::cout << "Restored " << data.vBalances.size() << " client(s) and " << data.vUsers.size() << " user(s) from " << fileName << '\n';
+    std::cout << "Decode: " << decodeSeconds << "s, Decode + Write: " << totalSeconds << "s, ";
+    std::cout << "Text Parse of " << parsedClients << " client(s): " << parseSeconds << "s\n";
+}
+
+bool parseAmount(const std::string& text, float& amount) {
+
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), amount);
+
+    return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size() && std::isfinite(amount) && amount > 0;
+}
+
+int runHeadlessTransfer(const std::string& fromAccountNum, const std::string& toAccountNum, float amount) {
+
+    sClient fromClient, toClient;
+
+    if (!findClientCached(fromAccountNum, fromClient) || !findClientCached(toAccountNum, toClient)) {
+
+        printClientNotFound(fromClient.accountNum.empty() ? fromAccountNum : toAccountNum);
+        return 1;
+    }
+
+    if (!saveTransfer(fromClient, toClient, amount)) {
+
+        std::cout << "Transfer rejected: same account, invalid amount or insufficient balance\n";
+        return 1;
+    }
+
+    if (!flushPersistence()) {
+
+        std::cout << "Transfer couldn't be saved\n";
+        return 1;
+    }
+
+    std::cout << "Transferred $" << amount << " from [" << fromAccountNum << "] to [" << toAccountNum << "]\n";
+
+    return 0;
+}
+
+void printClientCacheStats() {
+
+    long long lookups = cache::clientHits + cache::clientMisses;
+
+    std::cout << "\nClient Cache Stats\n";
+    std::cout << "Cached: " << cache::hotClients.size() << " / " << settings::clientCacheCapacity;
+    std::cout << ", Hits: " << cache::clientHits << ", Misses: " << cache::clientMisses;
+    std::cout << ", Hit Rate: " << std::fixed << std::setprecision(2) << (lookups ? 100.0 * cache::clientHits / lookups : 0) << "%\n";
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+void runClientCacheBenchmark(int numOfHotClients, int numOfLookups) {
+
+    std::vector <std::string> vAccountNums;
+
+    {
+        sClientTable table = loadClientTable();
+
+        for (const sPackedClient& record : table.vClients)
+            vAccountNums.push_back(std::string(unpackClient(table, record).accountNum));
+    }
+
+    if (vAccountNums.empty()) {
+
+        std::cout << "No clients in " << file::CLIENTS_FILE << '\n';
+        return;
+    }
+
+    std::mt19937 random(42);
+    std::vector <std::string> vHotAccountNums;
+
+    for (int i = 0; i < numOfHotClients; i++)
+        vHotAccountNums.push_back(vAccountNums[random() % vAccountNums.size()]);
+
+    sClient client;
+
+    // first touch of every hot account goes to storage
+    auto start = std::chrono::steady_clock::now();
+
+    for (const std::string& accountNum : vHotAccountNums)
+        findClientCached(accountNum, client);
+
+    double missSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < numOfLookups; i++)
+        findClientCached(vHotAccountNums[i % vHotAccountNums.size()], client);
+
+    double hitSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Clients: " << vAccountNums.size() << ", Hot Accounts: " << numOfHotClients << '\n';
+    std::cout << "Cold Lookup: " << missSeconds * 1e6 / numOfHotClients << " us\n";
+    std::cout << "Hot Lookup: " << hitSeconds * 1e9 / numOfLookups << " ns\n";
+
+    printClientCacheStats();
+}
+
+double sumVersionBalances(const sClientsVersion& version) {
+
+    double total = 0;
+
+    for (const std::shared_ptr <const sClientPageDirectory>& directory : version.vDirectories) {
+
+        for (const std::shared_ptr <const sClientPage>& page : directory->pages) {
+
+            if (!page)
+                break;
+
+            for (const sPackedClient& record : page->records)
+                total += record.balance;
+        }
+    }
+
+    return total;
+}
 
-    user.name = readUsername();
-    int index = getUserIndexByName(user.name, vUsers);
+// writers transfer between random accounts while a reporter sums the whole table: no reports, snapshot reports, locking reports
+void runSnapshotBenchmark(int numOfWriters, double seconds) {
 
-    while ((isUserExistsByIndex(index))) {
+    std::shared_ptr <const sClientsVersion> first = getClientsSnapshot();
 
-        std::cout << "\nUser is already added, ";
-        user.name = readUsername("Enter a valid username:");
+    if (first->count < 2) {
+
+        std::cout << "Need at least 2 clients in " << file::CLIENTS_FILE << '\n';
+        return;
     }
 
-    user.password = readPositiveNum("Enter password:");
-    user.permissions = readPermissionsToSet();
+    std::vector <std::string> vAccountNums(first->count);
 
-    return user;
-}
+    for (const auto& entry : *first->positions)
+        vAccountNums[entry.second] = entry.first;
 
+    // padding records are zero, so the expected total is the sum of the real balances
+    const double expectedTotal = sumVersionBalances(*first);
 
-// helper functions (definition)
+    first.reset();
 
-void addClient(const std::vector <sClient>& vClients) {
+    const std::string modes[3] = { "No Reports", "Snapshot Reports", "Locking Reports" };
 
-    sClient client = readClientData(vClients);
-    addLineToFile(clientRecordToLine(client), file::CLIENTS_FILE);
-}
+    std::cout << "Clients: " << vAccountNums.size() << ", Writers: " << numOfWriters << ", " << seconds << "s per mode\n\n";
+    std::cout << std::left << std::setw(20) << "Mode" << std::setw(14) << "Transfers" << std::setw(12) << "p50 (us)";
+    std::cout << std::setw(12) << "p99 (us)" << std::setw(12) << "p999 (us)" << std::setw(10) << "Reports" << "Inconsistent\n";
 
-int getClientIndexByAccountNum(const std::string& accountNum, const std::vector <sClient>& vClients) {
+    for (int mode = 0; mode < 3; mode++) {
 
-    int index = 0;
+        std::atomic <bool> isRunning(true);
+        std::vector <std::vector <double>> vLatencies(numOfWriters);
+        std::vector <std::thread> vThreads;
 
-    for (const sClient& client : vClients) {
+        long long numOfReports = 0, numOfInconsistent = 0;
 
-        if (client.accountNum != accountNum)
-            index++;
+        for (int w = 0; w < numOfWriters; w++) {
 
-        else
-            return index;
+            vThreads.emplace_back([&, w]() {
+
+                std::mt19937 random(w + 1);
+
+                while (isRunning) {
+
+                    const std::string& from = vAccountNums[random() % vAccountNums.size()];
+                    const std::string& to = vAccountNums[random() % vAccountNums.size()];
+
+                    auto start = std::chrono::steady_clock::now();
+
+                    applyBalanceDeltas({ { from, -1.0f }, { to, 1.0f } });
+
+                    vLatencies[w].push_back(std::chrono::duration <double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                }
+            });
+        }
+
+        if (mode > 0) {
+
+            vThreads.emplace_back([&]() {
+
+                while (isRunning) {
+
+                    double total;
+
+                    if (mode == 1) {
+
+                        total = sumVersionBalances(*std::atomic_load(&mvcc::current));
+                    }
+
+                    // what a single-version store has to do: keep writers out for the whole scan
+                    else {
+
+                        std::lock_guard <std::mutex> lock(mvcc::writeMutex);
+                        total = sumVersionBalances(*std::atomic_load(&mvcc::current));
+                    }
+
+                    numOfReports++;
+
+                    if (total != expectedTotal)
+                        numOfInconsistent++;
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration <double>(seconds));
+        isRunning = false;
+
+        for (std::thread& thread : vThreads)
+            thread.join();
+
+        std::vector <double> vAll;
+
+        for (const std::vector <double>& vWriter : vLatencies)
+            vAll.insert(vAll.end(), vWriter.begin(), vWriter.end());
+
+        std::sort(vAll.begin(), vAll.end());
+
+        double p50 = vAll.empty() ? 0 : vAll[vAll.size() / 2];
+        double p99 = vAll.empty() ? 0 : vAll[std::min(vAll.size() - 1, vAll.size() * 99 / 100)];
+        double p999 = vAll.empty() ? 0 : vAll[std::min(vAll.size() - 1, vAll.size() * 999 / 1000)];
+
+        std::cout << std::setw(20) << modes[mode] << std::setw(14) << vAll.size() << std::fixed << std::setprecision(2);
+        std::cout << std::setw(12) << p50 << std::setw(12) << p99 << std::setw(12) << p999 << std::setw(10) << numOfReports << numOfInconsistent << '\n';
+        std::cout << std::defaultfloat << std::setprecision(6);
     }
 
-    return CLIENT_NOT_FOUND;
+    std::cout << std::right;
 }
 
-sClient clientLineToRecord(const std::string& line) {
+// the headless report works on the packed table straight from the load, without building a version
+void runAnalyticsReport(int topN, int numOfThreads, const std::string& fileName) {
 
-    std::vector <std::string> vRecord = splitText(line, SEPARATOR);
+    auto start = std::chrono::steady_clock::now();
 
-    sClient client;
+    sClientTable table = loadClientTable(fileName);
 
-    client.accountNum = vRecord[0];
-    client.pincode = std::stoi(vRecord[1]);
-    client.name = vRecord[2];
-    client.phoneNum = vRecord[3];
-    client.balance = std::stod(vRecord[4]);
+    double loadSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
 
-    return client;
+    std::vector <std::pair <const sPackedClient*, size_t>> vSpans;
+
+    for (size_t first = 0; first < table.vClients.size(); first += mvcc::PAGE_RECORDS)
+        vSpans.push_back({ table.vClients.data() + first, std::min(mvcc::PAGE_RECORDS, table.vClients.size() - first) });
+
+    sBalanceAnalytics analytics = computeBalanceAnalytics(vSpans, topN, numOfThreads);
+
+    printBalanceAnalytics(analytics, table.pool);
+
+    std::cout << "\nLoad: " << loadSeconds << "s, Compute: " << analytics.seconds << "s on " << numOfThreads << " thread(s)\n";
 }
 
-sUser userLineToRecord(const std::string& line) {
+// producer-side cost only: the writer drains into a scratch file in the background
+void runAuditBenchmark(int numOfThreads, int eventsPerThread) {
 
-    std::vector <std::string> vUser = splitText(line, SEPARATOR);
+    const std::string benchFileName = "AUDIT_BENCH.dat";
 
-    sUser user;
+    std::remove(benchFileName.c_str());
 
-    user.name = vUser[0];
-    user.password = std::stoi(vUser[1]);
-    user.permissions = std::stoi(vUser[2]);
+    setAuditOperator("#bench");
+    startAuditWriter(benchFileName);
 
-    return user;
-}
+    // one lap to fault in the ring's pages, so first touches aren't counted as producer cost
+    for (size_t i = 0; i < audit::QUEUE_CAPACITY; i++)
+        emitAuditEvent(AUDIT_DEPOSIT, "A100000", 0, true);
 
-std::string clientRecordToLine(const sClient& client) {
+    flushAuditLog();
 
-    std::string line = "";
+    long long fullWaitsBefore = audit::fullWaits.load();
 
-    line += client.accountNum + SEPARATOR;
-    line += std::to_string(client.pincode) + SEPARATOR;
-    line += client.name + SEPARATOR;
-    line += client.phoneNum + SEPARATOR;
-    line += std::to_string(client.balance);
+    std::vector <double> vNanosPerEvent(numOfThreads);
+    std::vector <std::thread> vThreads;
 
-    return line;
-}
+    auto start = std::chrono::steady_clock::now();
 
-std::string userRecordToLine(const sUser& user) {
+    for (int t = 0; t < numOfThreads; t++) {
 
-    std::string line = "";
+        vThreads.emplace_back([&, t]() {
 
-    line += user.name + SEPARATOR;
-    line += std::to_string(user.password) + SEPARATOR;
-    line += std::to_string(user.permissions);
+            auto threadStart = std::chrono::steady_clock::now();
 
-    return line;
-}
+            for (int i = 0; i < eventsPerThread; i++)
+                emitAuditEvent(AUDIT_DEPOSIT, "A100000", (float)i, true);
 
-void returnToMenu(const std::string& menu) {
+            vNanosPerEvent[t] = std::chrono::duration <double, std::nano>(std::chrono::steady_clock::now() - threadStart).count() / eventsPerThread;
+        });
+    }
 
-    std::cout << "\nPress any key to return to " << menu << "...";
-    system("pause>0");
+    for (std::thread& thread : vThreads)
+        thread.join();
 
-    clearScreen();
+    double emitSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    flushAuditLog();
+
+    double totalSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    long long numOfEvents = (long long)numOfThreads * eventsPerThread;
+
+    std::cout << "Threads: " << numOfThreads << ", Events: " << numOfEvents << '\n';
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Producer: " << *std::min_element(vNanosPerEvent.begin(), vNanosPerEvent.end()) << " - ";
+    std::cout << *std::max_element(vNanosPerEvent.begin(), vNanosPerEvent.end()) << " ns/event per thread, ";
+    std::cout << numOfEvents / emitSeconds / 1e6 << "M events/s overall\n";
+    std::cout << "Writer: all events on disk after " << totalSeconds << "s, " << audit::fullWaits.load() - fullWaitsBefore << " event(s) waited on a full queue\n";
+    std::cout << std::defaultfloat << std::setprecision(6);
+
+    std::remove(benchFileName.c_str());
 }
 
-void processUpdating(const std::string& accountNum, std::vector <sClient>& vClients) {
+// every account gets +1 then -1, so balances end where they started
+void runMutationBenchmark(int numOfUpdates) {
 
-    int index = getClientIndexByAccountNum(accountNum, vClients);
+    std::vector <std::string> vAccountNums;
 
-    if (isClientExistsByIndex(index)) {
+    {
+        sClientTable table = loadClientTable();
 
-        printClientCard(vClients[index]);
+        for (const sPackedClient& record : table.vClients)
+            vAccountNums.push_back(std::string(unpackClient(table, record).accountNum));
+    }
 
-        char sureToUpdate = readChar("\nAre you sure you want to update client data (Y/N):");
+    if (vAccountNums.empty()) {
 
-        if (toupper(sureToUpdate) == 'Y') {
+        std::cout << "No clients in " << file::CLIENTS_FILE << " to run the benchmark on\n";
+        return;
+    }
 
-            std::cout << '\n';
+    std::mt19937 random(7);
+    sGroupCommitStats before;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+        before = persistence::stats;
+    }
+
+    std::vector <double> vLatencies;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < numOfUpdates; i += 2) {
+
+        const std::string& accountNum = vAccountNums[random() % vAccountNums.size()];
+
+        for (float delta : { 1.0f, -1.0f }) {
+
+            auto updateStart = std::chrono::steady_clock::now();
+
+            sClient client;
+
+            if (findClientCached(accountNum, client)) {
 
-            readUpdatedClientData(vClients[index]);
-            saveClientsToFile(vClients);
+                client.balance += delta;
+                submitClientMutation(client, true, delta);
+            }
+
+            vLatencies.push_back(std::chrono::duration <double, std::micro>(std::chrono::steady_clock::now() - updateStart).count());
         }
     }
 
-    else
-        printClientNotFound(accountNum);
+    double queueSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    flushPersistence();
+
+    double totalSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    sGroupCommitStats after;
+
+    {
+        std::lock_guard <std::mutex> lock(persistence::queueMutex);
+        after = persistence::stats;
+    }
+
+    // what each confirmation used to cost: load the whole list, change one record, serialize it all again
+    const int numOfRewrites = 4;
+
+    auto rewriteStart = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < numOfRewrites; i++) {
+
+        std::vector <sClient> vClients = loadClientsFromFile();
+
+        vClients[0].balance += (i % 2 == 0) ? 1.0f : -1.0f;
+        saveClientsToFile(vClients);
+    }
+
+    double rewriteSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - rewriteStart).count();
+
+    flushPersistence();
+
+    std::sort(vLatencies.begin(), vLatencies.end());
+
+    std::cout << "Clients: " << vAccountNums.size() << ", Updates: " << vLatencies.size() << '\n';
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Mutation queue: p50 " << vLatencies[vLatencies.size() / 2] << " us, p99 " << vLatencies[vLatencies.size() * 99 / 100];
+    std::cout << " us, max " << vLatencies.back() / 1000 << " ms per confirmation (the max includes backpressure waits)\n";
+    std::cout << queueSeconds << "s to queue, " << totalSeconds << "s until on disk\n";
+    std::cout << "Coalesced: " << after.coalescedMutations - before.coalescedMutations << ", File rewrites: " << after.mutationBatches - before.mutationBatches << '\n';
+    std::cout << "Full list rewrite: " << rewriteSeconds / numOfRewrites * 1000 << " ms per confirmation\n";
+    std::cout << std::defaultfloat << std::setprecision(6);
 }
 
-void processRemoving(const std::string& accountNum, std::vector <sClient>& vClients) {
+// add, remove and re-add one client inside a single commit window: the file must end up with the re-added record only
+bool runMutationOrderCheck() {
 
-    int index = getClientIndexByAccountNum(accountNum, vClients);
+    const std::string accountNum = "~MUTATION-ORDER-CHECK";
+    const int savedMaxWaitMs = settings::groupCommitMaxWaitMs;
 
-    if (isClientExistsByIndex(index)) {
+    size_t numOfClientsBefore = loadClientsFromFile().size();
 
-        printClientCard(vClients[index]);
+    sClient client;
 
-        char sureToUpdate = readChar("\nAre you sure you want to remove client (Y/N):");
+    client.accountNum = accountNum;
+    client.pincode = 1111;
+    client.name = "Mutation Order Check";
+    client.phoneNum = "0";
+    client.balance = 1;
 
-        if (toupper(sureToUpdate) == 'Y') {
+    settings::groupCommitMaxWaitMs = 300;
 
-            vClients[index].isDeleted = true;
-            saveClientsToFile(vClients);
-            vClients = loadClientsFromFile();
-        }
+    addLineToFile(clientRecordToLine(client), file::CLIENTS_FILE);
+
+    client.isDeleted = true;
+    submitClientMutation(client);
+
+    client.isDeleted = false;
+    client.balance = 2;
+    addLineToFile(clientRecordToLine(client), file::CLIENTS_FILE);
+
+    flushPersistence();
+
+    settings::groupCommitMaxWaitMs = savedMaxWaitMs;
+
+    std::vector <sClient> vClients = loadClientsFromFile();
+    std::vector <float> vBalances;
+
+    for (const sClient& stored : vClients) {
+
+        if (stored.accountNum == accountNum)
+            vBalances.push_back(stored.balance);
     }
 
-    else
-        printClientNotFound(accountNum);
+    bool isPassed = vClients.size() == numOfClientsBefore + 1 && vBalances.size() == 1 && vBalances[0] == 2;
+
+    std::cout << "Remove -> re-add: " << vBalances.size() << " record(s) of the client, " << vClients.size() << " of ";
+    std::cout << numOfClientsBefore + 1 << " client(s) expected, " << (isPassed ? "passed" : "FAILED") << '\n';
+
+    // leaves the file as it was
+    client.isDeleted = true;
+    submitClientMutation(client);
+    flushPersistence();
+
+    return isPassed;
 }
 
-bool confirmTransaction(int amount, float& balance, bool isDeposit) {
+// re-executes one captured operation the way its screen does, minus the console; false when it can't be replayed
+bool replayTraceRecord(const sTraceRecord& record) {
 
-    if (!isDeposit) {
+    std::string accountNum(record.accountNum, strnlen(record.accountNum, sizeof(record.accountNum)));
+    std::string otherAccountNum(record.otherAccountNum, strnlen(record.otherAccountNum, sizeof(record.otherAccountNum)));
 
-        while (amount > balance) {
+    sClient client;
 
-            std::cout << "\nWithdraw Amount is more than your balance, ";
-            std::cout << "Current Balance --> $" << balance << '\n';
+    if (record.menu == TRACE_BANK_MAIN) {
 
-            amount = readPositiveNum("Enter valid withdraw amount:", " $");
+        switch (record.choice) {
+
+        case eMainMenu::MENU_SHOW_ALL_CLIENTS: {
+
+            std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+            size_t length = 0;
+
+            for (size_t i = 0; i < snapshot->count; i++)
+                length += getVersionClient(*snapshot, i).name.size();
+
+            trace::replaySink = length;
+            return true;
         }
 
-        amount *= -1;
+        case eMainMenu::MENU_UPDATE_CLIENT:
+
+            // rewritten with the values it already has: the write path runs, the data doesn't change
+            if (findClientCached(accountNum, client)) {
+
+                submitClientMutation(client);
+                dropClientsVersion();
+            }
+
+            return true;
+
+        // a replayed removal would leave later operations without their client, only its lookup runs
+        case eMainMenu::MENU_REMOVE_CLIENT:
+        case eMainMenu::MENU_FIND_CLIENT:
+
+            findClientCached(accountNum, client);
+            return true;
+
+        case eMainMenu::MENU_LOGOUT:
+
+            flushPersistence();
+            return true;
+        }
+
+        // added clients would collide with the ones already in the data
+        return false;
     }
 
-    char confirm = readChar("\nAre you sure you want to do this transaction (Y/N):");
+    if (record.menu == TRACE_BANK_TRANSACTIONS) {
 
-    if (toupper(confirm) == 'Y') {
+        switch (record.choice) {
 
-        balance += amount;
+        case eTransactionsMenu::TRANSAC_DEPOSIT:
+        case eTransactionsMenu::TRANSAC_WITHDRAW:
 
-        std::cout << "\nNew Account Balance: $" << balance << '\n';
+            // a zero amount is a session that looked the client up and didn't confirm
+            if (findClientCached(accountNum, client) && record.amount != 0) {
 
-        return true;
+                client.balance += record.amount;
+                saveClientTransaction(client, record.amount, record.choice == eTransactionsMenu::TRANSAC_DEPOSIT);
+            }
+
+            return true;
+
+        case eTransactionsMenu::TRANSAC_TRANSFER: {
+
+            sClient toClient;
+
+            if (findClientCached(accountNum, client) && findClientCached(otherAccountNum, toClient))
+                saveTransfer(client, toClient, record.amount);
+
+            return true;
+        }
+
+        case eTransactionsMenu::TRANSAC_SHOW_ALL_BALANCES: {
+
+            std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+            double totalBalance = 0;
+
+            for (size_t i = 0; i < snapshot->count; i++)
+                totalBalance += getVersionClient(*snapshot, i).balance;
+
+            trace::replaySink = (size_t)totalBalance;
+            return true;
+        }
+
+        case eTransactionsMenu::TRANSAC_MINI_STATEMENT:
+
+            // zero is a date-range statement, read as the whole history
+            trace::replaySink = readAccountHistory(accountNum, (record.amount > 0) ? (size_t)record.amount : SIZE_MAX).size();
+            return true;
+
+        case eTransactionsMenu::TRANSAC_ANALYTICS: {
+
+            std::shared_ptr <const sClientsVersion> snapshot = getClientsSnapshot();
+
+            int numOfThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+            trace::replaySink = computeBalanceAnalytics(getVersionSpans(*snapshot), std::max(1, (int)record.amount), numOfThreads).count;
+            return true;
+        }
+        }
     }
 
+    // user management isn't on the hot path, and ATM operations belong to ATM_System --replay
     return false;
 }
 
-bool isClientExistsByIndex(int index) {
+double parseReplaySpeed(const std::string& speed) {
+
+    if (speed == "max")
+        return 0;
 
-    return (index != CLIENT_NOT_FOUND);
+    if (speed == "original")
+        return 1;
+
+    return std::max(0.0, std::stod(speed));
 }
 
-bool isUserExistsByIndex(int index) {
+// one row per operation, sorted by name, plus a Total row over all of them
+std::vector <sReplayResult> summarizeReplay(std::map <std::string, std::vector <double>>& latencies) {
 
-    return (index != USER_NOT_FOUND);
+    auto summarize = [](const std::string& operation, std::vector <double>& vLatencies) {
+
+        std::sort(vLatencies.begin(), vLatencies.end());
+
+        sReplayResult result;
+
+        result.operation = operation;
+        result.count = vLatencies.size();
+        result.p50 = vLatencies[vLatencies.size() / 2];
+        result.p99 = vLatencies[std::min(vLatencies.size() - 1, vLatencies.size() * 99 / 100)];
+        result.max = vLatencies.back();
+
+        for (double latency : vLatencies)
+            result.mean += latency;
+
+        result.mean /= vLatencies.size();
+
+        return result;
+    };
+
+    std::vector <sReplayResult> vResults;
+    std::vector <double> vAll;
+
+    for (auto& entry : latencies) {
+
+        vAll.insert(vAll.end(), entry.second.begin(), entry.second.end());
+        vResults.push_back(summarize(entry.first, entry.second));
+    }
+
+    if (!vAll.empty())
+        vResults.push_back(summarize("Total", vAll));
+
+    return vResults;
 }
 
-int getUserIndexByName(const std::string& username, const std::vector <sUser>& vUsers) {
+void printReplayResults(const std::vector <sReplayResult>& vResults) {
 
-    int index = 0;
+    std::cout << std::left << std::setw(20) << "Operation" << std::right << std::setw(10) << "Count" << std::setw(12) << "p50 (us)";
+    std::cout << std::setw(12) << "p99 (us)" << std::setw(12) << "Max (us)" << std::setw(12) << "Mean (us)" << '\n';
 
-    for (const sUser& user : vUsers) {
+    std::cout << std::fixed << std::setprecision(1);
 
-        if (user.name != username)
-            index++;
+    for (const sReplayResult& result : vResults) {
 
-        else
-            return index;
+        std::cout << std::left << std::setw(20) << result.operation << std::right << std::setw(10) << result.count << std::setw(12) << result.p50;
+        std::cout << std::setw(12) << result.p99 << std::setw(12) << result.max << std::setw(12) << result.mean << '\n';
     }
 
-    return USER_NOT_FOUND;
+    std::cout << std::defaultfloat << std::setprecision(6);
 }
 
-void processRemoving(int index, std::vector <sUser>& vUsers) {
+std::string replayResultsToFileContent(const std::vector <sReplayResult>& vResults) {
 
-    if (isUserExistsByIndex(index)) {
+    std::string content;
 
-        if (isAdmin(vUsers[index].permissions))
-            std::cout << "\nYou can't delete this user\n";
+    for (const sReplayResult& result : vResults) {
 
-        else {
+        content += result.operation + SEPARATOR + std::to_string(result.count) + SEPARATOR + std::to_string(result.p50) + SEPARATOR;
+        content += std::to_string(result.p99) + SEPARATOR + std::to_string(result.max) + SEPARATOR + std::to_string(result.mean) + '\n';
+    }
 
-            printUserCard(vUsers[index]);
+    return content;
+}
 
-            char sureToDelete = readChar("\nAre you sure you want to delete this user (Y/N):");
+std::vector <sReplayResult> loadReplayResults(const std::string& fileName) {
 
-            if (toupper(sureToDelete) == 'Y') {
+    std::vector <sReplayResult> vResults;
+    std::istringstream content(readFileContent(fileName));
+    std::string line;
 
-                vUsers[index].isDeleted = true;
-                saveUsersToFile(vUsers);
-                vUsers = loadUsersFromFile();
+    while (std::getline(content, line)) {
 
-                std::cout << "\nUser Deleted Successfully!\n";
-            }
+        std::vector <std::string> vFields = splitText(line, SEPARATOR);
 
-            else
-                printUserNotFound(vUsers[index].name);
-        }
+        if (vFields.size() < 6)
+            continue;
+
+        sReplayResult result;
+
+        result.operation = vFields[0];
+        result.count = std::stoull(vFields[1]);
+        result.p50 = std::stod(vFields[2]);
+        result.p99 = std::stod(vFields[3]);
+        result.max = std::stod(vFields[4]);
+        result.mean = std::stod(vFields[5]);
 
+        vResults.push_back(result);
     }
+
+    return vResults;
 }
 
-void processUpdating(int index, std::vector <sUser> vUsers) {
+// speed 1 keeps the captured gaps between operations, 0 runs them back to back, anything else divides the gaps by it
+void runReplay(const std::string& traceFile, double speed, const std::string& resultsFile) {
 
-    if (isUserExistsByIndex(index)) {
+    std::vector <sTraceRecord> vRecords = loadTraceFile(traceFile);
 
-        if (isAdmin(vUsers[index].permissions))
-            std::cout << "\nYou can't update info of this user !\n";
+    if (vRecords.empty()) {
 
-        else {
+        std::cout << "No operations in " << traceFile << '\n';
+        return;
+    }
 
-            printUserCard(vUsers[index]);
+    // replayed changes are audited like the session's were
+    startAuditWriter();
+    setAuditOperator("replay");
 
-            char sureToUpdate = readChar("\nAre you sure you want to update this user info (Y/N):");
+    std::map <std::string, std::vector <double>> latencies;
+    size_t numOfSkipped = 0;
 
-            vUsers[index].password = readPositiveNum("\nEnter new password:");
-            vUsers[index].permissions = readPermissionsToSet();
+    auto start = std::chrono::steady_clock::now();
 
-            saveUsersToFile(vUsers);
+    for (const sTraceRecord& record : vRecords) {
 
-            std::cout << "\nUser Updated Successfully\n";
+        if (speed > 0) {
+
+            auto offset = std::chrono::nanoseconds((int64_t)((record.timestamp - vRecords[0].timestamp) / speed));
+
+            std::this_thread::sleep_until(start + std::chrono::duration_cast <std::chrono::steady_clock::duration>(offset));
+        }
+
+        auto operationStart = std::chrono::steady_clock::now();
+
+        if (!replayTraceRecord(record)) {
+
+            numOfSkipped++;
+            continue;
         }
+
+        latencies[getTraceOperationName(record)].push_back(std::chrono::duration <double, std::micro>(std::chrono::steady_clock::now() - operationStart).count());
     }
 
-    else
-        printUserNotFound(vUsers[index].name);
+    // what the session's logout would have waited for
+    flushPersistence();
+    flushAuditLog();
+
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Replayed " << vRecords.size() - numOfSkipped << " of " << vRecords.size() << " operation(s) from " << traceFile;
+    std::cout << " in " << seconds << "s at ";
+
+    if (speed > 0)
+        std::cout << speed << "x original speed";
+    else
+        std::cout << "max speed";
+
+    std::cout << ", " << numOfSkipped << " skipped\n\n";
+
+    std::vector <sReplayResult> vResults = summarizeReplay(latencies);
+
+    printReplayResults(vResults);
+
+    if (!resultsFile.empty() && !commitToFile(resultsFile, replayResultsToFileContent(vResults)))
+        std::cout << "\nCouldn't write " << resultsFile << '\n';
 }
 
-void processTransactions(std::vector <sClient>& vClients, bool isDeposit = true) {
+// true when no operation's p99 grew by more than trace::REGRESSION_PERCENT
+bool printReplayComparison(const std::vector <sReplayResult>& vBaseline, const std::vector <sReplayResult>& vCandidate) {
 
-    std::string accountNum = readAccountNum();
-    int index = getClientIndexByAccountNum(accountNum, vClients);
+    auto change = [](double before, double after) {
 
-    if (isClientExistsByIndex(index)) {
+        return (before > 0) ? (after - before) / before * 100 : 0.0;
+    };
 
-        printClientCard(vClients[index]);
+    bool isWithinThreshold = true;
 
-        std::string transaction = (isDeposit) ? "deposit" : "withdraw";
+    std::cout << "\nReplay Comparison (latency in us, negative change is faster)\n\n";
+    std::cout << std::left << std::setw(20) << "Operation" << std::right << std::setw(8) << "Count" << std::setw(12) << "Base p50";
+    std::cout << std::setw(12) << "New p50" << std::setw(10) << "Change" << std::setw(12) << "Base p99" << std::setw(12) << "New p99";
+    std::cout << std::setw(10) << "Change" << '\n';
 
-        float amount = readPositiveNum("\nEnter " + transaction + " amount: ", " $");
+    std::cout << std::fixed << std::setprecision(1);
 
-        if (confirmTransaction(amount, vClients[index].balance, isDeposit)) {
+    for (const sReplayResult& baseline : vBaseline) {
 
-            saveClientsToFile(vClients);
-        }
-    }
+        auto candidate = std::find_if(vCandidate.begin(), vCandidate.end(), [&](const sReplayResult& result) { return result.operation == baseline.operation; });
 
-    else
-        printClientNotFound(vClients[index].accountNum);
-}
+        std::cout << std::left << std::setw(20) << baseline.operation << std::right << std::setw(8) << baseline.count;
 
-bool checkPermissionAccess(int permissions, ePermissions permissionToCheck) {
+        if (candidate == vCandidate.end()) {
 
-    return ((permissions & permissionToCheck) == permissionToCheck);
-}
+            std::cout << "  missing from the candidate run\n";
+            continue;
+        }
 
-int getUserIndexByNameAndPassword(const std::string& username, int password, const std::vector <sUser>& vUsers) {
+        double p99Change = change(baseline.p99, candidate->p99);
 
-    int index = 0;
+        std::cout << std::setw(12) << baseline.p50 << std::setw(12) << candidate->p50;
+        std::cout << std::showpos << std::setw(9) << change(baseline.p50, candidate->p50) << '%' << std::noshowpos;
+        std::cout << std::setw(12) << baseline.p99 << std::setw(12) << candidate->p99;
+        std::cout << std::showpos << std::setw(9) << p99Change << '%' << std::noshowpos;
 
-    for (const sUser& user : vUsers) {
+        if (p99Change > trace::REGRESSION_PERCENT) {
 
-        if (user.name != username || user.password != password)
-            index++;
+            std::cout << "  <-- regression";
+            isWithinThreshold = false;
+        }
 
-        else
-            return index;
+        std::cout << '\n';
     }
 
-    return USER_NOT_FOUND;
-}
-
-bool isAdmin(int userPermissions) {
+    std::cout << std::defaultfloat << std::setprecision(6);
 
-    return checkPermissionAccess(userPermissions, ePermissions::FULL_ACCESS);
+    return isWithinThreshold;
 }
 
+// each build replays the trace against its own copy of the current directory's data, then the two summaries are diffed
+bool runReplayComparison(const std::string& traceFile, const std::string& baseline, const std::string& candidate, const std::string& speed) {
 
-// output functions (definition)
+    const std::filesystem::path dataDirectory = std::filesystem::current_path();
+    const std::string builds[2] = { std::filesystem::absolute(baseline).string(), std::filesystem::absolute(candidate).string() };
+    const std::string tracePath = std::filesystem::absolute(traceFile).string();
 
-void printMainMenu() {
+    std::vector <sReplayResult> vResults[2];
 
-    std::cout << "=============================\n";
-    std::cout << "\tMain Menu\n";
-    std::cout << "=============================\n";
-    std::cout << "[1] Add New Client\n";
-    std::cout << "[2] Show All Clients\n";
-    std::cout << "[3] Update Client\n";
-    std::cout << "[4] Remove Client\n";
-    std::cout << "[5] Find Client\n";
-    std::cout << "[6] Transactions\n";
-    std::cout << "[7] Manage Users\n";
-    std::cout << "[8] Logout\n";
-    std::cout << "=============================\n";
-}
+    for (int i = 0; i < 2; i++) {
 
-void printClientsListHeader(int numOfClients) {
+        std::error_code error;
+        std::filesystem::path runDirectory = std::filesystem::temp_directory_path(error) / ("bank_replay_" + std::to_string(i) + "_"
+            + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
 
-    std::cout << '\n' << "\t\t\tClients List [" << numOfClients << "] Client(s)\n";
+        std::filesystem::create_directories(runDirectory, error);
 
-    std::cout << std::left;
-    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
-    std::cout << "| " << std::setw(17) << "Account Number";
-    std::cout << "| " << std::setw(10) << "Pincode";
-    std::cout << "| " << std::setw(30) << "Client Name";
-    std::cout << "| " << std::setw(17) << "Phone Number";
-    std::cout << "| " << std::setw(10) << "Balance";
-    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
-}
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dataDirectory, error)) {
 
-void printClientRecord(const sClient& client) {
+            if (entry.is_regular_file())
+                std::filesystem::copy_file(entry.path(), runDirectory / entry.path().filename(), error);
+        }
 
-    std::cout << "| " << std::setw(17) << client.accountNum;
-    std::cout << "| " << std::setw(10) << client.pincode;
-    std::cout << "| " << std::setw(30) << client.name;
-    std::cout << "| " << std::setw(17) << client.phoneNum;
-    std::cout << "| $" << std::setw(10) << client.balance << '\n';
-}
+        std::cout << "\n== " << ((i == 0) ? "Baseline" : "Candidate") << ": " << builds[i] << "\n\n" << std::flush;
 
-void printClientCard(const sClient& client) {
+        std::string command = "\"" + builds[i] + "\" --replay \"" + tracePath + "\" " + speed + " " + file::REPLAY_RESULTS_FILE;
 
-    std::cout << "\nAccount Number: " << client.accountNum;
-    std::cout << "\nPincode: " << client.pincode;
-    std::cout << "\nClient Name: " << client.name;
-    std::cout << "\nPhone Number: " << client.phoneNum;
-    std::cout << "\nBalance: $" << client.balance << '\n';
-}
+        std::filesystem::current_path(runDirectory);
+        int status = std::system(command.c_str());
+        std::filesystem::current_path(dataDirectory);
 
-void printClientNotFound(const std::string& accountNum) {
+        vResults[i] = loadReplayResults((runDirectory / file::REPLAY_RESULTS_FILE).string());
 
-    std::cout << "\nClient with account number [" << accountNum << "] isn't founded\n";
-}
+        std::filesystem::remove_all(runDirectory, error);
 
-void printTransactionsMenu() {
+        if (status != 0 || vResults[i].empty()) {
 
-    std::cout << "=============================\n";
-    std::cout << "\tTransactions Menu\n";
-    std::cout << "=============================\n";
-    std::cout << "[1] Deposit\n";
-    std::cout << "[2] Withdraw\n";
-    std::cout << "[3] Show All Balances\n";
-    std::cout << "[4] Return To Main Menu\n";
-    std::cout << "=============================\n";
+            std::cout << "\nReplay with " << builds[i] << " failed\n";
+            return false;
+        }
+    }
+
+    return printReplayComparison(vResults[0], vResults[1]);
 }
 
-void printBalancesListHeader(int numOfClients) {
+// the transfers take the real path, transferStoredBalances with its locks, reads and fsyncs, on a scratch copy of the data
+void runTransferBenchmark(int maxThreads, int transfersPerThread) {
 
-    std::cout << '\n' << "\t\t\tClients List [" << numOfClients << "] Client(s)\n";
+    std::vector <sClient> vClients = loadClientsFromFile();
 
-    std::cout << std::left;
-    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
-    std::cout << "| " << std::setw(17) << "Account Number";
-    std::cout << "| " << std::setw(30) << "Client Name";
-    std::cout << "| " << std::setw(10) << "Balance";
-    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
-}
+    if (vClients.size() < 2) {
 
-void printManageUsersMenu() {
+        std::cout << "At least two clients are needed in " << file::CLIENTS_FILE << " to run the benchmark\n";
+        return;
+    }
 
-    std::cout << "=============================\n";
-    std::cout << "\tManage Users Menu\n";
-    std::cout << "=============================\n";
-    std::cout << "[1] Add New User\n";
-    std::cout << "[2] List Users\n";
-    std::cout << "[3] Update User\n";
-    std::cout << "[4] Remove User\n";
-    std::cout << "[5] Find User\n";
-    std::cout << "[6] Return to Main Menu\n";
-    std::cout << "=============================\n";
-}
+    const std::filesystem::path dataDirectory = std::filesystem::current_path();
 
-void printUsersListHeader(int numOfUsers) {
+    std::error_code error;
+    std::filesystem::path runDirectory = std::filesystem::temp_directory_path(error) / ("bank_transfer_bench_"
+        + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
 
-    std::cout << '\n' << "\t\t\tUsers List [" << numOfUsers << "] User(s)\n";
+    std::filesystem::create_directories(runDirectory, error);
 
-    std::cout << std::left;
-    std::cout << "\n--------------------------------------------------------------------------------------------\n\n";
-    std::cout << "| " << std::setw(17) << "Username";
-    std::cout << "| " << std::setw(20) << "Password";
-    std::cout << "| " << std::setw(20) << "Permissions";
-    std::cout << "\n\n--------------------------------------------------------------------------------------------\n";
-}
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dataDirectory, error)) {
 
-void printUserCard(const sUser& user) {
+        if (entry.is_regular_file())
+            std::filesystem::copy_file(entry.path(), runDirectory / entry.path().filename(), error);
+    }
 
-    std::cout << "\nUsername: " << user.name;
-    std::cout << "\nPassword: " << user.password;
-    std::cout << "\nPermissions: " << user.permissions << '\n';
-}
+    std::filesystem::current_path(runDirectory);
 
-void printUserNotFound(const std::string& username) {
+    auto totalOf = [] {
 
-    std::cout << "\nUser with username [" << username << "] is not found!\n";
-}
+        double total = 0;
 
-void printAccessDenied() {
+        for (const sClient& client : loadClientsFromFile())
+            total += client.balance;
 
-    std::cout << "\t\t\t\t\t! Access Denied !\n";
-    std::cout << "\t\t\t\t-- Please contact your admin --\n\n";
-}
+        return total;
+    };
 
+    double totalBefore = totalOf();
 
-// data functions (definition)
+    std::cout << std::left << "| " << std::setw(10) << "Threads" << "| " << std::setw(12) << "Transfers";
+    std::cout << "| " << std::setw(14) << "Transfers/s" << "| " << std::setw(10) << "Rejected" << "| Balance Sum Conserved\n";
 
-std::vector <sClient> loadClientsFromFile() {
+    for (int numOfThreads = 1; numOfThreads <= maxThreads; numOfThreads *= 2) {
 
-    std::fstream file;
+        std::atomic <long long> rejected(0);
+        std::vector <std::thread> vThreads;
 
-    file.open(file::CLIENTS_FILE, std::ios::in);
+        auto start = std::chrono::steady_clock::now();
 
-    std::vector <sClient> vClients;
+        for (int t = 0; t < numOfThreads; t++) {
 
-    if (file.is_open()) {
+            vThreads.emplace_back([&, t] {
 
-        std::string line;
+                std::mt19937 generator(t * 7919 + numOfThreads);
+                std::uniform_int_distribution <int> pickClient(0, (int)vClients.size() - 1);
+                std::uniform_int_distribution <int> pickAmount(1, 100);
 
-        while (std::getline(file, line)) {
+                for (int i = 0; i < transfersPerThread; i++) {
 
-            sClient client = clientLineToRecord(line);
-            vClients.push_back(client);
+                    float fromBalance, toBalance;
+
+                    if (!transferStoredBalances(vClients[pickClient(generator)].accountNum, vClients[pickClient(generator)].accountNum,
+                        (float)pickAmount(generator), fromBalance, toBalance))
+                        rejected++;
+                }
+            });
         }
 
-        file.close();
+        for (std::thread& thread : vThreads)
+            thread.join();
+
+        double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+        long long transfers = (long long)numOfThreads * transfersPerThread;
+
+        std::cout << "| " << std::setw(10) << numOfThreads << "| " << std::setw(12) << transfers;
+        std::cout << "| " << std::setw(14) << (long long)(transfers / seconds) << "| " << std::setw(10) << rejected.load();
+        std::cout << "| " << ((totalOf() == totalBefore) ? "Yes" : "No") << '\n';
     }
 
-    return vClients;
+    std::filesystem::current_path(dataDirectory);
+    std::filesystem::remove_all(runDirectory, error);
 }
 
-void saveClientsToFile(const std::vector <sClient> vClients) {
+bool parseStatementPeriod(const std::string& period, int64_t& fromTime, int64_t& toTime) {
 
-    std::fstream file;
+    std::tm date = {};
 
-    file.open(file::CLIENTS_FILE, std::ios::out);
+    std::istringstream text(period);
+    text >> std::get_time(&date, "%Y-%m");
 
-    if (file.is_open()) {
+    if (text.fail())
+        return false;
 
-        for (const sClient& client : vClients) {
+    date.tm_mday = 1;
+    date.tm_isdst = -1;
 
-            if (client.isDeleted == false) {
+    fromTime = (int64_t)std::mktime(&date);
 
-                file << clientRecordToLine(client) << '\n';
-            }
-        }
+    date.tm_mon++;
+    date.tm_isdst = -1;
 
-        file.close();
-    }
-}
+    toTime = (int64_t)std::mktime(&date) - 1;
 
-void saveUsersToFile(const std::vector <sUser> vUsers) {
+    return true;
+}
 
-    std::fstream file;
+void renderStatement(std::string& buffer, const sClientView& client, const std::vector <sHistoryRecord>& vRecords, const std::string& period, int64_t toTime) {
 
-    file.open(file::USERS_FILE, std::ios::out);
+    // vRecords is newest first and may start with records made after the period
+    size_t firstInPeriod = 0;
 
-    if (file.is_open()) {
+    while (firstInPeriod < vRecords.size() && vRecords[firstInPeriod].timestamp > toTime)
+        firstInPeriod++;
 
-        for (const sUser& user : vUsers) {
+    float closingBalance = (firstInPeriod > 0) ? vRecords[firstInPeriod - 1].balanceAfter - vRecords[firstInPeriod - 1].amount : client.balance;
+    float openingBalance = (firstInPeriod < vRecords.size()) ? vRecords.back().balanceAfter - vRecords.back().amount : closingBalance;
 
-            if (user.isDeleted == false) {
+    auto appendNumber = [&buffer](float value) {
 
-                file << userRecordToLine(user) << '\n';
-            }
-        }
+        char digits[32];
+        buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, 2).ptr);
+    };
 
-        file.close();
+    const char* types[5] = { "", "Deposit     ", "Withdraw    ", "Transfer In ", "Transfer Out" };
+
+    buffer += "=============================================\n";
+    buffer += "Statement ";
+    buffer += period;
+    buffer += "\nAccount Number: ";
+    buffer.append(client.accountNum.data(), client.accountNum.size());
+    buffer += "\nClient Name: ";
+    buffer.append(client.name.data(), client.name.size());
+    buffer += "\nPhone Number: ";
+    buffer.append(client.phoneNum.data(), client.phoneNum.size());
+    buffer += "\nOpening Balance: $";
+    appendNumber(openingBalance);
+    buffer += '\n';
+
+    for (size_t i = vRecords.size(); i > firstInPeriod; i--) {
+
+        const sHistoryRecord& record = vRecords[i - 1];
+
+        std::tm date = toLocalTime(record.timestamp);
+        char dateText[20];
+
+        buffer.append(dateText, std::strftime(dateText, sizeof(dateText), "%Y-%m-%d %H:%M", &date));
+        buffer += "  ";
+        buffer += (record.type >= 1 && record.type <= 4) ? types[record.type] : "?           ";
+        buffer += "  $";
+        appendNumber(record.amount);
+        buffer += "  $";
+        appendNumber(record.balanceAfter);
+        buffer += '\n';
     }
+
+    buffer += "Closing Balance: $";
+    appendNumber(closingBalance);
+    buffer += "\n\n";
 }
 
-std::vector <sUser> loadUsersFromFile() {
+void runStatementJob(const std::string& period, int numOfThreads, int numOfShards) {
 
-    std::fstream file;
+    int64_t fromTime, toTime;
 
-    file.open(file::USERS_FILE, std::ios::in);
+    if (!parseStatementPeriod(period, fromTime, toTime)) {
 
-    std::vector <sUser> vUsers;
+        std::cout << "Invalid period! Use YYYY-MM\n";
+        return;
+    }
 
-    if (file.is_open()) {
+    auto start = std::chrono::steady_clock::now();
 
-        std::string line;
+    sClientTable table = loadClientTable();
 
-        while (std::getline(file, line)) {
+    const size_t chunkSize = 1024;
+    size_t numOfClients = table.vClients.size();
+    size_t numOfChunks = (numOfClients + chunkSize - 1) / chunkSize;
 
-            sUser user = userLineToRecord(line);
-            vUsers.push_back(user);
-        }
+    // chunks are dealt round-robin, idle workers steal from the front of the others' queues
+    std::vector <sWorkQueue> vQueues(numOfThreads);
 
-        file.close();
-    }
+    for (size_t chunk = 0; chunk < numOfChunks; chunk++)
+        vQueues[chunk % numOfThreads].tasks.push_back(chunk);
 
-    return vUsers;
-}
+    std::string filePeriod = period;
+    filePeriod.erase(std::remove(filePeriod.begin(), filePeriod.end(), '-'), filePeriod.end());
 
+    std::vector <FILE*> vShardFiles(numOfShards);
+    std::vector <std::mutex> vShardMutexes(numOfShards);
 
-// core functions (definition)
+    for (int shard = 0; shard < numOfShards; shard++) {
 
-void addClients(sUser& user) {
+        std::string shardFile = file::STATEMENTS_PREFIX + filePeriod + "_" + std::to_string(shard) + ".txt";
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::ADD_CLIENT)) {
+        if ((vShardFiles[shard] = std::fopen(shardFile.c_str(), "w")) == nullptr) {
 
-        printAccessDenied();
+            std::cout << "Couldn't create " << shardFile << '\n';
+
+            for (FILE* opened : vShardFiles) {
+
+                if (opened != nullptr)
+                    std::fclose(opened);
+            }
+
+            return;
+        }
     }
 
-    else {
+    std::atomic <size_t> statementsDone(0);
+    std::atomic <long long> bytesWritten(0);
+    std::atomic <long long> chunksStolen(0);
 
-        std::cout << "\t\t----------------------------\n";
-        std::cout << "\t\t\tAdd New Client\n";
-        std::cout << "\t\t----------------------------\n\n";
+    auto popChunk = [&](int worker, size_t& chunk) {
 
-        std::vector <sClient> vClients = loadClientsFromFile();
+        {
+            std::lock_guard <std::mutex> lock(vQueues[worker].mutex);
 
-        char addOtherClient;
+            if (!vQueues[worker].tasks.empty()) {
 
-        do {
+                chunk = vQueues[worker].tasks.back();
+                vQueues[worker].tasks.pop_back();
 
-            std::cout << "\nAdding New Client:\n\n";
+                return true;
+            }
+        }
 
-            addClient(vClients);
+        for (int offset = 1; offset < numOfThreads; offset++) {
 
-            addOtherClient = readChar("\nDo you want to add another client (Y/N):");
+            sWorkQueue& victim = vQueues[(worker + offset) % numOfThreads];
 
-        } while (toupper(addOtherClient) == 'Y');
-    }
+            std::lock_guard <std::mutex> lock(victim.mutex);
 
+            if (!victim.tasks.empty()) {
 
-    returnToMenu();
-}
+                chunk = victim.tasks.front();
+                victim.tasks.pop_front();
 
-void showAllClients(const sUser& user) {
+                chunksStolen++;
+                return true;
+            }
+        }
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::SHOW_ALL_CLIENTS)) {
+        return false;
+    };
 
-        printAccessDenied();
-    }
+    std::vector <std::thread> vWorkers;
 
-    else {
+    for (int worker = 0; worker < numOfThreads; worker++) {
 
-        std::cout << "\t\t----------------------------\n";
-        std::cout << "\t\t\tShow All Clients\n";
-        std::cout << "\t\t----------------------------\n";
+        vWorkers.emplace_back([&, worker] {
 
-        std::vector <sClient> vClients = loadClientsFromFile();
+            sHistoryReader reader;
 
-        printClientsListHeader(vClients.size());
+            // one buffer per worker, sized for a whole chunk and reused, so every shard write is one large block
+            std::string buffer;
+            buffer.reserve(chunkSize * 512);
 
-        for (const sClient& client : vClients) {
+            size_t chunk;
 
-            printClientRecord(client);
-        }
+            while (popChunk(worker, chunk)) {
 
-        std::cout << "\n-------------------------------------------------------------------------------------------\n";
-    }
+                buffer.clear();
 
+                size_t first = chunk * chunkSize;
+                size_t last = std::min(first + chunkSize, numOfClients);
 
-    returnToMenu();
-}
+                for (size_t i = first; i < last; i++) {
 
-void updateClient(const sUser& user) {
+                    sClientView client = unpackClient(table, table.vClients[i]);
+                    std::vector <sHistoryRecord> vRecords = readAccountHistory(reader, std::string(client.accountNum), SIZE_MAX, fromTime);
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::UPDATE_CLIENT)) {
+                    renderStatement(buffer, client, vRecords, period, toTime);
+                }
 
-        printAccessDenied();
+                int shard = chunk % numOfShards;
+
+                {
+                    std::lock_guard <std::mutex> lock(vShardMutexes[shard]);
+                    std::fwrite(buffer.data(), 1, buffer.size(), vShardFiles[shard]);
+                }
+
+                bytesWritten += buffer.size();
+                statementsDone += last - first;
+            }
+        });
     }
 
-    else {
+    while (statementsDone.load() < numOfClients) {
 
-        std::cout << "\t\t---------------------------\n";
-        std::cout << "\t\t\tUpdate Client\n";
-        std::cout << "\t\t---------------------------\n\n";
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
-        std::vector <sClient> vClients = loadClientsFromFile();
+        double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+        size_t done = statementsDone.load();
 
-        std::string accountNum = readAccountNum();
+        std::cout << "Progress: " << done << "/" << numOfClients << " (" << (numOfClients ? done * 100 / numOfClients : 100) << "%), ";
+        std::cout << (long long)(done / seconds) << " statements/s\n";
+    }
+
+    for (std::thread& worker : vWorkers)
+        worker.join();
 
-        processUpdating(accountNum, vClients);
+    for (FILE* shardFile : vShardFiles) {
+
+        std::fflush(shardFile);
+        fsync(fileno(shardFile));
+        std::fclose(shardFile);
     }
 
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
 
-    returnToMenu();
+    std::cout << "\nGenerated " << numOfClients << " statement(s) for " << period << " into " << numOfShards << " shard(s) in " << seconds << "s\n";
+    std::cout << "Throughput: " << (long long)(numOfClients / seconds) << " statements/s, " << (bytesWritten.load() >> 20) << " MB written, ";
+    std::cout << chunksStolen.load() << " chunk(s) stolen\n";
 }
 
-void removeClient(const sUser& user) {
+void computeAccrual(const float* balances, float* newBalances, size_t count) {
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::REMOVE_CLIENT)) {
+    const std::vector <std::pair <float, float>>& vTiers = settings::accrualTiers;
 
-        printAccessDenied();
-        returnToMenu();
+    size_t i = 0;
 
-        return;
-    }
+#ifdef HAS_SSE2
+    // 4 balances per step; tier rates are picked branch-free with compare masks
+    const __m128 fee = _mm_set1_ps(settings::maintenanceFee);
+    const __m128 feeWaiver = _mm_set1_ps(settings::feeWaiverBalance);
+    const __m128 zero = _mm_setzero_ps();
 
-    std::cout << "\t\t----------------------------\n";
-    std::cout << "\t\t\tRemove Client\n";
-    std::cout << "\t\t----------------------------\n\n";
+    for (; i + 4 <= count; i += 4) {
 
-    std::vector <sClient> vClients = loadClientsFromFile();
+        __m128 balance = _mm_loadu_ps(balances + i);
+        __m128 rate = zero;
 
-    std::string accountNum = readAccountNum();
+        for (const std::pair <float, float>& tier : vTiers) {
 
-    processRemoving(accountNum, vClients);
+            __m128 isInTier = _mm_cmpge_ps(balance, _mm_set1_ps(tier.first));
+            rate = _mm_or_ps(_mm_and_ps(isInTier, _mm_set1_ps(tier.second)), _mm_andnot_ps(isInTier, rate));
+        }
 
-    returnToMenu();
-}
+        __m128 charged = _mm_and_ps(_mm_cmplt_ps(balance, feeWaiver), _mm_min_ps(fee, _mm_max_ps(balance, zero)));
+        __m128 result = _mm_sub_ps(_mm_add_ps(balance, _mm_mul_ps(balance, rate)), charged);
 
-void findClient(const sUser& user) {
+        _mm_storeu_ps(newBalances + i, result);
+    }
+#endif
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::FIND_CLIENT)) {
+    for (; i < count; i++) {
 
-        printAccessDenied();
-        returnToMenu();
+        float balance = balances[i];
+        float rate = 0;
 
-        return;
+        for (const std::pair <float, float>& tier : vTiers) {
+
+            if (balance >= tier.first)
+                rate = tier.second;
+        }
+
+        float charged = (balance < settings::feeWaiverBalance) ? std::min(settings::maintenanceFee, std::max(balance, 0.0f)) : 0;
+
+        newBalances[i] = balance + balance * rate - charged;
     }
+}
 
-    std::cout << "\t\t------------------------\n";
-    std::cout << "\t\t\tFind Client\n";
-    std::cout << "\t\t------------------------\n\n";
+std::string tableToFileContent(const sClientTable& table) {
 
-    std::vector <sClient> vClients = loadClientsFromFile();
+    std::string content;
+    content.reserve(table.vClients.size() * 80);
+
+    char number[32];
 
-    std::string accountNum = readAccountNum();
+    for (const sPackedClient& record : table.vClients) {
 
-    int index = getClientIndexByAccountNum(accountNum, vClients);
+        sClientView client = unpackClient(table, record);
+        size_t lineStart = content.size();
 
-    if (isClientExistsByIndex(index)) {
+        // same layout as clientRecordToLine, balance with std::to_string's 6 decimals
+        content.append(client.accountNum.data(), client.accountNum.size());
+        content += SEPARATOR;
+        content.append(number, std::to_chars(number, number + sizeof(number), client.pincode).ptr);
+        content += SEPARATOR;
+        content.append(client.name.data(), client.name.size());
+        content += SEPARATOR;
+        content.append(client.phoneNum.data(), client.phoneNum.size());
+        content += SEPARATOR;
+        content.append(number, std::to_chars(number, number + sizeof(number), (double)client.balance, std::chars_format::fixed, 6).ptr);
 
-        printClientCard(vClients[index]);
+        appendLineChecksum(content, lineStart);
+        content += '\n';
     }
 
-    else
-        printClientNotFound(accountNum);
+    return content;
+}
 
+bool writeAccrualJournalState(eAccrualState state) {
 
-    returnToMenu();
-}
+    FILE* file = std::fopen(file::ACCRUAL_JOURNAL_FILE.c_str(), "r+b");
 
-void Deposit() {
+    if (file == nullptr)
+        return false;
 
-    std::cout << "\t\t------------------------\n";
-    std::cout << "\t\t\tDeposit\n";
-    std::cout << "\t\t------------------------\n\n";
+    sAccrualJournalHeader header;
 
-    std::vector <sClient> vClients = loadClientsFromFile();
+    bool isWritten = std::fread(&header, sizeof(header), 1, file) == 1;
 
-    processTransactions(vClients);
+    header.state = state;
 
-    returnToMenu(menu::TRANSACTIONS);
+    isWritten = isWritten && std::fseek(file, 0, SEEK_SET) == 0;
+    isWritten = isWritten && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    isWritten = isWritten && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+    return (std::fclose(file) == 0) && isWritten;
 }
 
-void Withdraw() {
+bool readAccrualJournalHeader(sAccrualJournalHeader& header) {
 
-    std::cout << "\t\t------------------------\n";
-    std::cout << "\t\t\tWithdraw\n";
-    std::cout << "\t\t------------------------\n\n";
+    std::fstream file;
 
-    std::vector <sClient> vClients = loadClientsFromFile();
+    file.open(file::ACCRUAL_JOURNAL_FILE, std::ios::in | std::ios::binary);
 
-    processTransactions(vClients, false);
+    if (!file.is_open())
+        return false;
 
-    returnToMenu(menu::TRANSACTIONS);
+    file.read((char*)&header, sizeof(header));
+
+    return file.good() && std::memcmp(header.magic, "BNKACRL2", 8) == 0;
 }
 
-void showAllBalances() {
+// the jobs that read and rewrite every shard hold all of them from the read to the commit: the mutexes in shard order,
+// then the BALANCES locks in shard order, the same order every other writer and the ATM syncs take them in
+void lockAllShards(std::vector <std::unique_lock <std::mutex>>& vShardLocks, std::deque <sFileLock>& balancesLocks) {
 
-    std::cout << "\t\t-------------------------------\n";
-    std::cout << "\t\t\tShow All Balances\n";
-    std::cout << "\t\t-------------------------------\n";
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++)
+        vShardLocks.emplace_back(shards::mutexes[shardIndex]);
 
-    std::vector <sClient> vClients = loadClientsFromFile();
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++)
+        balancesLocks.emplace_back(getShardFileName(file::HOT_BALANCES_LOCK_FILE, shardIndex));
+}
 
-    printBalancesListHeader(vClients.size());
+// caller holds every shard through lockAllShards; the shard files and their hot tables are read directly
+sClientTable loadLockedClientTable() {
 
-    int totalBalance = 0;
+    std::string buffer;
+    std::vector <std::vector <sIndexSlot>> vHotSlots(shards::count);
 
-    for (const sClient& client : vClients) {
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++) {
 
-        std::cout << "| " << std::setw(17) << client.accountNum;
-        std::cout << "| " << std::setw(30) << client.name;
-        std::cout << "| $" << std::setw(10) << client.balance << '\n';
+        buffer += readDiskContent(getShardFileName(file::CLIENTS_FILE, shardIndex));
 
-        totalBalance += client.balance;
-    }
+        if (!buffer.empty() && buffer.back() != '\n')
+            buffer += '\n';
 
-    std::cout << "\n\n-- Total Balance: $" << totalBalance << "\n\n";
+        vHotSlots[shardIndex] = loadHotBalances(shardIndex);
+    }
 
-    returnToMenu(menu::TRANSACTIONS);
+    return parseClientTable(buffer, vHotSlots, shards::count, file::CLIENTS_FILE);
 }
 
-void applyTransaction(eTransactionsMenu choice) {
+// caller holds every shard through lockAllShards
+bool writeLockedClientShards(const std::string& content) {
 
-    clearScreen();
+    std::vector <std::string> vParts = splitClientShards(content);
+    bool isWritten = true;
 
-    switch (choice) {
+    for (int shardIndex = 0; shardIndex < shards::count; shardIndex++)
+        isWritten = alignHotBalances(shardIndex, vParts[shardIndex]) && writeClientShard(shardIndex, vParts[shardIndex], false) && isWritten;
 
-    case eTransactionsMenu::TRANSAC_DEPOSIT:
+    dropClientsVersion();
 
-        Deposit();
-        break;
+    return isWritten;
+}
 
-    case eTransactionsMenu::TRANSAC_WITHDRAW:
+uint64_t hashTableBalances(const sClientTable& table) {
 
-        Withdraw();
-        break;
+    std::string balances;
+    balances.reserve(table.vClients.size() * sizeof(float));
 
-    case eTransactionsMenu::TRANSAC_SHOW_ALL_BALANCES:
+    for (const sPackedClient& record : table.vClients)
+        balances.append((const char*)&record.balance, sizeof(record.balance));
 
-        showAllBalances();
-        break;
+    return hashKey(balances);
+}
 
-    case eTransactionsMenu::TRANSAC_RETURN_TO_MAIN_MENU:
+void recoverAccrualJournal() {
 
+    sAccrualJournalHeader header;
+
+    if (!readAccrualJournalHeader(header) || header.state != ACCRUAL_BEGIN)
         return;
-    }
-}
 
-void Transactions(const sUser& user) {
+    // the balances are either still the batch's pre-image or all of it; anything else means the batch was cut off
+    // between shards or the balances changed since, and guessing would apply or reverse deltas that weren't
+    uint64_t hash = hashTableBalances(loadClientTable());
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::TRANSACTIONS)) {
+    if (hash != header.preImageHash && hash != header.postImageHash) {
 
-        printAccessDenied();
+        std::cout << "Accrual batch " << header.batchId << " was interrupted and the balances match neither its start nor its end, ";
+        std::cout << file::ACCRUAL_JOURNAL_FILE << " is left open for an operator to reconcile\n\n";
+        return;
     }
 
-    else {
+    bool isApplied = hash == header.postImageHash;
 
-        eTransactionsMenu choice;
+    writeAccrualJournalState(isApplied ? ACCRUAL_COMMITTED : ACCRUAL_ABORTED);
 
-        do {
+    std::cout << "Accrual batch " << header.batchId << " was interrupted and has been " << (isApplied ? "committed" : "aborted") << "\n\n";
+}
 
-            printTransactionsMenu();
-            choice = (eTransactionsMenu)readMenuChoice(1, 4);
+void runAccrualJob(int numOfThreads) {
 
-            applyTransaction(choice);
+    sAccrualJournalHeader openHeader;
 
-        } while (choice != eTransactionsMenu::TRANSAC_RETURN_TO_MAIN_MENU);
+    if (readAccrualJournalHeader(openHeader) && openHeader.state == ACCRUAL_BEGIN) {
+
+        std::cout << "Accrual batch " << openHeader.batchId << " in " << file::ACCRUAL_JOURNAL_FILE << " is still open, no new batch was started\n";
+        return;
     }
-}
 
-void addUser(const std::vector <sUser>& vUsers) {
+    auto start = std::chrono::steady_clock::now();
 
-    sUser user = readUserData(vUsers);
-    addLineToFile(userRecordToLine(user), file::USERS_FILE);
-}
+    // the session's queued changes reach the files, then nothing else can change a balance until the batch is written
+    flushPersistence();
 
-void addUsers() {
+    std::vector <std::unique_lock <std::mutex>> vShardLocks;
+    std::deque <sFileLock> balancesLocks;
 
-    std::cout << "\t\t-------------------------\n";
-    std::cout << "\t\t\tAdd User\n";
-    std::cout << "\t\t-------------------------\n";
+    lockAllShards(vShardLocks, balancesLocks);
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
+    sClientTable table = loadLockedClientTable();
+    uint64_t preImageHash = hashTableBalances(table);
 
-    std::cout << "\nAdding New User:\n\n";
+    size_t numOfClients = table.vClients.size();
 
-    char addAnotherUser;
+    // balances are copied into one contiguous column for the vector loop
+    std::vector <float> vBalances(numOfClients);
+    std::vector <float> vNewBalances(numOfClients);
 
-    do {
+    for (size_t i = 0; i < numOfClients; i++)
+        vBalances[i] = table.vClients[i].balance;
 
-        addUser(vUsers);
+    auto computeStart = std::chrono::steady_clock::now();
 
-        addAnotherUser = readChar("\nDo you want to add another user (Y/N):");
+    std::vector <std::thread> vThreads;
+    size_t slice = (numOfClients + numOfThreads - 1) / numOfThreads;
 
-    } while (toupper(addAnotherUser) == 'Y');
+    for (int t = 0; t < numOfThreads; t++) {
 
+        size_t first = std::min(numOfClients, t * slice);
+        size_t last = std::min(numOfClients, first + slice);
 
-    std::cout << '\n';
-    returnToMenu(menu::MANAGE_USERS);
-}
+        vThreads.emplace_back(computeAccrual, vBalances.data() + first, vNewBalances.data() + first, last - first);
+    }
 
-void showAllUsers() {
+    for (std::thread& thread : vThreads)
+        thread.join();
 
-    std::cout << "\t\t----------------------------\n";
-    std::cout << "\t\t\tShow All Users\n";
-    std::cout << "\t\t----------------------------\n";
+    double computeSeconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - computeStart).count();
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
+    // journal first: header marked BEGIN plus every account's delta, fsynced before the clients file changes
+    sAccrualJournalHeader header;
 
-    printUsersListHeader(vUsers.size());
+    header.batchId = (int64_t)std::time(nullptr);
+    header.count = numOfClients;
+    header.preImageHash = preImageHash;
+    header.state = ACCRUAL_BEGIN;
 
-    for (const sUser& user : vUsers) {
+    std::string journal((const char*)&header, sizeof(header));
+    journal.reserve(sizeof(header) + numOfClients * sizeof(sAccrualEntry));
 
-        std::cout << "| " << std::setw(17) << user.name;
-        std::cout << "| " << std::setw(20) << user.password;
-        std::cout << "| " << std::setw(20) << user.permissions << '\n';
-    }
+    double totalInterest = 0, totalFees = 0;
 
-    returnToMenu(menu::MANAGE_USERS);
-}
+    for (size_t i = 0; i < numOfClients; i++) {
 
-void updateUser() {
+        sAccrualEntry entry;
+        sClientView client = unpackClient(table, table.vClients[i]);
 
-    std::cout << "\t\t-----------------------------\n";
-    std::cout << "\t\t\tUpdate User\n";
-    std::cout << "\t\t-----------------------------\n\n";
+        client.accountNum.copy(entry.accountNum, sizeof(entry.accountNum) - 1);
+        entry.delta = vNewBalances[i] - vBalances[i];
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
+        journal.append((const char*)&entry, sizeof(entry));
 
-    std::string username = readUsername();
-    int index = getUserIndexByName(username, vUsers);
+        if (entry.delta >= 0)
+            totalInterest += entry.delta;
+        else
+            totalFees -= entry.delta;
 
-    processUpdating(index, vUsers);
+        table.vClients[i].balance = vNewBalances[i];
+    }
 
-    returnToMenu(menu::MANAGE_USERS);
-}
+    header.postImageHash = hashTableBalances(table);
+    std::memcpy(&journal[0], &header, sizeof(header));
 
-void removeUser() {
+    if (!writeFileDurably(file::ACCRUAL_JOURNAL_FILE, journal, false)) {
 
-    std::cout << "\t\t-----------------------------\n";
-    std::cout << "\t\t\tDelete User\n";
-    std::cout << "\t\t-----------------------------\n\n";
+        std::cout << "Couldn't write " << file::ACCRUAL_JOURNAL_FILE << ", no balance was changed\n";
+        return;
+    }
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
+    if (!writeLockedClientShards(tableToFileContent(table))) {
 
-    std::string username = readUsername();
-    int index = getUserIndexByName(username, vUsers);
+        writeAccrualJournalState(ACCRUAL_ABORTED);
 
-    processRemoving(index, vUsers);
+        std::cout << "Couldn't write " << file::CLIENTS_FILE << ", the batch was aborted\n";
+        return;
+    }
 
-    std::cout << '\n';
-    returnToMenu(menu::MANAGE_USERS);
-}
+    writeAccrualJournalState(ACCRUAL_COMMITTED);
 
-void findUser() {
+    double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
 
-    std::cout << "\t\t-----------------------------\n";
-    std::cout << "\t\t\tFind User\n";
-    std::cout << "\t\t-----------------------------\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Accrual batch " << header.batchId << " applied to " << numOfClients << " account(s)\n";
+    std::cout << "Interest: $" << totalInterest << ", Fees: $" << totalFees << '\n';
+    std::cout << std::defaultfloat << std::setprecision(6);
+    std::cout << "Compute: " << computeSeconds << "s on " << numOfThreads << " thread(s), Total: " << seconds << "s\n";
+}
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
+void rollbackAccrualJob() {
 
-    std::string username = readUsername();
-    int index = getUserIndexByName(username, vUsers);
+    sAccrualJournalHeader header;
 
-    if (isUserExistsByIndex(index)) {
+    if (!readAccrualJournalHeader(header) || header.state != ACCRUAL_COMMITTED) {
 
-        printUserCard(vUsers[index]);
+        std::cout << "There is no committed accrual batch to roll back\n";
+        return;
     }
 
-    else
-        printUserNotFound(username);
+    std::fstream file;
 
+    file.open(file::ACCRUAL_JOURNAL_FILE, std::ios::in | std::ios::binary);
+    file.seekg(sizeof(header));
 
-    returnToMenu(menu::MANAGE_USERS);
-}
+    std::vector <sAccrualEntry> vEntries(header.count);
+    file.read((char*)vEntries.data(), vEntries.size() * sizeof(sAccrualEntry));
 
-void applyManageUsersMenuChoice(eManageUsersMenu choice) {
+    if (!file.good()) {
 
-    clearScreen();
+        std::cout << file::ACCRUAL_JOURNAL_FILE << " is truncated, nothing was rolled back\n";
+        return;
+    }
 
-    switch (choice) {
+    file.close();
 
-    case eManageUsersMenu::ADD_NEW_USER:
+    flushPersistence();
 
-        addUsers();
-        break;
+    std::vector <std::unique_lock <std::mutex>> vShardLocks;
+    std::deque <sFileLock> balancesLocks;
 
-    case eManageUsersMenu::LIST_USERS:
+    lockAllShards(vShardLocks, balancesLocks);
 
-        showAllUsers();
-        break;
+    sClientTable table = loadLockedClientTable();
+    std::unordered_map <std::string_view, size_t> accountIndexes;
 
-    case eManageUsersMenu::UPDATE_USER:
+    accountIndexes.reserve(table.vClients.size());
 
-        updateUser();
-        break;
+    for (size_t i = 0; i < table.vClients.size(); i++)
+        accountIndexes[unpackClient(table, table.vClients[i]).accountNum] = i;
 
-    case eManageUsersMenu::REMOVE_USER:
+    // deltas are reversed on the current balances under the locks, so transactions made since the batch are kept
+    size_t numOfReversed = 0;
 
-        removeUser();
-        break;
+    for (const sAccrualEntry& entry : vEntries) {
 
-    case eManageUsersMenu::FIND_USER:
+        auto it = accountIndexes.find(std::string_view(entry.accountNum, strnlen(entry.accountNum, sizeof(entry.accountNum))));
 
-        findUser();
-        break;
+        if (it != accountIndexes.end()) {
 
-    case eManageUsersMenu::RETURN_TO_MAIN_MENU:
+            table.vClients[it->second].balance -= entry.delta;
+            numOfReversed++;
+        }
+    }
+
+    if (!writeLockedClientShards(tableToFileContent(table))) {
 
+        std::cout << "Couldn't write " << file::CLIENTS_FILE << ", nothing was rolled back\n";
         return;
     }
+
+    writeAccrualJournalState(ACCRUAL_ROLLED_BACK);
+
+    std::cout << "Accrual batch " << header.batchId << " rolled back on " << numOfReversed << " account(s)\n";
 }
 
-void manageUsers(const sUser& user) {
+int runHeadlessCommand(const std::vector <std::string>& vArgs) {
 
-    if (!checkPermissionAccess(user.permissions, ePermissions::MANAGE_USERS)) {
+    const std::string& command = vArgs[0];
 
-        printAccessDenied();
+    float amount = 0;
+
+    // a malformed amount falls through to the usage below
+    if (command == "--transfer" && vArgs.size() > 3 && parseAmount(vArgs[3], amount))
+        return runHeadlessTransfer(vArgs[1], vArgs[2], amount);
+
+    if (command == "--cache-bench") {
+
+        int numOfHotClients = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 64;
+        int numOfLookups = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : 10000000;
+
+        runClientCacheBenchmark(std::max(1, numOfHotClients), std::max(1, numOfLookups));
+        return 0;
     }
 
-    else {
+    if (command == "--snapshot-bench") {
 
-        eManageUsersMenu choice;
+        int numOfWriters = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 2;
+        double seconds = (vArgs.size() > 2) ? std::stod(vArgs[2]) : 2;
 
-        do {
+        runSnapshotBenchmark(std::max(1, numOfWriters), seconds);
+        return 0;
+    }
 
-            printManageUsersMenu();
-            choice = (eManageUsersMenu)readMenuChoice(1, 6);
+    if (command == "--analytics") {
 
-            applyManageUsersMenuChoice(choice);
+        int topN = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 10;
+        int numOfThreads = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        std::string fileName = (vArgs.size() > 3) ? vArgs[3] : file::CLIENTS_FILE;
 
-        } while (choice != eManageUsersMenu::RETURN_TO_MAIN_MENU);
+        runAnalyticsReport(std::max(0, topN), std::max(1, numOfThreads), fileName);
+        return 0;
     }
-}
 
-void applyMainMenuChoice(eMainMenu choice, sUser& user) {
+    if (command == "--audit-log") {
 
-    clearScreen();
+        printAuditLog((vArgs.size() > 1) ? std::stoul(vArgs[1]) : 50);
+        return 0;
+    }
 
-    switch (choice) {
+    if (command == "--audit-bench") {
 
-    case eMainMenu::MENU_ADD_CLIENT:
+        int numOfThreads = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 4;
+        int eventsPerThread = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : 1000000;
 
-        addClients(user);
-        break;
+        runAuditBenchmark(std::max(1, numOfThreads), std::max(1, eventsPerThread));
+        return 0;
+    }
 
-    case eMainMenu::MENU_SHOW_ALL_CLIENTS:
+    if (command == "--mutation-bench") {
 
-        showAllClients(user);
-        break;
+        runMutationBenchmark(std::max(2, (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 100000));
+        return 0;
+    }
 
-    case eMainMenu::MENU_UPDATE_CLIENT:
+    if (command == "--mutation-order-check")
+        return runMutationOrderCheck() ? 0 : 1;
 
-        updateClient(user);
-        break;
+    if (command == "--replay" && vArgs.size() > 1) {
 
-    case eMainMenu::MENU_REMOVE_CLIENT:
+        runReplay(vArgs[1], parseReplaySpeed((vArgs.size() > 2) ? vArgs[2] : "max"), (vArgs.size() > 3) ? vArgs[3] : "");
+        return 0;
+    }
 
-        removeClient(user);
-        break;
+    if (command == "--replay-compare" && vArgs.size() > 3)
+        return runReplayComparison(vArgs[1], vArgs[2], vArgs[3], (vArgs.size() > 4) ? vArgs[4] : "max") ? 0 : 1;
 
-    case eMainMenu::MENU_FIND_CLIENT:
+    if (command == "--transfer-bench") {
 
-        findClient(user);
-        break;
+        int maxThreads = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        int transfersPerThread = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : 1000;
 
-    case eMainMenu::MENU_TRANSACTIONS:
+        runTransferBenchmark(maxThreads, transfersPerThread);
+        return 0;
+    }
 
-        Transactions(user);
-        break;
+    if (command == "--statements" && vArgs.size() > 1) {
 
-    case eMainMenu::MENU_MANAGE_USERS:
+        int numOfThreads = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        int numOfShards = (vArgs.size() > 3) ? std::stoi(vArgs[3]) : numOfThreads;
 
-        manageUsers(user);
-        break;
+        runStatementJob(vArgs[1], std::max(1, numOfThreads), std::max(1, numOfShards));
+        return 0;
+    }
 
-    case eMainMenu::MENU_LOGOUT:
+    if (command == "--accrue") {
 
-        Login();
-        break;
+        int numOfThreads = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : (int)std::max(1u, std::thread::hardware_concurrency());
+
+        runAccrualJob(std::max(1, numOfThreads));
+        return 0;
     }
-}
 
-void startProgram(sUser& user) {
+    if (command == "--accrue-rollback") {
 
-    eMainMenu choice;
+        rollbackAccrualJob();
+        return 0;
+    }
 
-    do {
+    if (command == "--export-snapshot" && vArgs.size() > 1) {
 
-        printMainMenu();
-        choice = (eMainMenu)readMenuChoice(1, 8);
+        exportSnapshot(vArgs[1]);
+        return 0;
+    }
 
-        applyMainMenuChoice(choice, user);
+    if (command == "--restore-snapshot" && vArgs.size() > 1) {
 
-    } while (choice != eMainMenu::MENU_LOGOUT);
-}
+        restoreSnapshot(vArgs[1]);
+        return 0;
+    }
 
-void Login() {
+    if (command == "--generate-clients" && vArgs.size() > 2) {
 
-    std::cout << "\t\t----------------------------\n";
-    std::cout << "\t\t\tLogin Screen\n";
-    std::cout << "\t\t----------------------------\n\n";
+        generateClientsFile(std::stoll(vArgs[1]), vArgs[2]);
+        return 0;
+    }
 
-    std::vector <sUser> vUsers = loadUsersFromFile();
-    sUser user;
+    if (command == "--import-clients" && vArgs.size() > 1) {
 
-    while (true) {
+        importClients(vArgs[1]);
+        return 0;
+    }
 
-        user.name = readUsername("Enter username:");
-        user.password = readPositiveNum("Enter password:");
+    if (command == "--reshard" && vArgs.size() > 1) {
 
-        int index = getUserIndexByNameAndPassword(user.name, user.password, vUsers);
+        reshardClients(std::stoi(vArgs[1]));
+        return 0;
+    }
 
-        if (isUserExistsByIndex(index)) {
+    if (command == "--load-report") {
 
-            user.permissions = vUsers[index].permissions;
-            break;
-        }
+        printLoadReport((vArgs.size() > 1) ? vArgs[1] : file::CLIENTS_FILE);
+        return 0;
+    }
 
-        std::cout << "\nInvalid username/password\n";
-    };
+    if (command == "--commit-bench") {
 
-    clearScreen();
+        int numOfThreads = (vArgs.size() > 1) ? std::stoi(vArgs[1]) : 8;
+        int transactionsPerThread = (vArgs.size() > 2) ? std::stoi(vArgs[2]) : 100;
 
-    startProgram(user);
+        runCommitBenchmark(numOfThreads, transactionsPerThread);
+        return 0;
+    }
+
+    std::cout << "Unknown command: " << command << '\n';
+    std::cout << "Usage: Bank_System [--commit-bench <threads> <transactions per thread>]\n";
+    std::cout << "                   [--generate-clients <count> <file>]\n";
+    std::cout << "                   [--load-report [file]] [--import-clients <file>] [--reshard <shards>]\n";
+    std::cout << "                   [--export-snapshot <file>] [--restore-snapshot <file>]\n";
+    std::cout << "                   [--transfer <from> <to> <amount>] [--transfer-bench <max threads> <transfers per thread>]\n";
+    std::cout << "                   [--statements <YYYY-MM> [threads] [shards]]\n";
+    std::cout << "                   [--accrue [threads]] [--accrue-rollback]\n";
+    std::cout << "                   [--cache-bench [hot accounts] [lookups]] [--snapshot-bench [writers] [seconds]]\n";
+    std::cout << "                   [--analytics [top N] [threads] [file]]\n";
+    std::cout << "                   [--audit-log [count]] [--audit-bench [threads] [events per thread]]\n";
+    std::cout << "                   [--mutation-bench [updates]] [--mutation-order-check]\n";
+    std::cout << "                   [--capture <trace file>] [--replay <trace file> [max|original|<speedup>] [results file]]\n";
+    std::cout << "                   [--replay-compare <trace file> <baseline build> <candidate build> [max|original|<speedup>]]\n";
+
+    return 1;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+
+    if (!loadShardCount())
+        return 1;
+    loadSettingsFromFile();
+    recoverAccrualJournal();
+
+    // an interactive session whose operations are recorded for --replay
+    if (argc > 2 && std::string(argv[1]) == "--capture")
+        startTraceCapture(argv[2]);
+
+    else if (argc > 1)
+        return runHeadlessCommand(std::vector <std::string>(argv + 1, argv + argc));
+
+    startAuditWriter();
 
     Login();
 